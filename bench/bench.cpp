@@ -0,0 +1,810 @@
+#include <config.hh>
+#include <termgui.hh>
+#include <commands.hh>
+#include <fileio.hh>
+#include <version.hh>
+#include <memstats.hh>
+#include <grep.hh>
+#include <protocol.hh>
+#include <crdt.hh>
+#include <snapshot.hh>
+#include <lz.hh>
+#include <regex.hh>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <filesystem>
+#include <random>
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <poll.h>
+
+///////////////////
+// ALLOCATION COUNTING
+///////////////////
+
+static std::atomic<size_t> allocCount{0};
+static std::atomic<size_t> allocBytes{0};
+
+void *operator new(size_t n)
+{
+    allocCount.fetch_add(1, std::memory_order_relaxed);
+    allocBytes.fetch_add(n, std::memory_order_relaxed);
+    if (void *p = std::malloc(n ? n : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void *operator new[](size_t n)
+{
+    return operator new(n);
+}
+
+// GCC sees free() meet a pointer from operator new once these are inlined, not knowing new is malloc here
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete[](void *p) noexcept { std::free(p); }
+void operator delete(void *p, size_t) noexcept { std::free(p); }
+void operator delete[](void *p, size_t) noexcept { std::free(p); }
+#pragma GCC diagnostic pop
+
+///////////////////
+// CORPORA
+///////////////////
+
+/**
+ * @struct Corpus
+ * @brief A named, synthetic document used as benchmark input.
+ *
+ * @param name Short identifier written to the results file.
+ * @param ext File extension, selects the highlighting scheme.
+ * @param lines The document contents, one entry per row.
+ */
+struct Corpus
+{
+    std::string name;
+    std::string ext;
+    std::vector<std::string> lines;
+};
+
+static const char *cppWords[] = {"int", "return", "const", "auto", "for", "if", "while", "static", "std::string",
+                                 "size_t", "value", "count", "buffer", "row", "cfg", "namespace", "template", "void"};
+
+/**
+ * @brief Generates C++-like source with keywords, strings, numbers and comments.
+ */
+static Corpus genCpp(size_t nLines, std::mt19937 &rng)
+{
+    Corpus c{"cpp", ".cpp", {}};
+    std::uniform_int_distribution<int> words(0, std::size(cppWords) - 1), len(0, 12), kind(0, 9), depth(0, 3);
+    for (size_t i = 0; i < nLines; i++)
+    {
+        std::string line(depth(rng) * TABSTOP, ' ');
+        int k = kind(rng);
+        if (k == 0)
+        {
+            line += "// ";
+        }
+        int n = len(rng);
+        for (int w = 0; w < n; w++)
+        {
+            line += cppWords[words(rng)];
+            line += (w % 4 == 3) ? "(\"text\", 42.5); " : " ";
+        }
+        if (k == 1)
+            line += "{";
+        c.lines.push_back(line);
+    }
+    return c;
+}
+
+/**
+ * @brief Generates minified JSON: a handful of rows each several kilobytes long.
+ */
+static Corpus genJson(size_t nLines, std::mt19937 &rng)
+{
+    Corpus c{"json", ".json", {}};
+    std::uniform_int_distribution<int> fields(200, 600), num(0, 100000);
+    for (size_t i = 0; i < nLines; i++)
+    {
+        std::string line = "{";
+        int n = fields(rng);
+        for (int f = 0; f < n; f++)
+        {
+            line += "\"key" + std::to_string(f) + "\":" + std::to_string(num(rng)) + ",\"s\":\"value\",";
+        }
+        line += "\"end\":true}";
+        c.lines.push_back(line);
+    }
+    return c;
+}
+
+/**
+ * @brief Generates a Makefile where every recipe line is tab-indented.
+ */
+static Corpus genMakefile(size_t nLines, std::mt19937 &rng)
+{
+    Corpus c{"makefile", ".mk", {}};
+    std::uniform_int_distribution<int> tabs(1, 3), kind(0, 4);
+    for (size_t i = 0; i < nLines; i++)
+    {
+        if (kind(rng) == 0)
+            c.lines.push_back("target" + std::to_string(i) + ": dep" + std::to_string(i) + ".o\tother.o");
+        else
+            c.lines.push_back(std::string(tabs(rng), '\t') + "$(CC) $(CFLAGS)\t-c $<\t-o $@\t# step " + std::to_string(i));
+    }
+    return c;
+}
+
+/**
+ * @brief Builds an editor configuration holding the corpus, as if opened from disk.
+ */
+static void loadCorpus(Config &cfg, const Corpus &corpus)
+{
+    cfg.fileData = TTEdFileData{};
+    cfg.fileData.path = "bench" + corpus.ext;
+    parseFileExtension(cfg);
+    for (const std::string &line : corpus.lines)
+    {
+        cfg.fileData.fileData.emplace_back(std::make_shared<Row>(Row{line}));
+    }
+    cfg.cursor = TTEdCursor{};
+    cfg.term.sRow = 50;
+    cfg.term.sCol = 200;
+}
+
+///////////////////
+// HARNESS
+///////////////////
+
+/**
+ * @struct Result
+ * @brief Per-operation measurements for a single benchmark run.
+ */
+struct Result
+{
+    std::string name;
+    std::string corpus;
+    size_t iterations;
+    double nsPerOp;
+    double allocsPerOp;
+    double allocBytesPerOp;
+    double bytesEmittedPerOp;
+};
+
+static std::vector<Result> results;
+static std::vector<std::pair<std::string, MemStats::Breakdown>> memory;
+static int emitFd = -1;
+static size_t failures = 0;
+
+/**
+ * @brief Records whether a benchmarked operation did its job; a run timing failed operations
+ * says nothing, so it is reported and the suite exits non-zero.
+ *
+ * @param what The operation, printed for the first few failures only.
+ * @return ok.
+ */
+static bool check(bool ok, const char *what, const std::string &corpus)
+{
+    if (!ok && failures++ < 10)
+    {
+        std::cerr << "FAILED: " << what << " [" << corpus << "]\n";
+    }
+    return ok;
+}
+
+/**
+ * @brief Bytes written to stdout since the last call, stdout being redirected to a scratch file.
+ */
+static size_t takeEmitted()
+{
+    off_t n = lseek(emitFd, 0, SEEK_CUR);
+    lseek(emitFd, 0, SEEK_SET);
+    if (ftruncate(emitFd, 0) != 0)
+        return 0;
+    return n < 0 ? 0 : n;
+}
+
+/**
+ * @brief Runs op(i) in growing batches until at least minTime has been spent, then records per-op figures.
+ *
+ * @param setup Called before every batch to reset state, excluded from measurements.
+ */
+template <typename Setup, typename Op>
+static void bench(const std::string &name, const std::string &corpus, Setup setup, Op op)
+{
+    using clock = std::chrono::steady_clock;
+    const auto minTime = std::chrono::milliseconds(200);
+
+    size_t batch = 1;
+    while (true)
+    {
+        setup();
+        takeEmitted();
+        size_t a0 = allocCount.load(), b0 = allocBytes.load();
+        auto t0 = clock::now();
+        for (size_t i = 0; i < batch; i++)
+        {
+            op(i);
+        }
+        auto elapsed = clock::now() - t0;
+        size_t allocs = allocCount.load() - a0, bytes = allocBytes.load() - b0;
+        size_t emitted = takeEmitted();
+
+        if (elapsed >= minTime || batch >= (1u << 24))
+        {
+            double n = batch;
+            results.push_back({name, corpus, batch,
+                               std::chrono::duration<double, std::nano>(elapsed).count() / n,
+                               allocs / n, bytes / n, emitted / n});
+            std::cerr << name << " [" << corpus << "] " << results.back().nsPerOp << " ns/op\n";
+            return;
+        }
+        batch *= 2;
+    }
+}
+
+static void writeJson(std::ostream &os)
+{
+    os << "{\n  \"version\": \"" << VERSION << "\",\n  \"benchmarks\": [\n";
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const Result &r = results[i];
+        os << "    {\"name\": \"" << r.name << "\", \"corpus\": \"" << r.corpus
+           << "\", \"iterations\": " << r.iterations
+           << ", \"ns_per_op\": " << r.nsPerOp
+           << ", \"allocs_per_op\": " << r.allocsPerOp
+           << ", \"alloc_bytes_per_op\": " << r.allocBytesPerOp
+           << ", \"bytes_emitted_per_op\": " << r.bytesEmittedPerOp << "}"
+           << (i + 1 < results.size() ? ",\n" : "\n");
+    }
+    os << "  ],\n  \"memory\": [\n";
+    for (size_t i = 0; i < memory.size(); i++)
+    {
+        const MemStats::Breakdown &m = memory[i].second;
+        os << "    {\"corpus\": \"" << memory[i].first
+           << "\", \"raw_text\": " << m.rawText
+           << ", \"render\": " << m.render
+           << ", \"highlight\": " << m.highlight
+           << ", \"layout\": " << m.layout
+           << ", \"search\": " << m.search
+           << ", \"rows\": " << m.rows
+           << ", \"undo\": " << m.undo
+           << ", \"crdt\": " << m.crdt
+           << ", \"network\": " << m.network
+           << ", \"total\": " << m.total() << "}"
+           << (i + 1 < memory.size() ? ",\n" : "\n");
+    }
+    os << "  ]\n}\n";
+}
+
+///////////////////
+// BENCHMARKS
+///////////////////
+
+static void reportMemory(const Corpus &corpus)
+{
+    Config cfg;
+    loadCorpus(cfg, corpus);
+    memory.emplace_back(corpus.name, MemStats::collect(cfg));
+    std::cerr << corpus.name << " " << memory.back().second.summary() << "\n";
+}
+
+static void benchRow(const Corpus &corpus)
+{
+    Config cfg;
+    loadCorpus(cfg, corpus);
+    auto &rows = cfg.fileData.fileData;
+    TTEdCursor cursor;
+
+    // Alternate insert/delete in the middle of each row so row lengths stay stable
+    bench("Row::insertChar", corpus.name, [] {}, [&](size_t i) {
+        Row &r = *rows[i % rows.size()];
+        cursor.cx = r.size() / 2;
+        r.insertChar(cursor, 'x');
+    });
+    bench("Row::deleteChar", corpus.name, [] {}, [&](size_t i) {
+        Row &r = *rows[i % rows.size()];
+        cursor.cx = r.size() / 2 + 1;
+        r.deleteChar(cursor);
+        r.insertChar(cursor, 'x');
+    });
+    bench("Row::parseStates", corpus.name, [] {}, [&](size_t i) {
+        rows[i % rows.size()]->parseStates();
+    });
+    bench("Row::updateRender", corpus.name, [] {}, [&](size_t i) {
+        rows[i % rows.size()]->updateRender();
+    });
+}
+
+static void benchFileData(const Corpus &corpus)
+{
+    Config cfg;
+    bench("TTEdFileData::insertNewLine", corpus.name, [&] { loadCorpus(cfg, corpus); }, [&](size_t i) {
+        auto &fd = cfg.fileData;
+        cfg.cursor.cy = (i * 7919) % fd.size();
+        cfg.cursor.cx = fd.at(cfg.cursor.cy)->size() / 2;
+        fd.insertNewLine(cfg.cursor);
+    });
+
+    // With the visual line index in use, each new row is spliced into it, then the frame's scroll reads it
+    bench("TTEdFileData::insertNewLine (soft wrap)", corpus.name, [&] {
+        loadCorpus(cfg, corpus);
+        cfg.term.softWrap = true;
+        cfg.scroll();
+    }, [&](size_t i) {
+        auto &fd = cfg.fileData;
+        cfg.cursor.cy = (i * 7919) % fd.size();
+        cfg.cursor.cx = fd.at(cfg.cursor.cy)->size() / 2;
+        fd.insertNewLine(cfg.cursor);
+        cfg.scroll();
+    });
+
+    // Folding the whole file then revealing a row in the middle, as moving into a fold does
+    bench("TTEdFileData::fold + reveal", corpus.name, [&] {
+        loadCorpus(cfg, corpus);
+        cfg.fileData.syncLines(0);
+    }, [&](size_t i) {
+        auto &fd = cfg.fileData;
+        fd.fold(0, fd.size() - 1);
+        fd.reveal(1 + i % (fd.size() - 1));
+    });
+}
+
+static void benchFileIO(const Corpus &corpus)
+{
+    std::string path = "./build/bench_corpus" + corpus.ext;
+    {
+        std::ofstream ofs(path, std::ofstream::trunc);
+        for (const std::string &line : corpus.lines)
+            ofs << line << '\n';
+    }
+
+    Config cfg;
+    bench("FileIO::openFile", corpus.name, [] {}, [&](size_t) {
+        cfg.fileData = TTEdFileData{};
+        check(FileIO::openFile(cfg, path) == 0 && cfg.fileData.size() == corpus.lines.size(), "FileIO::openFile", corpus.name);
+    });
+    bench("FileIO::saveFile", corpus.name, [] {}, [&](size_t) {
+        check(FileIO::saveFile(cfg) == 0, "FileIO::saveFile", corpus.name);
+    });
+    std::remove(path.c_str());
+}
+
+static void benchGrep(const Corpus &corpus)
+{
+    // The corpus split over a tree of 64 files in 8 directories
+    std::filesystem::path root = "./build/bench_tree";
+    std::filesystem::remove_all(root);
+    size_t per = (corpus.lines.size() + 63) / 64;
+    for (size_t f = 0; f < 64; f++)
+    {
+        std::filesystem::path dir = root / ("d" + std::to_string(f % 8));
+        std::filesystem::create_directories(dir);
+        std::ofstream ofs(dir / ("f" + std::to_string(f) + corpus.ext), std::ofstream::trunc);
+        for (size_t i = f * per; i < std::min(corpus.lines.size(), (f + 1) * per); i++)
+            ofs << corpus.lines[i] << '\n';
+    }
+
+    bench("Grep", corpus.name, [] {}, [&](size_t) {
+        Grep grep(root, "value", false);
+        grep.wait();
+    });
+    bench("Grep (regex)", corpus.name, [] {}, [&](size_t) {
+        Grep grep(root, "val[a-z]+e", true);
+        grep.wait();
+    });
+    std::filesystem::remove_all(root);
+}
+
+static void benchSearch(const Corpus &corpus)
+{
+    Config cfg;
+    loadCorpus(cfg, corpus);
+
+    // Alternating two queries absent from the corpus, neither extending the other, forces a
+    // scan of the whole file per keystroke
+    bench("Commands::Search::callback", corpus.name, [] {}, [&](size_t i) {
+        Commands::Search::callback(cfg, i % 2 ? "no_such_identifier" : "no_such_identifiex", 'r');
+    });
+
+    // An uppercase letter turns smart case off, taking the exact-byte path
+    bench("Commands::Search::callback (case)", corpus.name, [] {}, [&](size_t i) {
+        Commands::Search::callback(cfg, i % 2 ? "No_such_identifier" : "No_such_identifiex", 'r');
+    });
+
+    // A common query collects and counts many matches, split across the thread pool
+    bench("Commands::Search::callback (count)", corpus.name, [] {}, [&](size_t i) {
+        Commands::Search::callback(cfg, i % 2 ? "return" : "retur", 'r');
+    });
+
+    // Regex mode: each query compiles once, then its lazy DFA scans every row
+    cfg.search.regex = true;
+    bench("Commands::Search::callback (regex)", corpus.name, [] {}, [&](size_t i) {
+        Commands::Search::callback(cfg, i % 2 ? "no_such_[a-z]+er" : "(x+x+)+y", 'r');
+    });
+    Commands::Search::callback(cfg, "", '\r');
+    cfg.search.regex = false;
+
+    // Typing a whole query: each keystroke narrows the previous one's matches
+    const std::string query = "no_such_identifier";
+    bench("Commands::Search::callback (typing)", corpus.name, [] {}, [&](size_t) {
+        for (size_t n = 1; n <= query.size(); n++)
+            Commands::Search::callback(cfg, query.substr(0, n), query[n - 1]);
+        Commands::Search::callback(cfg, query, '\r');
+    });
+    Commands::Search::callback(cfg, "", '\r');
+
+    // Replacing an identifier and back again leaves the corpus as it was
+    bench("Commands::Replace::all", corpus.name, [] {}, [&](size_t i) {
+        if (i % 2)
+            Commands::Replace::all(cfg, "valve", "value", false);
+        else
+            Commands::Replace::all(cfg, "value", "valve", false);
+    });
+}
+
+static void benchLongRow()
+{
+    // Patterns whose matches a search restarted after each one would rescan to the end of the row for
+    std::string alternating;
+    while (alternating.size() < 80000)
+        alternating += "cb";
+    std::vector<std::pair<size_t, size_t>> spans;
+    Regex dangling("c.*Q|b", false);
+    bench("Regex::findAll (c.*Q|b)", "80K row", [] {}, [&](size_t) {
+        dangling.findAll(alternating, spans);
+    });
+    std::string run(40000, 'a');
+    Regex plus("a+", false);
+    bench("Regex::findAll (a+)", "40K row", [] {}, [&](size_t) {
+        plus.findAll(run, spans);
+    });
+
+    // The same as a keystroke in regex mode on a file of one long line
+    Config cfg;
+    cfg.fileData.insertRow(0, Row(alternating));
+    cfg.search.regex = true;
+    bench("Commands::Search::callback (regex)", "80K row", [] {}, [&](size_t i) {
+        Commands::Search::callback(cfg, i % 2 ? "c.*Q|b" : "c.*Z|b", 'r');
+    });
+    Commands::Search::callback(cfg, "", '\r');
+}
+
+// The x-th key of a line of typing by one site, inserted after the key before it
+static Protocol::Op typed(size_t i, size_t x)
+{
+    Protocol::Op op;
+    op.id = Protocol::Id{i * 80 + x + 1, 7};
+    op.after = x > 0 ? Protocol::Id{i * 80 + x, 7} : Protocol::Id{};
+    op.text = std::string(1, 'a' + x % 26);
+    return op;
+}
+
+static void benchProtocol()
+{
+    // A line of fast typing, batched into one frame and decoded on the other side
+    Protocol::Writer writer;
+    Protocol::Reader reader;
+    std::string wire;
+    std::vector<Protocol::Op> ops;
+    bench("Protocol (80 keys)", "typing", [] {}, [&](size_t i) {
+        for (size_t x = 0; x < 80; x++)
+            writer.add(typed(i, x));
+        wire.clear();
+        writer.finish(wire);
+        ops.clear();
+        reader.feed(wire.data(), wire.size());
+        bool ok = reader.decode(ops);
+        size_t keys = 0;
+        for (const Protocol::Op &op : ops)
+            keys += op.text.size();
+        check(ok && keys == 80, "Protocol::Reader::decode", "typing");
+    });
+}
+
+static void benchFanout(size_t viewers)
+{
+    // A host broadcasting a line of typing to its viewers, each read back on a thread of its own
+    TTEdConnection conn;
+    std::vector<int> ends;
+    for (size_t v = 0; v < viewers; v++)
+    {
+        int sv[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0)
+            return;
+        conn.add(sv[0], "viewer").synced = true;
+        ends.push_back(sv[1]);
+    }
+    std::atomic<bool> stop{false};
+    std::thread drain([&] {
+        std::vector<pollfd> fds;
+        for (int fd : ends)
+            fds.push_back({fd, POLLIN, 0});
+        char buf[1 << 16];
+        while (!stop.load())
+        {
+            if (poll(fds.data(), fds.size(), 10) <= 0)
+                continue;
+            for (const pollfd &p : fds)
+                if (p.revents & POLLIN)
+                    read(p.fd, buf, sizeof(buf));
+        }
+    });
+
+    // As in the editor's loop, receiving is what unblocks viewers whose sockets filled up
+    std::vector<Protocol::Op> ops;
+    bench("TTEdConnection::flush (80 keys)", std::to_string(viewers) + " viewers", [] {}, [&](size_t i) {
+        for (size_t x = 0; x < 80; x++)
+            conn.queue(typed(i, x));
+        conn.flush(true);
+        conn.receive(ops);
+    });
+    for (const auto &[id, peer] : conn.peers)
+        if (!peer.error.empty())
+            std::cerr << "viewer " << id << " lost: " << peer.error << "\n";
+
+    stop = true;
+    drain.join();
+    conn.close();
+    for (int fd : ends)
+        close(fd);
+}
+
+static void benchNet()
+{
+    // A line of typing handed across a ring, as between the editor and the network thread
+    Ring<NetMsg> ring(NetThread::RING);
+    NetMsg msg;
+    bench("Ring (80 keys)", "typing", [] {}, [&](size_t i) {
+        for (size_t x = 0; x < 80; x++)
+        {
+            msg.op = typed(i, x);
+            ring.push(msg);
+            ring.pop(msg);
+        }
+    });
+
+    // A host whose one viewer never reads: what typing costs the editor must not grow as the viewer falls behind
+    Config host;
+    uint16_t port = 0;
+    for (uint16_t p = 47000; p < 47100 && port == 0; p++)
+    {
+        NetMsg listen;
+        listen.kind = NetMsg::LISTEN;
+        listen.port = p;
+        host.net.post(std::move(listen));
+        for (int t = 0; t < 1000 && !host.session.connected && host.status.statusMsg.empty(); t++)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            host.recv();
+        }
+        port = host.session.connected ? p : 0;
+        host.status.statusMsg.clear();
+    }
+    int viewer = socket(AF_INET, SOCK_STREAM, 0);
+    int small = 4096;
+    setsockopt(viewer, SOL_SOCKET, SO_RCVBUF, &small, sizeof(small));
+    struct sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    std::string hello;
+    Snapshot::hello({}, {}, hello);
+    if (port == 0 || connect(viewer, (struct sockaddr *)&address, sizeof(address)) != 0 ||
+        write(viewer, hello.data(), hello.size()) != (ssize_t)hello.size())
+    {
+        std::cerr << "net: no session to bench\n";
+        close(viewer);
+        return;
+    }
+    for (int t = 0; t < 1000 && host.session.peers == 0; t++)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        host.recv();
+    }
+
+    bench("Config::share (80 keys)", "stalled viewer", [] {}, [&](size_t) {
+        for (size_t x = 0; x < 80; x++)
+        {
+            host.fileData.journal.push_back(Crdt::Change{0, x, 0, "a"});
+            host.share();
+        }
+        host.recv();
+    });
+    host.net.stop();
+    close(viewer);
+}
+
+static void benchCrdt(const Corpus &corpus)
+{
+    Config cfg;
+    loadCorpus(cfg, corpus);
+    Crdt::Sequence local, remote;
+    bench("Crdt::Sequence::load", corpus.name, [] {}, [&](size_t) {
+        local.load(cfg.fileData);
+    });
+    std::string layout;
+    local.encode(layout);
+    check(remote.decode(layout, cfg.fileData), "Crdt::Sequence::decode", corpus.name);
+    Crdt::Log log;
+    log.start(local.version());
+    Crdt::Version joined = remote.version();
+
+    // A line typed a key at a time on a row spread through the file, then erased, and the
+    // same operations integrated by a peer
+    std::mt19937 rng(7);
+    std::vector<Protocol::Op> ops;
+    std::vector<Crdt::Change> changes;
+    bench("Crdt::Sequence (80 keys)", corpus.name, [] {}, [&](size_t) {
+        size_t row = rng() % cfg.fileData.size();
+        ops.clear();
+        for (size_t x = 0; x < 80; x++)
+        {
+            Protocol::Op op;
+            check(local.local(Crdt::Change{row, x, 0, std::string(1, 'a' + x % 26)}, op), "Crdt::Sequence::local", corpus.name);
+            ops.push_back(std::move(op));
+        }
+        Protocol::Op op;
+        check(local.local(Crdt::Change{row, 0, 80, ""}, op), "Crdt::Sequence::local", corpus.name);
+        ops.push_back(std::move(op));
+        changes.clear();
+        for (const Protocol::Op &o : ops)
+        {
+            log.keep(o);
+            remote.apply(o, changes);
+        }
+        check(remote.size() == local.size(), "Crdt::Sequence::apply", corpus.name);
+    });
+
+    // A peer that dropped right after joining, resumed from the log rather than sent the document
+    std::string wire;
+    std::vector<Protocol::Op> missed;
+    bench("Crdt::Log::since (resume)", corpus.name, [] {}, [&](size_t) {
+        missed.clear();
+        log.since(joined, missed);
+        Protocol::Writer writer;
+        for (const Protocol::Op &o : missed)
+            writer.add(o);
+        wire.clear();
+        writer.finish(wire);
+    });
+    std::cerr << corpus.name << " resume: " << wire.size() << " bytes for " << missed.size() << " edits, log "
+              << log.bytes() << " bytes\n";
+    std::cerr << corpus.name << " crdt: " << local.blocks() << " blocks, " << local.bytes() << " bytes for "
+              << local.size() << " chars\n";
+}
+
+static void benchSnapshot(const Corpus &corpus)
+{
+    Config host;
+    loadCorpus(host, corpus);
+    std::string text = host.fileData.streamify().str();
+
+    std::string packed, unpacked;
+    bench("Lz::compress", corpus.name, [] {}, [&](size_t) {
+        packed.clear();
+        Lz::compress(text, packed);
+    });
+    bench("Lz::decompress", corpus.name, [] {}, [&](size_t) {
+        unpacked.clear();
+        check(Lz::decompress(packed, text.size(), unpacked) && unpacked == text, "Lz::decompress", corpus.name);
+    });
+
+    // A peer joining over a local socket: the host sends while the peer receives and builds its rows
+    host.session.doc.load(host.fileData);
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0)
+        return;
+    Config peer;
+    bench("Snapshot (send+receive)", corpus.name, [] {}, [&](size_t) {
+        std::string wire, err;
+        Protocol::Reader live;
+        std::thread sender([&] {
+            Snapshot::encode(host.fileData, host.session.doc, wire);
+            for (size_t at = 0; at < wire.size();)
+            {
+                ssize_t n = write(sv[0], wire.data() + at, wire.size() - at);
+                if (n <= 0)
+                    break;
+                at += n;
+            }
+        });
+        Crdt::Version resumed;
+        check(Snapshot::receive(sv[1], peer, live, resumed, err) && peer.fileData.size() == host.fileData.size(),
+              "Snapshot::receive", corpus.name);
+        sender.join();
+    });
+    close(sv[0]);
+    close(sv[1]);
+}
+
+static void benchDraw(const Corpus &corpus)
+{
+    Config cfg;
+    loadCorpus(cfg, corpus);
+    TerminalGUI gui(cfg);
+
+    bench("TerminalGUI::draw", corpus.name, [] {}, [&](size_t i) {
+        cfg.cursor.cy = i % cfg.fileData.size();
+        gui.draw();
+    });
+
+    // Forgetting the screen forces the full repaint a resize or first frame costs
+    bench("TerminalGUI::draw (repaint)", corpus.name, [] {}, [&](size_t i) {
+        cfg.cursor.cy = i % cfg.fileData.size();
+        gui.invalidate();
+        gui.draw();
+    });
+
+    // Scrolling with a search open: every visible match is drawn over the syntax colors
+    cfg.search.active = true;
+    Commands::Search::callback(cfg, "e", 'e');
+    cfg.cursor.cx = 0;
+    bench("TerminalGUI::draw (search)", corpus.name, [] {}, [&](size_t i) {
+        cfg.cursor.cy = i % cfg.fileData.size();
+        gui.draw();
+    });
+    Commands::Search::callback(cfg, "", '\x1b');
+}
+
+int main(int argc, char *argv[])
+{
+    std::string out = argc > 1 ? argv[1] : "./build/bench.json";
+
+    // Everything the editor writes to the terminal lands in a scratch file so it can be counted
+    std::string emitPath = "./build/bench_emit.tmp";
+    emitFd = open(emitPath.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (emitFd < 0)
+    {
+        perror("open");
+        return 1;
+    }
+    int savedStdout = dup(STDOUT_FILENO);
+    dup2(emitFd, STDOUT_FILENO);
+
+    std::mt19937 rng(42);
+    std::vector<Corpus> corpora = {genCpp(20000, rng), genJson(64, rng), genMakefile(20000, rng)};
+
+    benchLongRow();
+    benchProtocol();
+    benchFanout(1);
+    benchFanout(16);
+    benchNet();
+    for (const Corpus &corpus : corpora)
+    {
+        reportMemory(corpus);
+        benchRow(corpus);
+        benchFileData(corpus);
+        benchFileIO(corpus);
+        benchSearch(corpus);
+        benchGrep(corpus);
+        benchCrdt(corpus);
+        benchSnapshot(corpus);
+        benchDraw(corpus);
+    }
+
+    dup2(savedStdout, STDOUT_FILENO);
+    close(emitFd);
+    std::remove(emitPath.c_str());
+
+    std::ofstream ofs(out, std::ofstream::trunc);
+    writeJson(ofs);
+    std::cerr << "Results written to " << out << "\n";
+    if (failures > 0)
+    {
+        std::cerr << failures << " benchmarked operations failed\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,456 @@
+#include <version.hh>
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <thread>
+#include <cstring>
+#include <csignal>
+#include <pty.h>
+#include <unistd.h>
+#include <sys/select.h>
+#include <sys/wait.h>
+
+using Clock = std::chrono::steady_clock;
+
+/**
+ * @struct Options
+ * @brief Command line options of the latency harness.
+ */
+struct Options
+{
+    std::string editor = "./build/tinyted";
+    std::string out = "./build/latency.json";
+    size_t samples = 200;
+    size_t largeLines = 1000000;
+    size_t longLen = 1024 * 1024;
+    int loadTimeout = 600;
+    unsigned short rows = 40;
+    unsigned short cols = 120;
+};
+
+///////////////////
+// SCREEN MODEL
+///////////////////
+
+/**
+ * @class Screen
+ * @brief Minimal VT100 model: enough of the escape-sequence stream to know which glyph is in each cell.
+ */
+class Screen
+{
+private:
+    size_t nRows, nCols;
+    std::vector<std::string> cells;
+    size_t row = 0, col = 0;
+    size_t top = 0, bottom;
+    enum
+    {
+        TEXT,
+        ESC,
+        CSI
+    } state = TEXT;
+    std::string params;
+
+    void scrollUp(size_t n)
+    {
+        for (size_t i = 0; i < n; i++)
+        {
+            cells.erase(cells.begin() + top);
+            cells.insert(cells.begin() + bottom, std::string(nCols, ' '));
+        }
+    }
+
+    void scrollDown(size_t n)
+    {
+        for (size_t i = 0; i < n; i++)
+        {
+            cells.erase(cells.begin() + bottom);
+            cells.insert(cells.begin() + top, std::string(nCols, ' '));
+        }
+    }
+
+    std::vector<size_t> numbers() const
+    {
+        std::vector<size_t> v;
+        size_t cur = 0;
+        bool any = false;
+        for (char c : params)
+        {
+            if (c >= '0' && c <= '9')
+            {
+                cur = cur * 10 + (c - '0');
+                any = true;
+            }
+            else if (c == ';')
+            {
+                v.push_back(any ? cur : 0);
+                cur = 0;
+                any = false;
+            }
+        }
+        v.push_back(any ? cur : 0);
+        return v;
+    }
+
+    void csi(char final)
+    {
+        if (!params.empty() && (params[0] == '?' || params[0] == '>'))
+            return; // Private modes (cursor visibility, synchronized output) do not affect cells
+
+        std::vector<size_t> n = numbers();
+        size_t n0 = n[0] ? n[0] : 1;
+        switch (final)
+        {
+        case 'H':
+        case 'f':
+            row = std::min(n0, nRows) - 1;
+            col = std::min(n.size() > 1 && n[1] ? n[1] : 1, nCols) - 1;
+            break;
+        case 'K':
+            if (n[0] == 0)
+                std::fill(cells[row].begin() + col, cells[row].end(), ' ');
+            else if (n[0] == 2)
+                cells[row].assign(nCols, ' ');
+            break;
+        case 'J':
+            if (n[0] == 2)
+                cells.assign(nRows, std::string(nCols, ' '));
+            break;
+        case 'r':
+            top = n[0] ? n[0] - 1 : 0;
+            bottom = n.size() > 1 && n[1] ? n[1] - 1 : nRows - 1;
+            row = col = 0;
+            break;
+        case 'S':
+            scrollUp(n0);
+            break;
+        case 'T':
+            scrollDown(n0);
+            break;
+        default:
+            break;
+        }
+    }
+
+public:
+    Screen(size_t rows, size_t cols) : nRows(rows), nCols(cols), cells(rows, std::string(cols, ' ')), bottom(rows - 1) {}
+
+    void feed(const char *data, size_t len)
+    {
+        for (size_t i = 0; i < len; i++)
+        {
+            char c = data[i];
+            switch (state)
+            {
+            case TEXT:
+                if (c == '\x1b')
+                    state = ESC;
+                else if (c == '\r')
+                    col = 0;
+                else if (c == '\n')
+                {
+                    if (row == bottom)
+                        scrollUp(1);
+                    else if (row + 1 < nRows)
+                        row++;
+                }
+                else if ((unsigned char)c >= ' ')
+                {
+                    if (col < nCols)
+                        cells[row][col++] = c;
+                }
+                break;
+            case ESC:
+                if (c == '[')
+                {
+                    state = CSI;
+                    params.clear();
+                    break;
+                }
+                if (c == 'D')
+                    row == bottom ? scrollUp(1) : (void)row++;
+                else if (c == 'M')
+                    row == top ? scrollDown(1) : (void)row--;
+                state = TEXT;
+                break;
+            case CSI:
+                if (c >= 0x40 && c <= 0x7e)
+                {
+                    csi(c);
+                    state = TEXT;
+                }
+                else
+                    params += c;
+                break;
+            }
+        }
+    }
+
+    char at(size_t r, size_t c) const
+    {
+        return cells[r][c];
+    }
+
+    const std::string &line(size_t r) const
+    {
+        return cells[r];
+    }
+};
+
+///////////////////
+// EDITOR SESSION
+///////////////////
+
+/**
+ * @class Session
+ * @brief The editor running under a pseudo-terminal, with its output fed into a Screen.
+ */
+class Session
+{
+private:
+    int master = -1;
+    pid_t pid = -1;
+
+public:
+    Screen screen;
+    size_t bytesRead = 0;
+
+    Session(const Options &opt, const std::string &file) : screen(opt.rows, opt.cols)
+    {
+        struct winsize ws = {opt.rows, opt.cols, 0, 0};
+        pid = forkpty(&master, nullptr, nullptr, &ws);
+        if (pid == 0)
+        {
+            execl(opt.editor.c_str(), opt.editor.c_str(), file.c_str(), (char *)nullptr);
+            perror("execl");
+            _exit(127);
+        }
+        if (pid < 0)
+        {
+            perror("forkpty");
+            exit(1);
+        }
+    }
+
+    ~Session()
+    {
+        // Quit twice in case the buffer was left modified
+        send("\x11");
+        pump(std::chrono::milliseconds(100));
+        send("\x11");
+        pump(std::chrono::milliseconds(100));
+        kill(pid, SIGTERM);
+        waitpid(pid, nullptr, 0);
+        close(master);
+    }
+
+    void send(const std::string &keys)
+    {
+        if (write(master, keys.data(), keys.size()) != (ssize_t)keys.size())
+            perror("write");
+    }
+
+    /**
+     * @brief Reads output until the predicate holds on the screen or the timeout expires.
+     *
+     * @return True if the predicate held before the timeout.
+     */
+    template <typename Pred>
+    bool waitFor(Pred pred, std::chrono::milliseconds timeout)
+    {
+        auto deadline = Clock::now() + timeout;
+        char buf[65536];
+        while (!pred(screen))
+        {
+            auto left = std::chrono::duration_cast<std::chrono::microseconds>(deadline - Clock::now());
+            if (left.count() <= 0)
+                return false;
+
+            fd_set fds;
+            FD_ZERO(&fds);
+            FD_SET(master, &fds);
+            struct timeval tv = {(time_t)(left.count() / 1000000), (suseconds_t)(left.count() % 1000000)};
+            if (select(master + 1, &fds, nullptr, nullptr, &tv) <= 0)
+                continue;
+
+            ssize_t n = read(master, buf, sizeof(buf));
+            if (n <= 0)
+                return false;
+            bytesRead += n;
+            screen.feed(buf, n);
+        }
+        return true;
+    }
+
+    void pump(std::chrono::milliseconds duration)
+    {
+        waitFor([](const Screen &) { return false; }, duration);
+    }
+};
+
+///////////////////
+// SCENARIOS
+///////////////////
+
+/**
+ * @struct Result
+ * @brief Latency distribution and output volume for one scenario.
+ */
+struct Result
+{
+    std::string name;
+    size_t lines;
+    std::vector<double> latenciesUs;
+    std::vector<size_t> bytes;
+    size_t timeouts = 0;
+};
+
+static std::string writeFile(const std::string &name, size_t lines, size_t firstLen)
+{
+    std::string path = "./build/latency_" + name + ".cpp";
+    std::ofstream ofs(path, std::ofstream::trunc);
+    ofs << "int " << std::string(firstLen > 4 ? firstLen - 4 : 0, 'x') << '\n';
+    for (size_t i = 1; i < lines; i++)
+    {
+        ofs << "    int value" << i << " = " << i << "; // line " << i << '\n';
+    }
+    return path;
+}
+
+static Result runScenario(const Options &opt, const std::string &name, size_t lines, size_t firstLen)
+{
+    std::string path = writeFile(name, lines, firstLen);
+    Result res{name, lines, {}, {}, 0};
+
+    // The first text cell sits after the "~ " row marker
+    const size_t glyphRow = 0, glyphCol = 2;
+    const size_t statusRow = opt.rows - 2;
+
+    Session s(opt, path);
+    if (!s.waitFor([&](const Screen &sc) { return sc.line(statusRow).find("lines") != std::string::npos; },
+                   std::chrono::seconds(opt.loadTimeout)))
+    {
+        std::cerr << name << ": editor did not draw within " << opt.loadTimeout << "s\n";
+        return res;
+    }
+    s.pump(std::chrono::milliseconds(200));
+    char original = s.screen.at(glyphRow, glyphCol);
+
+    // Alternate inserting a glyph at the start of the file and deleting it again, so the file size stays fixed
+    for (size_t i = 0; i < opt.samples; i++)
+    {
+        bool insert = i % 2 == 0;
+        char expect = insert ? (char)('a' + (i / 2) % 26) : original;
+        if (insert && expect == original)
+            expect = expect == 'z' ? 'a' : expect + 1;
+
+        std::this_thread::sleep_for(std::chrono::microseconds(2000 + (i * 7919) % 8000));
+        s.pump(std::chrono::milliseconds(0));
+
+        size_t before = s.bytesRead;
+        auto t0 = Clock::now();
+        s.send(insert ? std::string(1, expect) : std::string("\x7f"));
+        bool seen = s.waitFor([&](const Screen &sc) { return sc.at(glyphRow, glyphCol) == expect; },
+                              std::chrono::seconds(5));
+        auto dt = Clock::now() - t0;
+
+        if (!seen)
+        {
+            res.timeouts++;
+            continue;
+        }
+        res.latenciesUs.push_back(std::chrono::duration<double, std::micro>(dt).count());
+        res.bytes.push_back(s.bytesRead - before);
+    }
+
+    std::remove(path.c_str());
+    return res;
+}
+
+static double percentile(std::vector<double> v, double p)
+{
+    if (v.empty())
+        return 0;
+    std::sort(v.begin(), v.end());
+    return v[std::min(v.size() - 1, (size_t)(p * v.size()))];
+}
+
+static void writeJson(std::ostream &os, const std::vector<Result> &results)
+{
+    os << "{\n  \"version\": \"" << VERSION << "\",\n  \"scenarios\": [\n";
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const Result &r = results[i];
+        double bytes = 0;
+        for (size_t b : r.bytes)
+            bytes += b;
+        os << "    {\"name\": \"" << r.name << "\", \"lines\": " << r.lines
+           << ", \"samples\": " << r.latenciesUs.size() << ", \"timeouts\": " << r.timeouts
+           << ", \"latency_us\": {\"min\": " << percentile(r.latenciesUs, 0)
+           << ", \"p50\": " << percentile(r.latenciesUs, 0.5)
+           << ", \"p90\": " << percentile(r.latenciesUs, 0.9)
+           << ", \"p99\": " << percentile(r.latenciesUs, 0.99)
+           << ", \"max\": " << percentile(r.latenciesUs, 1)
+           << "}, \"bytes_per_keystroke\": " << (r.bytes.empty() ? 0 : bytes / r.bytes.size()) << "}"
+           << (i + 1 < results.size() ? ",\n" : "\n");
+    }
+    os << "  ]\n}\n";
+}
+
+static void usage()
+{
+    std::cerr << "Usage: tinyted_latency [options]\n"
+              << "\t--editor PATH       editor binary (default ./build/tinyted)\n"
+              << "\t--samples N         keystrokes per scenario (default 200)\n"
+              << "\t--large-lines N     lines in the large file (default 1000000)\n"
+              << "\t--long-len N        length of the long line (default 1048576)\n"
+              << "\t--load-timeout S    seconds to wait for the first frame (default 600)\n"
+              << "\t--out PATH          results file (default ./build/latency.json)\n";
+}
+
+int main(int argc, char *argv[])
+{
+    Options opt;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (i + 1 >= argc)
+        {
+            usage();
+            return arg == "-h" || arg == "--help" ? 0 : 1;
+        }
+        std::string val = argv[++i];
+
+        if (arg == "--editor") opt.editor = val;
+        else if (arg == "--samples") opt.samples = std::stoull(val);
+        else if (arg == "--large-lines") opt.largeLines = std::stoull(val);
+        else if (arg == "--long-len") opt.longLen = std::stoull(val);
+        else if (arg == "--load-timeout") opt.loadTimeout = std::stoi(val);
+        else if (arg == "--out") opt.out = val;
+        else
+        {
+            usage();
+            return 1;
+        }
+    }
+
+    std::vector<Result> results;
+    results.push_back(runScenario(opt, "small", 200, 20));
+    results.push_back(runScenario(opt, "large", opt.largeLines, 20));
+    results.push_back(runScenario(opt, "longline", 200, opt.longLen));
+
+    for (const Result &r : results)
+    {
+        std::cerr << r.name << ": p50 " << percentile(r.latenciesUs, 0.5) << "us p99 "
+                  << percentile(r.latenciesUs, 0.99) << "us over " << r.latenciesUs.size()
+                  << " keys, " << r.timeouts << " timeouts\n";
+    }
+
+    std::ofstream ofs(opt.out, std::ofstream::trunc);
+    writeJson(ofs, results);
+    std::cerr << "Results written to " << opt.out << "\n";
+    return 0;
+}
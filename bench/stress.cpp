@@ -0,0 +1,783 @@
+#include <config.hh>
+#include <fileio.hh>
+#include <version.hh>
+#include <commands.hh>
+#include <crdt.hh>
+#include <protocol.hh>
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <memory>
+
+/**
+ * @struct Shape
+ * @brief Parameters controlling the documents the generator produces.
+ *
+ * @param lineMean Mean line length in characters (exponentially distributed).
+ * @param tabDensity Probability that a word is preceded by a tab rather than a space.
+ * @param keywordDensity Probability that a word is a C++ keyword.
+ * @param longLineRate Probability that a line is a very long line.
+ * @param longLineLen Length of very long lines.
+ */
+struct Shape
+{
+    double lineMean = 40;
+    double tabDensity = 0.05;
+    double keywordDensity = 0.2;
+    double longLineRate = 0.001;
+    size_t longLineLen = 64 * 1024;
+};
+
+/**
+ * @struct Options
+ * @brief Command line options of the stress tool.
+ */
+struct Options
+{
+    Shape shape;
+    size_t minSize = 1024;
+    size_t maxSize = 4 * 1024 * 1024;
+    size_t ops = 20000;
+    unsigned seed = 1;
+    std::string out = "./build/stress.json";
+    std::string genPath;
+    size_t sites = 0;
+    size_t sessions = 200;
+    size_t folds = 0;
+};
+
+///////////////////
+// GENERATOR
+///////////////////
+
+static const char *identifiers[] = {"value", "count", "buffer", "row", "cfg", "index", "result", "data", "node", "it"};
+
+/**
+ * @brief Generates a single line following the shape's distributions.
+ */
+static std::string genLine(std::mt19937_64 &rng, const Shape &shape)
+{
+    std::uniform_real_distribution<double> p(0, 1);
+    std::exponential_distribution<double> len(1.0 / shape.lineMean);
+    std::uniform_int_distribution<size_t> kw(0, hlSchemes[0].keywords.size() - 1), id(0, std::size(identifiers) - 1);
+
+    size_t target = p(rng) < shape.longLineRate ? shape.longLineLen : (size_t)len(rng);
+    std::string line;
+    while (line.size() < target)
+    {
+        if (!line.empty())
+            line += p(rng) < shape.tabDensity ? '\t' : ' ';
+        line += p(rng) < shape.keywordDensity ? hlSchemes[0].keywords[kw(rng)] : identifiers[id(rng)];
+    }
+    return line;
+}
+
+/**
+ * @brief Generates lines until at least the given number of bytes (including newlines) is reached.
+ */
+static std::vector<std::string> genDocument(size_t bytes, std::mt19937_64 &rng, const Shape &shape)
+{
+    std::vector<std::string> lines;
+    size_t total = 0;
+    while (total < bytes)
+    {
+        lines.push_back(genLine(rng, shape));
+        total += lines.back().size() + 1;
+    }
+    return lines;
+}
+
+/**
+ * @brief Streams a generated document straight to disk, so sizes beyond memory can be produced.
+ */
+static int genFile(const std::string &path, size_t bytes, std::mt19937_64 &rng, const Shape &shape)
+{
+    std::ofstream ofs(path, std::ofstream::trunc);
+    if (!ofs)
+    {
+        std::cerr << "Failed to open " << path << "\n";
+        return 1;
+    }
+
+    size_t total = 0;
+    while (total < bytes)
+    {
+        std::string line = genLine(rng, shape);
+        ofs << line << '\n';
+        total += line.size() + 1;
+    }
+    return ofs ? 0 : 1;
+}
+
+///////////////////
+// REFERENCE MODEL
+///////////////////
+
+/**
+ * @struct Model
+ * @brief Naive reference implementation of the TTEdFileData edit operations.
+ */
+struct Model
+{
+    std::vector<std::string> rows;
+
+    void insertChar(TTEdCursor &cursor, char c)
+    {
+        if (cursor.cy == rows.size())
+            rows.emplace_back();
+        std::string &r = rows[cursor.cy];
+        r.insert(std::min(cursor.cx, r.size()), 1, c);
+        cursor.cx++;
+    }
+
+    void deleteChar(TTEdCursor &cursor)
+    {
+        if (cursor.cy >= rows.size() || (cursor.cx == 0 && cursor.cy == 0))
+            return;
+        if (cursor.cx > 0)
+        {
+            rows[cursor.cy].erase(cursor.cx - 1, 1);
+            cursor.cx--;
+        }
+        else
+        {
+            cursor.cx = rows[cursor.cy - 1].size();
+            rows[cursor.cy - 1] += rows[cursor.cy];
+            rows.erase(rows.begin() + cursor.cy);
+            cursor.cy--;
+        }
+    }
+
+    void insertNewLine(TTEdCursor &cursor)
+    {
+        std::string tail = rows[cursor.cy].substr(cursor.cx);
+        rows[cursor.cy].resize(cursor.cx);
+        rows.insert(rows.begin() + cursor.cy + 1, tail);
+        cursor.cy++;
+        cursor.cx = 0;
+    }
+};
+
+/**
+ * @brief Checks the editor buffer row by row against the reference model.
+ *
+ * @return An empty string on success, otherwise a description of the first mismatch.
+ */
+static std::string verify(const TTEdFileData &fd, const Model &model)
+{
+    if (fd.size() != model.rows.size())
+        return "row count " + std::to_string(fd.size()) + " != " + std::to_string(model.rows.size());
+
+    for (size_t i = 0; i < fd.size(); i++)
+    {
+        const Row &r = *fd.at(i);
+        if (r.sRaw != model.rows[i])
+            return "row " + std::to_string(i) + " text differs";
+        if (r.textStates.size() != r.sRender.size())
+            return "row " + std::to_string(i) + " highlight state out of sync";
+    }
+    return "";
+}
+
+///////////////////
+// COLLABORATION
+///////////////////
+
+/**
+ * @brief Gets a buffer's text, each row ending in a newline.
+ */
+static std::string textOf(const TTEdFileData &fd)
+{
+    std::string s;
+    for (size_t i = 0; i < fd.size(); i++)
+    {
+        s += fd.at(i)->sRaw;
+        s += '\n';
+    }
+    return s;
+}
+
+/**
+ * @brief Sends operations through the wire format, as the network thread would.
+ *
+ * @return An empty string on success, otherwise why the frame was rejected.
+ */
+static std::string transmit(const std::vector<Protocol::Op> &ops, std::vector<Protocol::Op> &out)
+{
+    Protocol::Writer w;
+    for (const Protocol::Op &op : ops)
+        w.add(op);
+    std::string wire;
+    w.finish(wire);
+
+    Protocol::Reader r;
+    r.feed(wire.data(), wire.size());
+    return r.decode(out) ? "" : "wire: " + r.error();
+}
+
+/**
+ * @brief Runs one session: sites edit one document at once through a host, over links that
+ * deliver in a random interleaving and that drop and resume from the operation logs.
+ *
+ * Each site edits its own buffer and shares the edits through Config::share, and applies
+ * what reaches it through Config::apply, as the editor does. At the end every site must
+ * hold the same text, and its sequence must describe its rows.
+ *
+ * @param sites Number of sites, the first hosting.
+ * @param ops Edits made over the session, spread at random over the sites.
+ * @param resumes Incremented for every dropped link resumed.
+ * @return An empty string on success, otherwise a description of the first failure.
+ */
+static std::string runSession(size_t sites, size_t ops, std::mt19937_64 &rng, size_t &resumes)
+{
+    std::vector<std::unique_ptr<Config>> site;
+    for (size_t i = 0; i < sites; i++)
+        site.push_back(std::make_unique<Config>());
+
+    // The host loads the document, and guests join from its layout, as from a snapshot
+    Config &host = *site[0];
+    for (size_t r = 0; r < 5; r++)
+        host.fileData.fileData.push_back(std::make_shared<Row>("line " + std::to_string(r) + " valve"));
+    host.session.doc.load(host.fileData);
+    std::string layout;
+    host.session.doc.encode(layout);
+    for (size_t i = 1; i < sites; i++)
+    {
+        for (size_t r = 0; r < host.fileData.size(); r++)
+            site[i]->fileData.fileData.push_back(std::make_shared<Row>(host.fileData.at(r)->sRaw));
+        if (!site[i]->session.doc.decode(layout, site[i]->fileData))
+            return "guest could not decode the host's layout";
+    }
+    for (auto &c : site)
+    {
+        c->fileData.journaling = true;
+        c->session.log.start(c->session.doc.version());
+    }
+
+    // Links to and from each guest, and whether the guest is cut off
+    std::vector<std::deque<Protocol::Op>> up(sites), down(sites);
+    std::vector<bool> offline(sites, false);
+    std::string err;
+
+    auto apply = [&](size_t i, const Protocol::Op &op) {
+        Config &c = *site[i];
+        c.apply(op);
+        if (c.cursor.cy > c.fileData.size() || (c.cursor.cy < c.fileData.size() && c.cursor.cx > c.fileData.at(c.cursor.cy)->size()))
+            err = "site " + std::to_string(i) + " cursor left the text";
+    };
+    auto share = [&](size_t i) {
+        Config &c = *site[i];
+        Crdt::Version before = c.session.doc.version();
+        c.share();
+        std::vector<Protocol::Op> made, sent;
+        c.session.log.since(before, made);
+        if (offline[i] || made.empty())
+            return;
+        err = transmit(made, sent);
+        for (Protocol::Op &op : sent)
+        {
+            if (i > 0)
+                up[i].push_back(op);
+            for (size_t g = 1; i == 0 && g < sites; g++)
+                if (!offline[g])
+                    down[g].push_back(op);
+        }
+    };
+    // Delivers one operation on a random busy link; the host relays what guests send
+    auto deliver = [&]() {
+        std::vector<std::pair<bool, size_t>> busy;
+        for (size_t g = 1; g < sites; g++)
+        {
+            if (!up[g].empty())
+                busy.push_back({true, g});
+            if (!down[g].empty())
+                busy.push_back({false, g});
+        }
+        if (busy.empty())
+            return false;
+
+        auto [toHost, g] = busy[rng() % busy.size()];
+        std::deque<Protocol::Op> &link = toHost ? up[g] : down[g];
+        Protocol::Op op = link.front();
+        link.pop_front();
+        apply(toHost ? 0 : g, op);
+        for (size_t o = 1; toHost && o < sites; o++)
+            if (o != g && !offline[o])
+                down[o].push_back(op);
+        return true;
+    };
+    // Each side sends what the other lacks, which both logs must still hold
+    auto resume = [&](size_t g) {
+        Config &guest = *site[g];
+        if (!Crdt::includes(guest.session.doc.version(), host.session.log.floor()) ||
+            !Crdt::includes(host.session.doc.version(), guest.session.log.floor()))
+        {
+            err = "site " + std::to_string(g) + " could not resume";
+            return;
+        }
+        std::vector<Protocol::Op> toGuest, toHost, sent;
+        host.session.log.since(guest.session.doc.version(), toGuest);
+        guest.session.log.since(host.session.doc.version(), toHost);
+        err = transmit(toGuest, sent);
+        down[g].assign(sent.begin(), sent.end());
+        up[g].assign(toHost.begin(), toHost.end());
+        offline[g] = false;
+        resumes++;
+    };
+
+    for (size_t step = 0; step < ops && err.empty(); step++)
+    {
+        size_t i = rng() % sites;
+        Config &c = *site[i];
+        TTEdFileData &fd = c.fileData;
+        c.cursor.cy = rng() % (fd.size() + 1);
+        c.cursor.cx = c.cursor.cy < fd.size() ? rng() % (fd.at(c.cursor.cy)->size() + 1) : 0;
+
+        int k = rng() % 100;
+        if (k < 55)
+            fd.insertChar(c.cursor, 'a' + rng() % 26);
+        else if (k < 85)
+            fd.deleteChar(c.cursor);
+        else if (k < 97)
+            fd.insertNewLine(c.cursor);
+        else
+            Commands::Replace::all(c, rng() % 2 ? "valve" : "a", rng() % 2 ? "value" : "", false);
+        if (c.cursor.cy < fd.size())
+            c.cursor.cx = std::min(c.cursor.cx, fd.at(c.cursor.cy)->size()); // Replacing may shorten the row
+        share(i);
+
+        // Now and then a guest's link drops, losing what is in flight, or comes back
+        if (sites > 1 && rng() % 40 == 0)
+        {
+            size_t g = 1 + rng() % (sites - 1);
+            if (!offline[g])
+            {
+                offline[g] = true;
+                up[g].clear();
+                down[g].clear();
+            }
+            else
+            {
+                resume(g);
+            }
+        }
+        for (int d = rng() % 3; d > 0 && deliver(); d--)
+            ;
+    }
+
+    for (size_t i = 0; i < sites && err.empty(); i++)
+        share(i);
+    for (size_t g = 1; g < sites && err.empty(); g++)
+        if (offline[g])
+            resume(g);
+    while (err.empty() && deliver())
+        ;
+    if (!err.empty())
+        return err;
+
+    std::string text = textOf(host.fileData);
+    for (size_t i = 0; i < sites; i++)
+    {
+        Config &c = *site[i];
+        std::string mine = textOf(c.fileData);
+        if (mine != text)
+            return "site " + std::to_string(i) + " diverged from the host";
+        if (c.session.doc.size() != mine.size() && c.session.doc.size() + 1 != mine.size())
+            return "site " + std::to_string(i) + " sequence size " + std::to_string(c.session.doc.size()) + " != text " + std::to_string(mine.size());
+
+        std::string l;
+        c.session.doc.encode(l);
+        Crdt::Sequence fresh;
+        if (!fresh.decode(l, c.fileData))
+            return "site " + std::to_string(i) + " sequence does not describe its rows";
+    }
+    return "";
+}
+
+/**
+ * @brief Runs sessions until one fails, reporting the seed to replay it with.
+ *
+ * @return Whether every session converged.
+ */
+static bool runCollaboration(const Options &opt)
+{
+    size_t resumes = 0;
+    for (size_t n = 0; n < opt.sessions; n++)
+    {
+        // One generator per session, so a failure replays with --seed alone
+        std::mt19937_64 rng(opt.seed + n);
+        std::string error = runSession(opt.sites, opt.ops, rng, resumes);
+        if (!error.empty())
+        {
+            std::cerr << "Session with --seed " << opt.seed + n << " failed: " << error << "\n";
+            return false;
+        }
+    }
+
+    std::cerr << opt.sessions << " sessions of " << opt.sites << " sites, " << opt.ops << " edits each, "
+              << resumes << " resumes: converged\n";
+    return true;
+}
+
+///////////////////
+// FOLDS
+///////////////////
+
+/**
+ * @brief Folds, unfolds and reveals at random, letting folds nest and overlap, and checks the
+ * visual line index after every step against the folds kept in a plain map.
+ *
+ * @param ops Steps to take.
+ * @param rng Generator for the document and the steps.
+ * @return An empty string on success, otherwise a description of the first mismatch.
+ */
+static std::string runFolds(size_t ops, std::mt19937_64 &rng)
+{
+    // Rows of words wrapped to a narrow width, so rows span different numbers of lines
+    size_t n = 2 + rng() % 120;
+    std::vector<std::shared_ptr<Row>> rows;
+    for (size_t i = 0; i < n; i++)
+    {
+        std::string text;
+        for (size_t w = rng() % 12; w > 0; w--)
+            text += std::string(1 + rng() % 8, 'a' + rng() % 26) + " ";
+        rows.push_back(std::make_shared<Row>(text));
+    }
+    TTEdFileData fd;
+    fd.insertRows(0, std::move(rows));
+    size_t width = 10 + rng() % 40;
+
+    std::map<size_t, size_t> folds; // Header row to the rows hidden after it
+    for (size_t k = 0; k < ops; k++)
+    {
+        size_t pick = rng() % 10;
+        size_t row = rng() % n;
+        if (pick < 5 && row + 1 < n && !folds.count(row))
+        {
+            size_t len = 1 + rng() % (n - row - 1);
+            fd.fold(row, len);
+            folds[row] = len;
+        }
+        else if (pick < 8 && !folds.empty())
+        {
+            auto it = std::next(folds.begin(), rng() % folds.size());
+            fd.unfold(it->first);
+            folds.erase(it);
+        }
+        else
+        {
+            fd.reveal(row);
+            std::erase_if(folds, [&](const auto &f) { return f.first < row && f.first + f.second >= row; });
+        }
+        fd.syncLines(width);
+
+        std::vector<int> depth(n, 0);
+        for (auto [header, len] : folds)
+        {
+            for (size_t i = header + 1; i <= header + len; i++)
+                depth[i]++;
+        }
+
+        const LineIndex &index = fd.lines;
+        std::string at = "step " + std::to_string(k) + ", row ";
+        size_t line = 0;
+        for (size_t i = 0; i < n; i++)
+        {
+            size_t lines = depth[i] > 0 ? 0 : fd.rowLines(i);
+            if (index.hidden(i) != (depth[i] > 0) || index.count(i) != lines)
+                return at + std::to_string(i) + ": shown wrongly";
+            if (index.prefix(i) != line)
+                return at + std::to_string(i) + ": prefix " + std::to_string(index.prefix(i)) + " != " + std::to_string(line);
+            for (size_t seg = 0; seg < lines; seg++)
+            {
+                if (index.find(line + seg) != std::make_pair(i, seg))
+                    return at + std::to_string(i) + ": line " + std::to_string(line + seg) + " found elsewhere";
+            }
+            line += lines;
+
+            std::vector<size_t> covering;
+            for (auto [header, len] : folds)
+            {
+                if (header < i && header + len >= i)
+                    covering.push_back(header);
+            }
+            if (index.covering(i) != covering)
+                return at + std::to_string(i) + ": covering folds differ";
+
+            // The fold marker counts the rows unfolding shows: those no other fold covers
+            size_t shown = 0;
+            if (auto f = folds.find(i); f != folds.end())
+            {
+                for (size_t j = i + 1; j <= i + f->second; j++)
+                    shown += depth[j] == 1;
+            }
+            if (index.revealed(i) != shown)
+                return at + std::to_string(i) + ": fold shows " + std::to_string(index.revealed(i)) + " != " + std::to_string(shown);
+        }
+        if (index.total() != line)
+            return "step " + std::to_string(k) + ": total " + std::to_string(index.total()) + " != " + std::to_string(line);
+    }
+    return "";
+}
+
+/**
+ * @brief Runs fold checks on fresh documents until one fails, reporting the seed to replay it with.
+ *
+ * @return Whether the index matched on every document.
+ */
+static bool runFoldChecks(const Options &opt)
+{
+    for (size_t n = 0; n < opt.folds; n++)
+    {
+        std::mt19937_64 rng(opt.seed + n);
+        std::string error = runFolds(opt.ops, rng);
+        if (!error.empty())
+        {
+            std::cerr << "Folds with --seed " << opt.seed + n << " failed: " << error << "\n";
+            return false;
+        }
+    }
+
+    std::cerr << opt.folds << " documents, " << opt.ops << " fold steps each: line index matched\n";
+    return true;
+}
+
+///////////////////
+// DRIVER
+///////////////////
+
+/**
+ * @struct Run
+ * @brief Measurements for one document size.
+ */
+struct Run
+{
+    size_t bytes;
+    size_t lines;
+    double loadNsPerLine;
+    double editNsPerOp;
+    double exponent;
+    std::string error;
+};
+
+static Run runSize(size_t bytes, const Options &opt, std::mt19937_64 &rng)
+{
+    using clock = std::chrono::steady_clock;
+    Run run{bytes, 0, 0, 0, 0, ""};
+
+    Model model;
+    model.rows = genDocument(bytes, rng, opt.shape);
+    run.lines = model.rows.size();
+
+    // Load the rows as openFile would, minus the disk reads
+    Config cfg;
+    cfg.fileData.path = "stress.cpp";
+    parseFileExtension(cfg);
+    auto t0 = clock::now();
+    for (const std::string &line : model.rows)
+    {
+        cfg.fileData.fileData.emplace_back(std::make_shared<Row>(Row{line}));
+    }
+    run.loadNsPerLine = std::chrono::duration<double, std::nano>(clock::now() - t0).count() / run.lines;
+
+    // Generate the edit script up front so only the edits are timed
+    struct Edit
+    {
+        int kind;
+        size_t cy, cx;
+        char c;
+    };
+    std::uniform_int_distribution<int> kind(0, 9);
+    std::uniform_int_distribution<int> ch('a', 'z');
+
+    std::vector<Edit> script;
+    script.reserve(opt.ops);
+    std::vector<size_t> lengths;
+    for (const std::string &r : model.rows)
+        lengths.push_back(r.size());
+
+    // Track row lengths so every edit targets a valid position, mirroring each operation's effect
+    for (size_t i = 0; i < opt.ops; i++)
+    {
+        int k = kind(rng);
+        size_t cy = std::uniform_int_distribution<size_t>(0, lengths.size() - 1)(rng);
+        size_t cx = std::uniform_int_distribution<size_t>(0, lengths[cy])(rng);
+        Edit e{k < 6 ? 0 : k < 9 ? 1 : 2, cy, cx, (char)ch(rng)};
+        script.push_back(e);
+
+        if (e.kind == 0)
+            lengths[cy]++;
+        else if (e.kind == 1 && cx > 0)
+            lengths[cy]--;
+        else if (e.kind == 1 && cy > 0)
+        {
+            lengths[cy - 1] += lengths[cy];
+            lengths.erase(lengths.begin() + cy);
+        }
+        else if (e.kind == 2)
+        {
+            lengths.insert(lengths.begin() + cy + 1, lengths[cy] - cx);
+            lengths[cy] = cx;
+        }
+    }
+
+    TTEdCursor cursor;
+    t0 = clock::now();
+    for (const Edit &e : script)
+    {
+        cursor.cy = e.cy;
+        cursor.cx = e.cx;
+        if (e.kind == 0)
+            cfg.fileData.insertChar(cursor, e.c);
+        else if (e.kind == 1)
+            cfg.fileData.deleteChar(cursor);
+        else
+            cfg.fileData.insertNewLine(cursor);
+    }
+    run.editNsPerOp = std::chrono::duration<double, std::nano>(clock::now() - t0).count() / script.size();
+
+    for (const Edit &e : script)
+    {
+        cursor.cy = e.cy;
+        cursor.cx = e.cx;
+        if (e.kind == 0)
+            model.insertChar(cursor, e.c);
+        else if (e.kind == 1)
+            model.deleteChar(cursor);
+        else
+            model.insertNewLine(cursor);
+    }
+
+    run.error = verify(cfg.fileData, model);
+    return run;
+}
+
+static void writeJson(std::ostream &os, const Options &opt, const std::vector<Run> &runs)
+{
+    const Shape &s = opt.shape;
+    os << "{\n  \"version\": \"" << VERSION << "\",\n"
+       << "  \"shape\": {\"line_mean\": " << s.lineMean << ", \"tab_density\": " << s.tabDensity
+       << ", \"keyword_density\": " << s.keywordDensity << ", \"long_line_rate\": " << s.longLineRate
+       << ", \"long_line_len\": " << s.longLineLen << "},\n"
+       << "  \"ops\": " << opt.ops << ",\n  \"runs\": [\n";
+    for (size_t i = 0; i < runs.size(); i++)
+    {
+        const Run &r = runs[i];
+        os << "    {\"bytes\": " << r.bytes << ", \"lines\": " << r.lines
+           << ", \"load_ns_per_line\": " << r.loadNsPerLine
+           << ", \"edit_ns_per_op\": " << r.editNsPerOp
+           << ", \"edit_scaling_exponent\": " << r.exponent
+           << ", \"verified\": " << (r.error.empty() ? "true" : "false") << "}"
+           << (i + 1 < runs.size() ? ",\n" : "\n");
+    }
+    os << "  ]\n}\n";
+}
+
+/**
+ * @brief Parses a size such as 512, 64K, 16M or 10G.
+ */
+static size_t parseSize(const std::string &s)
+{
+    size_t n = std::stoull(s);
+    switch (s.back())
+    {
+    case 'G': case 'g': return n << 30;
+    case 'M': case 'm': return n << 20;
+    case 'K': case 'k': return n << 10;
+    default: return n;
+    }
+}
+
+static void usage()
+{
+    std::cerr << "Usage: tinyted_stress [options]\n"
+              << "\t--min SIZE          smallest document (default 1K)\n"
+              << "\t--max SIZE          largest document, sizes grow 4x per run (default 4M, up to 10G)\n"
+              << "\t--ops N             random edits per document (default 20000)\n"
+              << "\t--line-mean N       mean line length (default 40)\n"
+              << "\t--tabs P            tab density (default 0.05)\n"
+              << "\t--keywords P        keyword density (default 0.2)\n"
+              << "\t--long-rate P       probability of a very long line (default 0.001)\n"
+              << "\t--long-len N        length of very long lines (default 64K)\n"
+              << "\t--seed N            random seed (default 1)\n"
+              << "\t--out PATH          results file (default ./build/stress.json)\n"
+              << "\t--gen PATH          only write a --max sized document to PATH\n"
+              << "\t--sites N           instead simulate N sites editing one document, checking they converge\n"
+              << "\t--sessions N        sessions simulated with --sites (default 200)\n"
+              << "\t--folds N           instead check the line index on N documents with nested and overlapping folds\n";
+}
+
+int main(int argc, char *argv[])
+{
+    Options opt;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (i + 1 >= argc)
+        {
+            usage();
+            return arg == "-h" || arg == "--help" ? 0 : 1;
+        }
+        std::string val = argv[++i];
+
+        if (arg == "--min") opt.minSize = parseSize(val);
+        else if (arg == "--max") opt.maxSize = parseSize(val);
+        else if (arg == "--ops") opt.ops = std::stoull(val);
+        else if (arg == "--line-mean") opt.shape.lineMean = std::stod(val);
+        else if (arg == "--tabs") opt.shape.tabDensity = std::stod(val);
+        else if (arg == "--keywords") opt.shape.keywordDensity = std::stod(val);
+        else if (arg == "--long-rate") opt.shape.longLineRate = std::stod(val);
+        else if (arg == "--long-len") opt.shape.longLineLen = parseSize(val);
+        else if (arg == "--seed") opt.seed = std::stoul(val);
+        else if (arg == "--out") opt.out = val;
+        else if (arg == "--gen") opt.genPath = val;
+        else if (arg == "--sites") opt.sites = std::stoull(val);
+        else if (arg == "--sessions") opt.sessions = std::stoull(val);
+        else if (arg == "--folds") opt.folds = std::stoull(val);
+        else
+        {
+            usage();
+            return 1;
+        }
+    }
+
+    std::mt19937_64 rng(opt.seed);
+    if (!opt.genPath.empty())
+        return genFile(opt.genPath, opt.maxSize, rng, opt.shape);
+    if (opt.sites > 0)
+        return runCollaboration(opt) ? 0 : 1;
+    if (opt.folds > 0)
+        return runFoldChecks(opt) ? 0 : 1;
+
+    std::vector<Run> runs;
+    bool ok = true;
+    for (size_t bytes = opt.minSize; bytes <= opt.maxSize; bytes *= 4)
+    {
+        Run run = runSize(bytes, opt, rng);
+
+        // Per-op cost should stay flat; an exponent near 1 means edits scale with document size
+        if (!runs.empty() && runs.back().editNsPerOp > 0)
+        {
+            run.exponent = std::log(run.editNsPerOp / runs.back().editNsPerOp) /
+                           std::log((double)run.lines / runs.back().lines);
+        }
+
+        std::cerr << bytes << " bytes, " << run.lines << " lines: load " << run.loadNsPerLine
+                  << " ns/line, edit " << run.editNsPerOp << " ns/op, exponent " << run.exponent
+                  << (run.error.empty() ? "" : " MISMATCH: " + run.error) << "\n";
+        ok = ok && run.error.empty();
+        runs.push_back(run);
+    }
+
+    std::ofstream ofs(opt.out, std::ofstream::trunc);
+    writeJson(ofs, opt, runs);
+    std::cerr << "Results written to " << opt.out << "\n";
+    return ok ? 0 : 1;
+}
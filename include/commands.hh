@@ -45,4 +45,110 @@ namespace Commands
         void run(TerminalGUI &gui, Config &cfg);
 
     }
+
+    /**
+     * @namespace MemReport
+     * @brief Implements the memory breakdown command
+     */
+    namespace MemReport
+    {
+        /**
+         * @brief Shows the per-subsystem memory breakdown in the message bar.
+         *
+         * @param gui The TerminalGUI object used for displaying the report.
+         * @param cfg The configuration object containing editor state and settings.
+         */
+        void run(TerminalGUI &gui, Config &cfg);
+    }
+
+    /**
+     * @namespace Fold
+     * @brief Implements the fold command
+     */
+    namespace Fold
+    {
+        /**
+         * @brief Unfolds the fold at the cursor row, or prompts for the last line of a new one.
+         *
+         * An empty answer folds the block the cursor row opens, by braces or indentation.
+         *
+         * @param gui The TerminalGUI object used for the prompt.
+         * @param cfg The configuration object containing editor state and settings.
+         */
+        void run(TerminalGUI &gui, Config &cfg);
+    }
+
+    /**
+     * @namespace Replace
+     * @brief Implements the replace-all command
+     */
+    namespace Replace
+    {
+        /**
+         * @brief Replaces every match of a query as one batch.
+         *
+         * Each row with a match is rebuilt in a single pass and re-highlighted once. Matches do
+         * not overlap, and the query follows search's smart case. While collaborating, each match
+         * is journaled as an erase and an insert, so peers receive the batch as ordinary frames.
+         *
+         * @param cfg The configuration object containing editor state and settings.
+         * @param query The text, or in regex mode the pattern, to replace.
+         * @param with The replacement text, inserted literally.
+         * @param regex Whether the query is a regular expression.
+         * @return The number of matches replaced.
+         */
+        size_t all(Config &cfg, std::string_view query, std::string_view with, bool regex);
+
+        /**
+         * @brief Prompts for a query, highlighting its matches as search does, then for its
+         * replacement, and replaces every match.
+         *
+         * @param gui The TerminalGUI object used for the prompts.
+         * @param cfg The configuration object containing editor state and settings.
+         */
+        void run(TerminalGUI &gui, Config &cfg);
+    }
+
+    /**
+     * @namespace ProjectSearch
+     * @brief Implements the project grep command and its results buffer
+     */
+    namespace ProjectSearch
+    {
+        /**
+         * @brief Prompts for a query and starts searching every file under the working directory,
+         * showing a results buffer in place of the open file that fills in as matches are found.
+         *
+         * The query is a regex when search is in regex mode. An empty query goes back to the last results.
+         *
+         * @param gui The TerminalGUI object used for the prompt.
+         * @param cfg The configuration object containing editor state and settings.
+         */
+        void run(TerminalGUI &gui, Config &cfg);
+
+        /**
+         * @brief Appends the matches found since the last call to the results buffer, a bounded
+         * number per call so the editor keeps drawing, and reports progress in the message bar.
+         *
+         * @param cfg The configuration object containing editor state and settings.
+         */
+        void poll(Config &cfg);
+
+        /**
+         * @brief Opens the file of the match under the cursor at the match.
+         *
+         * The file that was open is kept if the match is in it; otherwise it is closed, unless
+         * it has unsaved changes, in which case nothing is opened.
+         *
+         * @param cfg The configuration object, with the results buffer on screen.
+         */
+        void open(Config &cfg);
+
+        /**
+         * @brief Leaves the results buffer for the file it replaced on screen.
+         *
+         * @param cfg The configuration object, with the results buffer on screen.
+         */
+        void back(Config &cfg);
+    }
 };
@@ -2,14 +2,25 @@
 
 #include <string>
 #include <vector>
+#include <cstdint>
 #include <memory>
 #include <termios.h>
 #include <functional>
 #include <filesystem>
 #include <arpa/inet.h>
 #include <unistd.h>
+#include <lineindex.hh>
+#include <protocol.hh>
+#include <crdt.hh>
+#include <chrono>
+#include <deque>
+#include <map>
+#include <atomic>
+#include <thread>
+#include <ring.hh>
 
 #define TABSTOP 4
+#define GUTTER_WIDTH 2
 #define K_CTRL(k) ((k) & 0x1f)
 #define HFLAG_NUM 1 << 0
 #define HFLAG_STR 1 << 1
@@ -28,7 +39,7 @@ enum keys
     PAGE_DOWN,
 };
 
-enum textState
+enum textState : uint8_t
 {
     TS_NORMAL = 0,
     TS_KW1,
@@ -61,6 +72,10 @@ struct TTEdTermData;
 struct TTEdFileData;
 struct TTEdConnection;
 struct Config;
+class Regex;
+class Finder;
+namespace Snapshot { struct Transfer; }
+class Grep;
 
 using TTEdCommand = std::function<void(Config &, std::string, int)>;
 
@@ -85,6 +100,43 @@ static std::vector<SyntaxHL> hlSchemes = {
   },
 };
 
+/**
+ * @struct StateSpan
+ * @brief A run of rendered columns sharing one textState.
+ *
+ * @param start First column of the run; the run extends to the next span's start.
+ * @param state Render state of every column in the run.
+ */
+struct StateSpan
+{
+    size_t start;
+    textState state;
+};
+
+/**
+ * @struct RowImage
+ * @brief A frozen copy of the columns of a row a frame shows, so the render thread can encode
+ * them while the editor goes on changing the row.
+ *
+ * @param text Rendered columns [offset, offset + width) of the row.
+ * @param spans Syntax runs over text, starts relative to offset.
+ * @param matches Search match ranges over text, relative to offset.
+ * @param offset First rendered column of the row held.
+ * @param width Width of the window held, SIZE_MAX for the rest of the row.
+ * @param encoded Terminal bytes for the whole of text, built by the render thread on first use.
+ */
+struct RowImage
+{
+    std::string text;
+    std::vector<StateSpan> spans;
+    std::vector<std::pair<size_t, size_t>> matches;
+    size_t offset = 0;
+    size_t width = 0;
+
+    mutable std::string encoded;
+    mutable bool encodedValid = false;
+};
+
 /**
  * @struct TTEdCursor
  * @brief Represents the cursor's position and offset in the editor.
@@ -94,6 +146,9 @@ static std::vector<SyntaxHL> hlSchemes = {
  * @param cx Cursor's x position on the screen.
  * @param cy Cursor's y position on the screen.
  * @param rx Rendered x position in the file row.
+ * @param vOffset First visual line shown when rows span several screen lines.
+ * @param sx Cursor's column within the text area, set by Config::scroll.
+ * @param sy Cursor's row on the screen, set by Config::scroll.
  */
 struct TTEdCursor
 {
@@ -102,6 +157,9 @@ struct TTEdCursor
     size_t cx = 0;
     size_t cy = 0;
     size_t rx = 0;
+    size_t vOffset = 0;
+    size_t sx = 0;
+    size_t sy = 0;
 
     /**
      * @brief Converts the cursor position to the render position for the row.
@@ -118,13 +176,30 @@ struct TTEdCursor
  *
  * @param sRaw Raw representation of file row data.
  * @param sRender Parsed representation accounting for tabs.
- * @param textState Render state for ith element
+ * @param textStates Render state for ith element of sRender
+ * @param spans Run-length index over textStates, ordered by start column
+ * @param image Columns of the row last handed to the renderer, see TerminalGUI::captureRows
+ * @param wrapBreaks Start column of each soft-wrapped segment after the first
+ * @param foldLen Number of rows after this one hidden by a fold anchored here, 0 if not folded
+ * @param matches Rendered column ranges of search matches, drawn over textStates; see TerminalGUI::overlayMatches
+ * @param matchGen TTEdSearch::generation that matches was found for, 0 when stale
  */
 struct Row
 {
     std::string sRaw;
     std::string sRender;
-    std::array<textState, UCHAR_MAX> textStates;
+    std::vector<textState> textStates;
+    std::vector<StateSpan> spans;
+
+    std::shared_ptr<const RowImage> image;
+
+    std::vector<size_t> wrapBreaks;
+    size_t wrapWidth = 0;
+
+    size_t foldLen = 0;
+
+    std::vector<std::pair<size_t, size_t>> matches;
+    size_t matchGen = 0;
 
     Row(std::string s);
 
@@ -167,6 +242,65 @@ struct Row
     void updateRender();
 
     bool isSeparator(int c);
+
+    /**
+     * @brief Maps a column of sRaw to the column of sRender it is drawn at.
+     *
+     * @param cx The raw column, at most size().
+     * @return The rendered column.
+     */
+    size_t rawToRender(size_t cx) const;
+
+    /**
+     * @brief Rebuilds spans from textStates, required whenever textStates change; marks matches stale.
+     */
+    void indexSpans();
+
+    /**
+     * @brief Finds the span covering a rendered column in O(log n).
+     *
+     * @param col The rendered column.
+     * @return Index into spans of the run containing col.
+     */
+    size_t spanAt(size_t col) const;
+
+    /**
+     * @brief Gets an immutable copy of a window of the row, reusing the last one while the row
+     * and the window are unchanged.
+     *
+     * @param offset First rendered column of the window.
+     * @param width Width of the window in columns, SIZE_MAX for the rest of the row.
+     * @return The image, shared with any frame still holding it.
+     */
+    std::shared_ptr<const RowImage> imageOf(size_t offset, size_t width);
+
+    /**
+     * @brief Drops the cached image, required whenever sRender, textStates or matches change.
+     */
+    void invalidateImage();
+
+    /**
+     * @brief Computes soft-wrap breakpoints, reusing the cached ones if the width is unchanged.
+     *
+     * Breaks after the last space that fits, or mid-word when a word is wider than the screen.
+     *
+     * @param width Width of the text area in columns.
+     * @return The number of screen lines the row occupies.
+     */
+    size_t wrapLayout(size_t width);
+
+    /**
+     * @brief Finds the soft-wrapped segment containing a rendered column.
+     *
+     * @param rx The rendered column.
+     * @return Index of the segment, 0 for the first.
+     */
+    size_t segmentOf(size_t rx) const;
+
+    /**
+     * @brief Gets the first rendered column of a soft-wrapped segment.
+     */
+    size_t segmentStart(size_t seg) const;
 };
 
 /**
@@ -201,12 +335,30 @@ struct TTEdStatus
  * @param sRow Number of rows in the terminal window.
  * @param sCol Number of columns in the terminal window.
  * @param tty Terminal I/O settings.
+ * @param softWrap Whether long rows wrap onto further screen lines instead of scrolling sideways.
+ * @param syncOutput Whether the terminal supports synchronized output (DEC mode 2026).
  */
 struct TTEdTermData
 {
     size_t sRow;
     size_t sCol;
     struct termios tty;
+    bool softWrap = false;
+    bool syncOutput = false;
+
+    /**
+     * @brief Gets the number of columns available for text, right of the row marker gutter.
+     */
+    size_t textCols() const;
+
+    /**
+     * @brief Asks the terminal whether it supports synchronized output and sets syncOutput.
+     *
+     * Must be called in raw mode. Sends DECRQM for mode 2026 followed by a primary device
+     * attributes request, which every terminal answers, so the wait ends without a timeout
+     * on terminals that ignore DECRQM.
+     */
+    void detectSyncOutput();
 
     /**
      * @brief Gets the current size of the terminal window.
@@ -237,6 +389,14 @@ struct TTEdTermData
  * @param filename The name of the file.
  * @param fileData Vector of shared pointers to Row objects representing file content.
  * @param modified Flag indicating whether the file has been modified.
+ * @param edits Count of edits ever applied, for caches that depend on the text.
+ * @param lines Treap keyed by row position of the screen lines each row occupies and the folds hiding rows, see LineIndex;
+ * maintained while soft wrap is on or rows are folded.
+ * @param linesWidth Wrap width lines was built for, 0 for one line per row.
+ * @param linesDirty Set when lines must be rebuilt, as when soft wrap is toggled; rows added or removed are applied in place.
+ * @param folds Number of active folds.
+ * @param journaling Whether edits are recorded in journal, as they are while collaborating.
+ * @param journal Changes made by editing since the journal was last taken, in order.
  */
 struct TTEdFileData
 {
@@ -245,6 +405,86 @@ struct TTEdFileData
     std::string extension;
     std::vector<std::shared_ptr<Row>> fileData;
     int modified = 0;
+    size_t edits = 0;
+
+    LineIndex lines;
+    size_t linesWidth = 0;
+    bool linesDirty = true;
+    size_t folds = 0;
+
+    bool journaling = false;
+    std::vector<Crdt::Change> journal;
+
+    /**
+     * @brief Brings the visual line index up to date for a wrap width.
+     *
+     * Rows inserted or removed are applied to the index as they happen, so this only rebuilds
+     * it for a new width, which re-lays out every row, or after the rows were replaced wholesale.
+     *
+     * @param wrapWidth Width of the text area in columns, 0 to disable wrapping.
+     */
+    void syncLines(size_t wrapWidth);
+
+    /**
+     * @brief Gets the number of screen lines a row occupies when not folded away.
+     *
+     * @param pos The position of the row.
+     */
+    size_t rowLines(size_t pos) const;
+
+    /**
+     * @brief Hides the rows following a header row, in O(log n) once the line index is in use.
+     *
+     * @param header The position of the row that stays visible and anchors the fold.
+     * @param len The number of rows to hide after the header.
+     */
+    void fold(size_t header, size_t len);
+
+    /**
+     * @brief Shows the rows hidden by the fold anchored at a header row, if any.
+     *
+     * @param header The position of the fold's header row.
+     */
+    void unfold(size_t header);
+
+    /**
+     * @brief Unfolds every fold hiding a row, found through the line index in O((k + 1) log n).
+     *
+     * @param pos The position of the row to make visible.
+     */
+    void reveal(size_t pos);
+
+    /**
+     * @brief Finds the rows to fold under a header: up to the matching brace if the header
+     * opens a block, otherwise the following rows indented deeper than it.
+     *
+     * @param header The position of the header row.
+     * @return The number of rows to hide after the header.
+     */
+    size_t foldRange(size_t header) const;
+
+    /**
+     * @brief Gets the next row that is not folded away, in O(log n).
+     *
+     * @param pos The position of the current row.
+     * @return The position of the next visible row, or size() past the last.
+     */
+    size_t nextVisible(size_t pos) const;
+
+    /**
+     * @brief Gets the previous row that is not folded away, in O(log n).
+     *
+     * @param pos The position of the current row, greater than 0.
+     * @return The position of the previous visible row.
+     */
+    size_t prevVisible(size_t pos) const;
+
+    /**
+     * @brief Updates the visual line index after a single row's text changed.
+     *
+     * @param pos The position of the edited row.
+     */
+    void touchRow(size_t pos);
 
     /**
      * @brief Inserts a row at the specified position.
@@ -254,6 +494,22 @@ struct TTEdFileData
      */
     void insertRow(size_t pos, Row r = {""});
 
+    /**
+     * @brief Inserts rows at the specified position, keeping the visual line index current.
+     *
+     * @param pos The position of the first row inserted.
+     * @param rows The rows to insert.
+     */
+    void insertRows(size_t pos, std::vector<std::shared_ptr<Row>> rows);
+
+    /**
+     * @brief Erases consecutive rows, keeping the visual line index current.
+     *
+     * @param pos The position of the first row erased.
+     * @param n The number of rows to erase.
+     */
+    void eraseRows(size_t pos, size_t n);
+
     /**
      * @brief Gets the number of rows in the file.
      *
@@ -291,6 +547,14 @@ struct TTEdFileData
      */
     void insertNewLine(TTEdCursor &cursor);
 
+    /**
+     * @brief Makes a change from a peer, without recording it in the journal.
+     *
+     * @param change The change, see Crdt::Change.
+     * @param cursor The cursor, moved with the text around it.
+     */
+    void splice(const Crdt::Change &change, TTEdCursor &cursor);
+
     /**
      * @brief Converts the file data to a string stream representation.
      *
@@ -305,16 +569,397 @@ struct TTEdMod
     int c;
 };
 
-struct TTEdConnection 
+/**
+ * @struct TTEdPeer
+ * @brief A collaborator on the other end of a socket.
+ *
+ * @param id Tags the operations received from the peer, so they are not sent back to it.
+ * @param fd The socket.
+ * @param ip The peer's address.
+ * @param synced Whether the peer has been given the document; a peer accepted by the host has not.
+ * @param greeting Bytes received from a peer not yet synced, which open with its hello, see Snapshot.
+ * @param greeted Whether the peer's hello has been read off greeting and handed on to be answered.
+ * @param pending Bytes for this peer alone, the snapshot for one joining, sent before the broadcast.
+ * @param pendHead Start of the first pending byte not yet sent.
+ * @param sent Offset into the broadcast stream of the first byte not yet sent.
+ * @param blocked Whether the socket is full, so sending waits for epoll to report it writable.
+ * @param error Why the peer was lost, empty while it is connected.
+ * @param closing Why the socket closed, which becomes error once what arrived before is decoded.
+ * @param inbox Bytes received, reassembled into frames.
+ */
+struct TTEdPeer
 {
-    struct sockaddr_in address;
+    uint32_t id;
+    int fd;
     std::string ip;
-    fd_set readfds;
-    timeval timeout{0, 1000};
+    bool synced = false;
+    std::string greeting;
+    bool greeted = false;
+    std::string pending;
+    size_t pendHead = 0;
+    size_t sent = 0;
+    bool blocked = false;
+    std::string error;
+    std::string closing;
+    Protocol::Reader inbox;
+};
 
-    int sockfd;
+/**
+ * @struct TTEdConnection
+ * @brief Connections to the collaborating peers, a host and its guests or a guest and its host.
+ *
+ * Operations are queued and sent in batches: everything queued within BATCH_WINDOW of the first
+ * goes out as one frame, see Protocol. Frames are encoded once into a broadcast stream that every
+ * peer is sent from at its own offset, skipping the frames that came from it, so relaying to many
+ * peers costs a send each and nothing more. The host listens for peers joining at any time and
+ * watches every socket with one epoll set; a peer that falls MAX_LAG behind is dropped.
+ *
+ * @param batch Operations queued since the last frame was sent.
+ * @param batchOrigin The peer the operations in batch came from.
+ * @param batchStart When the first operation in batch was queued.
+ * @param outbox The broadcast stream from outBase on, trimmed once every peer is past its start.
+ * @param outBase Offset into the broadcast stream of outbox's first byte.
+ * @param frames The origin and end offset of each frame in outbox not yet sent to every peer.
+ * @param peers The peers by id.
+ */
+struct TTEdConnection 
+{
+    static constexpr auto BATCH_WINDOW = std::chrono::milliseconds(4);
+    static constexpr size_t MAX_BATCH = 16 << 10; ///< Batch size in bytes sent without waiting out the window.
+    static constexpr size_t MAX_LAG = 32 << 20; ///< Bytes a peer may fall behind before it is dropped.
+    static constexpr size_t MAX_HELLO = 1 << 20; ///< Bytes a joining peer may send before its hello is complete.
+
+    struct Frame
+    {
+        size_t end;
+        uint32_t origin;
+    };
+
+    int listenfd = -1;
+    int epollfd = -1;
     bool host = false;
-    bool connected;
+    bool connected = false;
+
+    Protocol::Writer batch;
+    uint32_t batchOrigin = 0;
+    std::chrono::steady_clock::time_point batchStart;
+    std::string outbox;
+    size_t outBase = 0;
+    std::deque<Frame> frames;
+    std::map<uint32_t, TTEdPeer> peers;
+    uint32_t nextId = 1;
+
+    /**
+     * @brief Starts hosting: listens on the port for peers to join.
+     *
+     * @param port The port to listen on, on every interface.
+     * @param err Set to why listening failed.
+     * @return false if the port could not be listened on.
+     */
+    bool listen(uint16_t port, std::string &err);
+
+    /**
+     * @brief Adds a peer connected on the socket, making the socket non-blocking and turning off
+     * Nagle's algorithm, as frames are batched here.
+     *
+     * @param fd The socket, which the connection closes from now on.
+     * @param ip The peer's address.
+     * @return The peer, which starts at the end of the broadcast stream.
+     */
+    TTEdPeer &add(int fd, const std::string &ip);
+
+    /**
+     * @brief Closes a peer's socket and forgets it.
+     */
+    void drop(uint32_t id);
+
+    /**
+     * @brief Closes every socket and ends the session.
+     */
+    void close();
+
+    /**
+     * @brief Gets the offset into the broadcast stream of its end.
+     */
+    size_t end() const;
+
+    /**
+     * @brief Queues an operation for every peer but the one it came from.
+     */
+    void queue(const Protocol::Op &op);
+
+    /**
+     * @brief Ends the batch, appending it to the broadcast stream as one frame.
+     */
+    void seal();
+
+    /**
+     * @brief Sends the batch once its window has passed, and gives every peer whatever of the
+     * stream its socket will take. Peers whose sockets fail are marked with an error.
+     *
+     * @param force Whether to send the batch before its window has passed.
+     */
+    void flush(bool force = false);
+
+    /**
+     * @brief Accepts peers waiting to join and reads everything the peers have sent, decoding
+     * the frames completed by it. Peers that closed or sent something that is not a frame are
+     * marked with an error.
+     *
+     * @param ops The operations decoded are appended here, tagged with the peer they came from,
+     * including those that arrived before a peer was lost.
+     * @return The number of operations decoded.
+     */
+    int receive(std::vector<Protocol::Op> &ops);
+
+private:
+    void watch(TTEdPeer &peer, bool writable);
+    void send(TTEdPeer &peer);
+    void trim();
+};
+
+/**
+ * @struct TTEdSession
+ * @brief The editor's side of a collaboration session; the sockets are the network thread's.
+ *
+ * @param connected Whether the session is live, so edits are sent as they are made.
+ * @param starting Whether a LISTEN or CONNECT was posted and its HOSTING or ATTACHED reply is awaited.
+ * @param host Whether this editor hosts the session.
+ * @param peers The peers connected, as last reported by the network thread.
+ * @param doc The shared sequence the document's edits are made to, see Crdt::Sequence.
+ * @param log The operations integrated into doc lately, for peers resuming, see Crdt::Log.
+ */
+struct TTEdSession
+{
+    bool connected = false;
+    bool starting = false;
+    bool host = false;
+    size_t peers = 0;
+    Crdt::Sequence doc;
+    Crdt::Log log;
+};
+
+/**
+ * @struct NetMsg
+ * @brief A message between the editor and the network thread.
+ *
+ * To the network thread: OP queues op for the peers, LISTEN starts hosting on port, CONNECT joins
+ * the host at text and port with a hello for have and floor, SYNC answers the joining peer with
+ * text and starts relaying to it, CLOSE ends the session.
+ * To the editor: OP is op from a peer, HOSTING and ATTACHED report a session started, failing
+ * with error; JOINED is a peer's hello, from address text; LEFT is peer lost for error.
+ *
+ * @param peers The peers connected when the network thread sent the message.
+ * @param transfer The snapshot a guest joining received; null when the host resumed the session
+ * at version have instead.
+ */
+struct NetMsg
+{
+    enum Kind : uint8_t
+    {
+        OP,
+        LISTEN,
+        CONNECT,
+        SYNC,
+        CLOSE,
+        HOSTING,
+        ATTACHED,
+        JOINED,
+        LEFT,
+    };
+
+    Kind kind = OP;
+    Protocol::Op op;
+    uint32_t peer = 0;
+    uint16_t port = 0;
+    size_t peers = 0;
+    std::string text;
+    std::string error;
+    Crdt::Version have;
+    Crdt::Version floor;
+    std::shared_ptr<Snapshot::Transfer> transfer;
+};
+
+/**
+ * @class NetThread
+ * @brief Runs the connection on a thread of its own, so a slow peer or a join never stalls typing.
+ *
+ * The editor and the thread trade NetMsgs through a Ring each way and wake each other with an
+ * eventfd, which the editor only writes when the thread is asleep, so typing costs no syscall.
+ * Neither side ever waits on the other: what does not fit a full ring is kept in order by its
+ * sender and pushed once there is room. The thread starts on the first message posted.
+ */
+class NetThread
+{
+public:
+    static constexpr size_t RING = 1024; ///< Messages each ring holds.
+
+private:
+    TTEdConnection conn;
+    Ring<NetMsg> toNet{RING};
+    Ring<NetMsg> toEditor{RING};
+    std::deque<NetMsg> outSpill; ///< The editor's messages that did not fit toNet.
+    std::deque<NetMsg> inSpill;  ///< The thread's messages that did not fit toEditor.
+    int netWake = -1;
+    int editorWake = -1;
+    std::thread thread;
+    std::atomic<bool> stopping{false};
+    std::atomic<bool> asleep{false}; ///< Whether the thread may be waiting in poll, so posting must wake it.
+    std::atomic<size_t> held{0};
+    bool delivered = false;      ///< Whether the thread has sent the editor messages since it last woke it.
+
+    void wake();
+    void run();
+    void handle(NetMsg &msg);
+    void attach(NetMsg &msg);
+    void deliver(NetMsg msg);
+
+public:
+    NetThread();
+    ~NetThread();
+
+    NetThread(const NetThread &) = delete;
+    NetThread &operator=(const NetThread &) = delete;
+
+    /**
+     * @brief Sends a message to the network thread; called by the editor only.
+     */
+    void post(NetMsg msg);
+
+    /**
+     * @brief Takes the next message from the network thread; called by the editor only.
+     *
+     * @return false if there is none.
+     */
+    bool next(NetMsg &msg);
+
+    /**
+     * @brief Gets an eventfd that turns readable when the network thread has sent messages.
+     */
+    int wakeFd() const;
+
+    /**
+     * @brief Gets the bytes the connection held on the heap when the thread last looked.
+     */
+    size_t bytes() const;
+
+    /**
+     * @brief Ends the session and joins the thread.
+     */
+    void stop();
+};
+
+/**
+ * @struct SearchHit
+ * @brief A match of the search query.
+ *
+ * @param row The row of the match.
+ * @param col The raw column the match starts at.
+ * @param len The length of the match in raw bytes.
+ */
+struct SearchHit
+{
+    size_t row;
+    size_t col;
+    size_t len = 0;
+};
+
+/**
+ * @struct TTEdSearch
+ * @brief State of the search prompt, kept between keystrokes.
+ *
+ * @param query The query hits were collected for.
+ * @param ignoreCase Whether hits were matched regardless of case.
+ * @param edits TTEdFileData::edits when hits were collected.
+ * @param hits Every match of query in file order, empty when there were more than cap.
+ * @param complete Whether hits holds every match, so a longer query can narrow them down.
+ * @param total Matches counted by the last full collection, 0 when not counted.
+ * @param current Index in hits of the match the cursor is on (0 past the cap), -1 for none.
+ * @param match Position of the match the cursor is on.
+ * @param origin Cursor position the search started from; a new query goes to the first match after it.
+ * @param cap Most hits kept; beyond it matches are found by scanning from the cursor.
+ * @param active Whether the search prompt is open.
+ * @param regex Whether the query is a regular expression; Ctrl-R in the prompt toggles it.
+ * @param compiled The query compiled in regex mode, kept so stepping reuses its DFA states.
+ * @param finder The query compiled in literal mode.
+ * @param error Why the regex failed to compile, empty if it did.
+ * @param generation Bumped whenever the query or its hits change, so rows know to find their matches again.
+ */
+struct TTEdSearch
+{
+    std::string query;
+    bool ignoreCase = false;
+    size_t edits = 0;
+    std::vector<SearchHit> hits;
+    bool complete = false;
+    size_t total = 0;
+    long current = -1;
+    SearchHit match{0, 0};
+    SearchHit origin{0, 0};
+    size_t cap = 1 << 22;
+    bool active = false;
+    bool regex = false;
+    std::shared_ptr<Regex> compiled;
+    std::shared_ptr<Finder> finder;
+    std::string error;
+    size_t generation = 1;
+
+    /**
+     * @brief Forgets the query, its hits and its compiled form; the mode stays.
+     */
+    void reset();
+
+    /**
+     * @brief Binary searches hits for the first match at or after a position.
+     *
+     * @return Its index, wrapping around to 0 past the last match; -1 when there are no hits.
+     */
+    long locate(SearchHit at) const;
+};
+
+/**
+ * @struct GrepMatch
+ * @brief A row matched by a project grep.
+ *
+ * @param path The file, relative to the directory searched.
+ * @param row The row of the match.
+ * @param col The raw column the first match on the row starts at.
+ * @param len The length of that match in raw bytes.
+ * @param line The text of the row, cut short past Grep::MAX_LINE bytes.
+ */
+struct GrepMatch
+{
+    std::string path;
+    size_t row;
+    size_t col;
+    size_t len;
+    std::string line;
+};
+
+/**
+ * @struct TTEdGrep
+ * @brief State of the project grep and its results buffer.
+ *
+ * The results are a read-only buffer that trades places with the open file: whichever of the two
+ * is not on screen waits in other.
+ *
+ * @param job The search streaming into the results, null before the first grep.
+ * @param matches The match shown on each row of the results buffer.
+ * @param other The buffer not on screen, empty when there is none.
+ * @param otherCursor The cursor in other.
+ * @param otherSyntax The highlighting of other.
+ * @param showing Whether the results buffer is on screen.
+ * @param reported Whether the end of the search has been reported.
+ */
+struct TTEdGrep
+{
+    std::shared_ptr<Grep> job;
+    std::vector<GrepMatch> matches;
+    TTEdFileData other;
+    TTEdCursor otherCursor;
+    SyntaxHL *otherSyntax = NULL;
+    bool showing = false;
+    bool reported = true;
 };
 
 /**
@@ -325,6 +970,10 @@ struct TTEdConnection
  * @param term Terminal-related data and settings.
  * @param fileData The data of the currently open file.
  * @param status The current status message and timestamp.
+ * @param session The collaboration session, see TTEdSession.
+ * @param net The network thread the session's connection runs on.
+ * @param search The state of the search prompt.
+ * @param grep The state of the project grep.
  */
 struct Config
 {
@@ -332,8 +981,11 @@ struct Config
     TTEdTermData term;
     TTEdFileData fileData;
     TTEdStatus status;
-    TTEdConnection conn;
+    TTEdSession session;
+    NetThread net;
     TTEdMod mod;
+    TTEdSearch search;
+    TTEdGrep grep;
     static SyntaxHL *syntax;
 
     /**
@@ -341,27 +993,30 @@ struct Config
      */
     void scroll();
 
-    // Receive data from the socket
-    int recv() {
-        if (!conn.connected) {
-            status.setStatusMsg("No connection established.");
-            return -1;
-        }
-
-        ssize_t bytesRead = ::recv(conn.sockfd, &mod, sizeof(mod), 0);
-
-        if (bytesRead < 0) {
-            // status.setStatusMsg("Recieve none");
-            return -1;
-        } else if (bytesRead == 0) {
-            status.setStatusMsg("Connection closed by peer.");
-            conn.connected = false;
-            return -1;
-        }
-
-        // Return the received data as a string
-        return 1;
-    }
+    /**
+     * @brief Handles scrolling by visual lines while soft wrap is on or rows are folded.
+     */
+    void scrollIndexed();
+
+    /**
+     * @brief Handles what the network thread has sent: applies the peers' operations, relaying
+     * them while hosting, answers peers joining, and reports sessions starting and peers
+     * leaving in the status.
+     *
+     * @return The number of operations applied.
+     */
+    int recv();
+
+    /**
+     * @brief Logs an operation for every edit journaled since the last call, posting it to
+     * the network thread while connected.
+     */
+    void share();
+
+    /**
+     * @brief Applies an operation from a peer to the document, moving the cursor with the text around it.
+     */
+    void apply(const Protocol::Op &op);
 
     // // Send data to the socket
     // bool send(const std::string& data) {
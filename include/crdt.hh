@@ -0,0 +1,239 @@
+#pragma once
+
+#include <lineindex.hh>
+#include <protocol.hh>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+struct TTEdFileData;
+
+/**
+ * @namespace Crdt
+ * @brief The shared document collaborating editors converge on.
+ */
+namespace Crdt
+{
+    /**
+     * @struct Change
+     * @brief A change to the text of the rows, which either erases or inserts.
+     *
+     * Positions count a newline at the end of every row, so erasing one joins two rows and
+     * inserting one splits a row.
+     *
+     * @param row The row the change starts on; the number of rows for past the last one.
+     * @param col The raw column the change starts at.
+     * @param erase The number of characters erased.
+     * @param text The text inserted.
+     */
+    struct Change
+    {
+        size_t row = 0;
+        size_t col = 0;
+        size_t erase = 0;
+        std::string text;
+    };
+
+    /**
+     * @brief How much of each site's editing a replica has: the clock of the last operation
+     * it integrated from every site.
+     *
+     * A site's operations reach every replica in the order it made them, so a replica holding
+     * one holds all the site made before it.
+     */
+    using Version = std::map<uint32_t, uint64_t>;
+
+    /**
+     * @brief Checks whether a replica at version a holds everything one at version b does,
+     * having heard of every site b has.
+     */
+    bool includes(const Version &a, const Version &b);
+
+    /**
+     * @brief Gets the clock of the last character an operation inserts, or the stamp of a delete.
+     */
+    uint64_t last(const Protocol::Op &op);
+
+    /**
+     * @class Sequence
+     * @brief A replicated sequence of characters in the style of RGA, stored as runs.
+     *
+     * Every character has an Id that never changes. Text is inserted after a character,
+     * ahead of any inserted after that character before with a smaller id, so every replica
+     * puts concurrent inserts in the same order whatever order they arrive in. Deleted
+     * characters stay as tombstones without their text, so later inserts can still name them.
+     *
+     * Characters are stored in blocks, runs of consecutive ids from one site, so a stretch of
+     * typing is one block and memory stays near the size of the text. Blocks are grouped in
+     * chunks of at most CHUNK_BLOCKS, with a LineIndex over the characters and newlines of
+     * each chunk and a map from where each block's ids start to its chunk, so an operation
+     * costs O(log n) plus a scan of one chunk.
+     */
+    class Sequence
+    {
+    public:
+        static constexpr size_t BASE_BLOCK = 4096;  ///< Characters per block of a document as loaded.
+        static constexpr size_t CHUNK_BLOCKS = 64;  ///< Blocks a chunk holds before it splits.
+
+    private:
+        struct Block
+        {
+            Protocol::Id id;
+            size_t len;
+            size_t lines;     ///< Newlines in text.
+            bool deleted;
+            std::string text; ///< Empty once deleted.
+        };
+
+        struct Chunk
+        {
+            std::vector<Block> blocks;
+            size_t at = 0;    ///< Position in chunks.
+            size_t chars = 0; ///< Characters not deleted.
+            size_t lines = 0; ///< Newlines not deleted.
+        };
+
+        struct Pos
+        {
+            size_t chunk;
+            size_t block;
+            size_t off;
+        };
+
+        std::vector<std::unique_ptr<Chunk>> chunks;
+        LineIndex chars;
+        LineIndex lines;
+        std::map<std::pair<uint32_t, uint64_t>, Chunk *> index; ///< Site and first clock of each block.
+        uint64_t clock = 0;
+        uint32_t site = 0;
+        Version seen;
+
+        void rebuild();
+        void recount(Chunk &chunk);
+        void append(Block block);
+        void splitChunk(size_t c);
+        Pos split(Pos p);
+        void normalize(Pos &p) const;
+        bool atEnd(const Pos &p) const;
+        bool find(const Protocol::Id &id, Pos &p) const;
+        Pos at(size_t offset) const;
+        size_t offsetOf(const Pos &p) const;
+        size_t rowStart(size_t row) const;
+        Change change(const Pos &p) const;
+        void insert(const Protocol::Op &op, std::vector<Change> *changes);
+        void erase(Protocol::Span span, std::vector<Change> *changes);
+
+    public:
+        Sequence();
+
+        /**
+         * @brief Starts the sequence from a document, as a new site.
+         *
+         * The document's characters are given a site of their own, so replicas of another
+         * document loaded elsewhere share none of their ids.
+         */
+        void load(const TTEdFileData &fData);
+
+        /**
+         * @brief Appends the ids and tombstones of the sequence, without its text, and its version to out.
+         */
+        void encode(std::string &out) const;
+
+        /**
+         * @brief Rebuilds the sequence from encode's output and the document's text, as a new site.
+         *
+         * @return false if the encoding is corrupt or does not match the document.
+         */
+        bool decode(std::string_view in, const TTEdFileData &fData);
+
+        /**
+         * @brief Applies a change made to the rows here, making the operation to send for it.
+         *
+         * @return false if the change changed nothing.
+         */
+        bool local(const Change &change, Protocol::Op &op);
+
+        /**
+         * @brief Applies an operation from a peer, appending the changes to make to the rows.
+         */
+        void apply(const Protocol::Op &op, std::vector<Change> &changes);
+
+        /**
+         * @brief Gets the operations integrated, local ones included.
+         */
+        const Version &version() const;
+
+        /**
+         * @brief Gets the number of characters not deleted.
+         */
+        size_t size() const;
+
+        /**
+         * @brief Gets the number of blocks, tombstones included.
+         */
+        size_t blocks() const;
+
+        /**
+         * @brief Gets the bytes the sequence holds on the heap.
+         */
+        size_t bytes() const;
+    };
+
+    /**
+     * @class Log
+     * @brief The operations a replica integrated lately, kept so a peer that dropped can be
+     * sent what it missed rather than the whole document.
+     *
+     * Operations are kept in the order they were integrated, a run of typing as one, until
+     * they hold more than WINDOW bytes; the oldest are dropped then, and the floor records
+     * how far each site's dropped operations reach.
+     */
+    class Log
+    {
+    public:
+        static constexpr size_t WINDOW = 8 << 20; ///< Bytes of operations kept.
+
+    private:
+        std::deque<Protocol::Op> ops;
+        Version dropped;
+        size_t held = 0;
+
+    public:
+        /**
+         * @brief Empties the log, taking everything up to a version as dropped.
+         */
+        void start(const Version &base);
+
+        /**
+         * @brief Keeps an operation once it is integrated.
+         */
+        void keep(const Protocol::Op &op);
+
+        /**
+         * @brief Gets how far each site's dropped operations reach; a replica needs at least
+         * this much to be brought up to date from the log.
+         */
+        const Version &floor() const;
+
+        /**
+         * @brief Appends, in order, the operations kept that a replica at a version is missing;
+         * all it is missing when the version includes the floor.
+         */
+        void since(const Version &have, std::vector<Protocol::Op> &out) const;
+
+        /**
+         * @brief Gets the number of operations kept.
+         */
+        size_t size() const;
+
+        /**
+         * @brief Gets the bytes the log holds on the heap.
+         */
+        size_t bytes() const;
+    };
+};
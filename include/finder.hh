@@ -0,0 +1,99 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+/**
+ * @class Finder
+ * @brief A substring query compiled once and scanned over many rows.
+ *
+ * memchr skips ahead to the query's rarest byte, unless case is ignored and that byte is a
+ * letter. Otherwise, and in rows where that byte turns out to be common, starts are filtered
+ * 16 at a time on the query's two rarest bytes (SSE2) before candidates are verified. Without SSE2, and for
+ * the last few bytes of a row, a Horspool scan is used instead.
+ */
+class Finder
+{
+private:
+    std::string needle; ///< The query, lowered when ignoring case.
+    bool ignoreCase;
+    std::array<size_t, 256> shift; ///< Horspool shift per byte.
+    size_t rare1 = 0;              ///< Offset of the query's rarest byte.
+    size_t rare2 = 0;              ///< Offset of its next rarest byte, distinct unless the query is one byte.
+
+    /**
+     * @brief Checks for the query at a position.
+     */
+    bool verify(const char *at) const;
+
+    /**
+     * @brief memchr-driven scan of starts [i, end) for the query's rarest byte.
+     *
+     * @param i The first start to try, advanced past the starts ruled out.
+     * @return The match, or std::string::npos when none was found before i stopped.
+     */
+    size_t skim(std::string_view hay, size_t &i, size_t end) const;
+
+    /**
+     * @brief SSE2 scan for the first match starting in [i, end), end if there is none.
+     *
+     * @tparam Fold Whether to match both cases of letters.
+     */
+    template <bool Fold>
+    size_t sieve(std::string_view hay, size_t i, size_t end) const;
+
+    /**
+     * @brief Horspool scan of hay[from, to + size()) for a match starting before to.
+     */
+    size_t scan(std::string_view hay, size_t from, size_t to) const;
+
+public:
+    /**
+     * @brief Compiles a query.
+     *
+     * @param query The text to look for.
+     * @param ignoreCase Whether ASCII letters match regardless of case.
+     */
+    Finder(std::string_view query, bool ignoreCase);
+
+    /**
+     * @brief Smart case: a query without uppercase letters ignores case.
+     */
+    static bool smartCase(std::string_view query);
+
+    /**
+     * @brief Gets the length of the query in bytes.
+     */
+    size_t size() const;
+
+    /**
+     * @brief Finds the first match at or after a position.
+     *
+     * @param hay The text to search.
+     * @param from The first position a match may start at.
+     * @return The position of the match, or std::string::npos. An empty query never matches.
+     */
+    size_t find(std::string_view hay, size_t from = 0) const;
+
+    /**
+     * @brief Finds the first match at or after a position, reporting its length like Regex::find.
+     */
+    size_t find(std::string_view hay, size_t from, size_t &len) const;
+
+    /**
+     * @brief Finds every match in a row, overlapping ones included, like Regex::findAll.
+     *
+     * @param out Set to the position and length of each match, in order.
+     */
+    void findAll(std::string_view hay, std::vector<std::pair<size_t, size_t>> &out) const;
+
+    /**
+     * @brief Checks whether the query matches at a position.
+     */
+    bool matchesAt(std::string_view hay, size_t pos) const;
+};
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <config.hh>
+#include <atomic>
+#include <cstddef>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+/**
+ * @class Grep
+ * @brief Searches every file under a directory on background threads, handing matches over as they are found.
+ *
+ * Directories and files are tasks on per-thread deques. A thread pushes what it lists onto its own
+ * deque and works from the back; an idle thread steals from the front of another's, where the
+ * directories nearest the root and so the most work wait, so one deep directory keeps every
+ * thread busy. Files are mapped with mmap: a literal query is found across the whole file at
+ * once, a regex row by row. Hidden entries are skipped, symlinks are not followed, and files
+ * with a NUL byte near the start are taken as binary.
+ */
+class Grep
+{
+private:
+    struct Task;
+    struct Worker;
+
+    std::filesystem::path root;
+    std::shared_ptr<const Finder> finder; ///< The query in literal mode.
+    std::shared_ptr<const Regex> pattern; ///< The query in regex mode, copied by each thread.
+    std::string err;
+
+    std::mutex mutex; ///< Guards found and head.
+    std::vector<GrepMatch> found;
+    size_t head = 0; ///< First match in found not yet taken.
+
+    std::atomic<size_t> pending{0}; ///< Tasks queued or running; the walk is over at 0.
+    std::atomic<size_t> scanned{0};
+    std::atomic<size_t> count{0};
+    std::atomic<bool> stopping{false};
+    std::atomic<bool> finished{false};
+    std::atomic<bool> capped{false};
+    std::thread driver;
+
+    /**
+     * @brief Runs the walk on a pool of its own, so the editor's shared pool stays free.
+     */
+    void walk();
+
+    /**
+     * @brief Runs tasks for one worker, stealing when its deque is empty, until none are left.
+     */
+    void work(std::vector<Worker> &workers, size_t id);
+
+    /**
+     * @brief Queues the entries of a directory on a worker's deque.
+     */
+    void list(Worker &self, const std::filesystem::path &dir);
+
+    /**
+     * @brief Maps a file and records its first match on every row that has one.
+     *
+     * @param re The worker's copy of the pattern, null in literal mode.
+     */
+    void scan(Worker &self, const std::filesystem::path &file, Regex *re);
+
+public:
+    static constexpr size_t MAX_LINE = 512;        ///< Bytes of a matching row kept for display.
+    static constexpr size_t MAX_MATCHES = 1 << 20; ///< Matches after which the search stops.
+
+    /**
+     * @brief Starts searching.
+     *
+     * @param root The directory to search; matches report paths relative to it.
+     * @param query The text, or in regex mode the pattern, to find; smart case as in search.
+     * @param regex Whether the query is a regular expression.
+     */
+    Grep(std::filesystem::path root, std::string_view query, bool regex);
+
+    /**
+     * @brief Stops the search and joins its threads.
+     */
+    ~Grep();
+
+    Grep(const Grep &) = delete;
+    Grep &operator=(const Grep &) = delete;
+
+    /**
+     * @brief Moves matches found since the last call to the end of out, in the order they were found.
+     *
+     * @param max The most matches to move.
+     */
+    void take(std::vector<GrepMatch> &out, size_t max);
+
+    /**
+     * @brief Blocks until the search is over.
+     */
+    void wait();
+
+    /**
+     * @brief Checks whether every file was searched or the search stopped.
+     */
+    bool done() const;
+
+    /**
+     * @brief Gets the number of files searched so far.
+     */
+    size_t files() const;
+
+    /**
+     * @brief Gets the number of matches found so far.
+     */
+    size_t matches() const;
+
+    /**
+     * @brief Checks whether the search stopped at MAX_MATCHES.
+     */
+    bool truncated() const;
+
+    /**
+     * @brief Gets why the regex failed to compile, empty if it did.
+     */
+    const std::string &error() const;
+};
@@ -21,6 +21,12 @@ namespace InputHandler
         PROMPTSERVER,
         PROMPTCONNECT,
         PROMPTMOD,
+        MEMREPORT,      ///< Indicates a request for the memory breakdown.
+        PROMPTFOLD,     ///< Indicates a request to fold or unfold at the cursor.
+        PROMPTREPLACE,  ///< Indicates a prompt to replace every match of a query.
+        PROMPTGREP,     ///< Indicates a prompt to search every file in the project.
+        GREPOPEN,       ///< Indicates a request to open the grep match under the cursor.
+        GREPBACK,       ///< Indicates a request to leave the grep results.
         SHUTDOWN,       ///< Indicates a request to shut down the editor.
     };
 
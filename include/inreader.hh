@@ -8,4 +8,9 @@ namespace InputReader
      * @return The ASCII value of the key read.
      */
     int readKey();
+
+    /**
+     * @brief Makes readKey return -1 early whenever an eventfd turns readable, which it drains.
+     */
+    void wakeOn(int fd);
 };
\ No newline at end of file
@@ -0,0 +1,182 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+/**
+ * @class LineIndex
+ * @brief Balanced tree (a treap keyed by position) over the number of screen lines each file row occupies.
+ *
+ * Maps between file rows and screen (visual) lines in O(log n), and absorbs a change to a
+ * single row's line count, or rows inserted or erased anywhere, in O(log n) plus the rows moved.
+ *
+ * Folds are kept in the same tree: each row records the length of the fold anchored on it,
+ * and a fold adds one to the depth of the rows it covers with a lazy range update. Rows at
+ * depth 0 count their lines, deeper rows none, so folding and unfolding cost O(log n)
+ * however many rows they hide.
+ *
+ * A Fenwick array over the rows would answer prefix and find as fast, but it is laid out by
+ * position: a row inserted or erased shifts every entry after it, forcing an O(n) rebuild, and
+ * folding a range would mean one update per hidden row. Splitting and merging the treap by
+ * position makes both O(log n).
+ */
+class LineIndex
+{
+private:
+    static constexpr uint32_t NIL = UINT32_MAX;
+
+    /**
+     * @struct Node
+     * @brief One row and the summary of its subtree.
+     *
+     * @param rows Rows in the subtree.
+     * @param depth Folds covering the row.
+     * @param lazy Folds covering the whole subtree not yet applied to the children.
+     * @param low Least depth in the subtree.
+     * @param lowRows Rows of the subtree at depth low.
+     * @param count Screen lines the row occupies when shown.
+     * @param sum Lines of the subtree's rows at depth low.
+     * @param fold Rows after this one covered by the fold anchored on it, 0 for none.
+     * @param reach Last row covered by a fold anchored in the subtree, counted from its first row, -1 for none.
+     */
+    struct Node
+    {
+        uint32_t left = NIL;
+        uint32_t right = NIL;
+        uint32_t prio = 0;
+        uint32_t rows = 1;
+        int32_t depth = 0;
+        int32_t lazy = 0;
+        int32_t low = 0;
+        uint32_t lowRows = 1;
+        uint32_t fold = 0;
+        int64_t reach = -1;
+        size_t count = 0;
+        size_t sum = 0;
+    };
+
+    std::vector<Node> nodes;
+    std::vector<uint32_t> spare;
+    uint32_t root = NIL;
+    uint32_t seed = 2463534242u;
+
+    uint32_t random();
+    uint32_t alloc(size_t count);
+    void release(uint32_t t);
+    uint32_t rowsOf(uint32_t t) const;
+    size_t shownOf(uint32_t t, int32_t above) const;
+    void apply(uint32_t t, int32_t delta);
+    void push(uint32_t t);
+    void pull(uint32_t t);
+    void heapify(uint32_t t);
+    uint32_t build(const std::vector<size_t> &rowCounts, const std::vector<int32_t> &depths,
+                   const std::vector<size_t> &folds, size_t begin, size_t end);
+    uint32_t descend(size_t row, std::vector<uint32_t> &path);
+    void cover(size_t row, size_t n, int32_t delta);
+    void covering(uint32_t t, size_t base, size_t row, std::vector<size_t> &out) const;
+    size_t rowsAt(uint32_t t, size_t base, size_t begin, size_t end, int32_t above, int32_t depth) const;
+    std::pair<uint32_t, uint32_t> split(uint32_t t, size_t k);
+    uint32_t merge(uint32_t a, uint32_t b);
+
+public:
+    /**
+     * @brief Rebuilds the index from per-row line counts in O(n).
+     *
+     * @param rowCounts Screen lines occupied by each row when shown.
+     * @param rowFolds Rows after each row covered by a fold anchored on it, empty for no folds.
+     */
+    void build(std::vector<size_t> rowCounts, const std::vector<size_t> &rowFolds = {});
+
+    /**
+     * @brief Inserts rows before a row in O(k + log n).
+     *
+     * @param row Position of the first row inserted, at most size().
+     * @param rowCounts Screen lines occupied by each row inserted.
+     */
+    void insert(size_t row, const std::vector<size_t> &rowCounts);
+
+    /**
+     * @brief Erases consecutive rows in O(k + log n).
+     *
+     * @param row Position of the first row erased.
+     * @param n Number of rows to erase.
+     */
+    void erase(size_t row, size_t n);
+
+    /**
+     * @brief Gets the number of indexed rows.
+     */
+    size_t size() const;
+
+    /**
+     * @brief Gets the bytes held by the tree's nodes, spare ones included.
+     */
+    size_t bytes() const;
+
+    /**
+     * @brief Gets the number of screen lines a row occupies: none when folded away.
+     */
+    size_t count(size_t row) const;
+
+    /**
+     * @brief Changes the number of screen lines a row occupies when shown.
+     */
+    void set(size_t row, size_t n);
+
+    /**
+     * @brief Hides the rows following a header row in O(log n).
+     *
+     * @param header The row anchoring the fold, not already anchoring one.
+     * @param len The number of rows to hide after the header, all within the index.
+     */
+    void fold(size_t header, size_t len);
+
+    /**
+     * @brief Removes the fold anchored on a header row, if any, in O(log n).
+     *
+     * @param header The row anchoring the fold.
+     */
+    void unfold(size_t header);
+
+    /**
+     * @brief Gets whether any fold covers a row.
+     */
+    bool hidden(size_t row) const;
+
+    /**
+     * @brief Finds the folds covering a row in O((k + 1) log n) for k folds found.
+     *
+     * @param row The row.
+     * @return The header rows of the folds, in order.
+     */
+    std::vector<size_t> covering(size_t row) const;
+
+    /**
+     * @brief Counts the rows unfolding a header would show, those its fold covers and no other
+     * fold does, in O(log n).
+     *
+     * @param header The row anchoring the fold.
+     * @return The rows shown, 0 if no fold is anchored on the header.
+     */
+    size_t revealed(size_t header) const;
+
+    /**
+     * @brief Gets the first visual line of a row, i.e. the lines occupied by all rows before it.
+     */
+    size_t prefix(size_t row) const;
+
+    /**
+     * @brief Gets the total number of visual lines.
+     */
+    size_t total() const;
+
+    /**
+     * @brief Finds the row shown on a visual line, skipping rows occupying no lines.
+     *
+     * @param line The visual line, less than total().
+     * @return The row and the line's offset within that row.
+     */
+    std::pair<size_t, size_t> find(size_t line) const;
+};
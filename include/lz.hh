@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+/**
+ * @namespace Lz
+ * @brief A byte-oriented LZ77 codec in the style of LZ4, built for speed over ratio.
+ *
+ * A block is a run of sequences: a token byte whose high nibble is the number of literals and
+ * low nibble the match length minus 4 (15 in either continues in bytes that add up to 255
+ * each), the literals, then a 2-byte little-endian offset back into the output. The last
+ * sequence is literals only. Matches are found through a single-entry hash table of 4-byte
+ * prefixes, so compression does one probe per position and skips faster through data that
+ * does not compress.
+ */
+namespace Lz
+{
+    /**
+     * @brief Appends the compressed form of in to out.
+     */
+    void compress(std::string_view in, std::string &out);
+
+    /**
+     * @brief Appends the decompressed form of a block to out.
+     *
+     * @param in The compressed block.
+     * @param rawLen The size the block decompresses to.
+     * @return false if the block is malformed or does not decompress to rawLen bytes.
+     */
+    bool decompress(std::string_view in, size_t rawLen, std::string &out);
+};
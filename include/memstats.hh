@@ -0,0 +1,60 @@
+#pragma once
+
+#include <config.hh>
+#include <string>
+
+/**
+ * @namespace MemStats
+ * @brief Per-subsystem accounting of the memory held by the editor's data structures.
+ */
+namespace MemStats
+{
+    /**
+     * @struct Breakdown
+     * @brief Bytes attributed to each subsystem, counting heap capacity rather than size.
+     *
+     * Both the buffer on screen and the one waiting behind the grep results are counted.
+     *
+     * @param rawText Heap storage of Row::sRaw.
+     * @param render Heap storage of Row::sRender and the cached Row::image.
+     * @param highlight Storage of Row::textStates and Row::spans.
+     * @param layout Soft-wrap breaks of each row and the visual line index.
+     * @param search Row::matches, the search hits and the grep results.
+     * @param rows Row objects, their shared_ptr control blocks and the row vector itself.
+     * @param undo Undo history.
+     * @param crdt The shared sequence, the operation log kept for resuming and the journal not yet shared.
+     * @param network Connection and modification buffers.
+     */
+    struct Breakdown
+    {
+        size_t rawText = 0;
+        size_t render = 0;
+        size_t highlight = 0;
+        size_t layout = 0;
+        size_t search = 0;
+        size_t rows = 0;
+        size_t undo = 0;
+        size_t crdt = 0;
+        size_t network = 0;
+
+        size_t total() const;
+
+        /**
+         * @brief Formats the breakdown on a single line for the message bar.
+         */
+        std::string summary() const;
+    };
+
+    /**
+     * @brief Walks the editor state and attributes its memory to subsystems.
+     *
+     * @param cfg The configuration object holding editor state.
+     * @return The per-subsystem byte counts.
+     */
+    Breakdown collect(const Config &cfg);
+
+    /**
+     * @brief Formats a byte count with a binary unit suffix, e.g. "1.5M".
+     */
+    std::string formatBytes(size_t bytes);
+};
@@ -0,0 +1,132 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <string>
+
+/**
+ * @namespace Perf
+ * @brief Lightweight performance counters backing the status bar HUD.
+ *
+ * Nothing is measured while the HUD is disabled; probes only test a flag. Every entry point
+ * may be called from any thread, as rows are re-rendered and highlighted on pool threads.
+ */
+namespace Perf
+{
+    enum metric
+    {
+        // Accumulated over a frame and sampled once per frame
+        HIGHLIGHT = 0, ///< Milliseconds spent in Row::parseStates.
+        RENDER,        ///< Milliseconds spent capturing and composing rows.
+        INPUT,         ///< Milliseconds spent processing local keys.
+        BYTES,         ///< Bytes written to the terminal.
+        REHIGHLIGHT,   ///< Rows re-highlighted.
+        FRAME_METRICS,
+
+        // Sampled once per event
+        FRAME = FRAME_METRICS, ///< Milliseconds spent capturing, composing and presenting a frame.
+        NET_RECV,              ///< Milliseconds spent taking in what the network thread received.
+        NET_APPLY,             ///< Milliseconds spent applying a remote modification.
+        METRIC_COUNT,
+    };
+
+    /**
+     * @brief Per-frame metrics of one frame, indexed by metric.
+     */
+    using Sample = std::array<double, FRAME_METRICS>;
+
+    /**
+     * @class Window
+     * @brief Fixed-size rolling window of the most recent samples.
+     */
+    class Window
+    {
+    private:
+        static constexpr size_t CAPACITY = 128;
+        std::array<double, CAPACITY> samples{};
+        size_t head = 0;
+        size_t count = 0;
+
+    public:
+        void push(double v);
+
+        /**
+         * @brief The most recent sample, or 0 if none were recorded.
+         */
+        double last() const;
+
+        /**
+         * @brief The 99th percentile over the window, or 0 if none were recorded.
+         */
+        double p99() const;
+    };
+
+    /**
+     * @brief Whether the HUD is shown and probes are recording.
+     */
+    extern std::atomic<bool> enabled;
+
+    /**
+     * @brief Records a value for a metric, accumulating per-frame metrics until take.
+     */
+    void record(metric m, double v);
+
+    /**
+     * @brief Takes the per-frame metrics accumulated since the last call, for the frame being captured.
+     */
+    Sample take();
+
+    /**
+     * @brief Closes a presented frame, pushing its per-frame metrics and duration into their windows.
+     *
+     * @param frame The frame's per-frame metrics.
+     * @param ms Milliseconds spent capturing, composing and presenting the frame.
+     */
+    void endFrame(const Sample &frame, double ms);
+
+    /**
+     * @brief Gets a copy of the rolling window for a metric.
+     */
+    Window window(metric m);
+
+    /**
+     * @brief Toggles the HUD, clearing stale samples when turned on.
+     */
+    void toggle();
+
+    /**
+     * @class Timer
+     * @brief Scoped probe recording its lifetime in milliseconds against a metric.
+     */
+    class Timer
+    {
+    private:
+        using clock = std::chrono::steady_clock;
+        metric m;
+        bool on;
+        clock::time_point start;
+
+    public:
+        explicit Timer(metric m) : m(m), on(enabled)
+        {
+            if (on)
+                start = clock::now();
+        }
+
+        /**
+         * @brief Discards the measurement, for probes whose event turned out not to happen.
+         */
+        void cancel()
+        {
+            on = false;
+        }
+
+        ~Timer()
+        {
+            if (on)
+                record(m, std::chrono::duration<double, std::milli>(clock::now() - start).count());
+        }
+    };
+};
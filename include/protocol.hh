@@ -0,0 +1,156 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * @namespace Protocol
+ * @brief The wire format edits travel between collaborating editors in.
+ *
+ * A frame is a varint body length followed by the body: the protocol version byte, a varint
+ * count of operations, then the operations. Every integer is a LEB128 varint, so the format has
+ * no byte order and small values take one byte. Edits are operations on the shared sequence,
+ * see Crdt::Sequence, naming characters by Id. Within a frame, an id's clock is sent as the
+ * zigzag difference from the previous id's and its site only when it changes, and a run of
+ * typing or deleting is merged into one operation, so it costs a few bytes however long it is.
+ */
+namespace Protocol
+{
+    constexpr uint8_t WIRE_VERSION = 3;
+    constexpr size_t MAX_FRAME = 64 << 20; ///< Largest body accepted; anything larger is taken as corruption.
+
+    enum OpType : uint8_t
+    {
+        OP_INSERT = 1, ///< Text inserted after a character.
+        OP_DELETE,     ///< Characters deleted, by id, under an id of its own.
+    };
+
+    /**
+     * @struct Id
+     * @brief Names a character for good: the Lamport clock of its insertion and the site that
+     * inserted it. Ids order by clock, then site.
+     */
+    struct Id
+    {
+        uint64_t clock = 0;
+        uint32_t site = 0;
+
+        auto operator<=>(const Id &) const = default;
+    };
+
+    /**
+     * @struct Span
+     * @brief The characters one site inserted with consecutive clocks, from id on.
+     */
+    struct Span
+    {
+        Id id;
+        uint64_t len = 0;
+    };
+
+    /**
+     * @struct Op
+     * @brief An operation sent between peers.
+     *
+     * @param type What the operation does; the fields it does not use are left empty.
+     * @param id The id of the first character inserted, the rest following with consecutive clocks;
+ * for a delete, its stamp, so versions count it.
+     * @param after The character the text was inserted after, a zero id for the start.
+     * @param text The text inserted.
+     * @param spans The characters deleted.
+     * @param origin The peer the operation arrived from, 0 for this editor; kept locally, not sent.
+     */
+    struct Op
+    {
+        OpType type = OP_INSERT;
+        Id id;
+        Id after;
+        std::string text;
+        std::vector<Span> spans;
+        uint32_t origin = 0;
+    };
+
+    /**
+     * @brief Appends an unsigned LEB128 varint.
+     */
+    void putVarint(std::string &out, uint64_t v);
+
+    /**
+     * @brief Reads an unsigned LEB128 varint from the front of in, consuming it.
+     *
+     * @return false if in ends first or the varint is longer than 64 bits.
+     */
+    bool getVarint(std::string_view &in, uint64_t &v);
+
+    /**
+     * @class Writer
+     * @brief Batches operations into one frame.
+     */
+    class Writer
+    {
+    private:
+        std::string body;
+        size_t count = 0;
+        Id last; ///< The id encoded last, which the next is sent relative to.
+        Op open; ///< The operation runs are merged into, encoded once the next does not extend it.
+        bool hasOpen = false;
+
+        void putId(const Id &id);
+        void encode(const Op &op);
+
+    public:
+        /**
+         * @brief Adds an operation to the batch, merging it into the previous one when it
+         * continues the same run of typing or deleting.
+         */
+        void add(const Op &op);
+
+        /**
+         * @brief Gets the number of operations batched, after merging.
+         */
+        size_t size() const;
+
+        /**
+         * @brief Gets the encoded size of the batch in bytes.
+         */
+        size_t bytes() const;
+
+        /**
+         * @brief Appends the batch to out as a frame and starts a new batch.
+         */
+        void finish(std::string &out);
+    };
+
+    /**
+     * @class Reader
+     * @brief Reassembles frames from a byte stream arriving in pieces of any size.
+     */
+    class Reader
+    {
+    private:
+        std::string buf;
+        size_t head = 0; ///< Start of the first byte not yet decoded.
+        std::string err;
+
+    public:
+        /**
+         * @brief Appends bytes received from the stream.
+         */
+        void feed(const char *data, size_t n);
+
+        /**
+         * @brief Decodes every complete frame received so far, appending their operations to out.
+         *
+         * @return false once the stream is corrupt or speaks another version; error() says why.
+         */
+        bool decode(std::vector<Op> &out);
+
+        /**
+         * @brief Gets why the stream was rejected, empty if it was not.
+         */
+        const std::string &error() const;
+    };
+};
@@ -0,0 +1,132 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/**
+ * @class Regex
+ * @brief A regular expression compiled once and matched in linear time.
+ *
+ * The pattern compiles to a Thompson NFA. A lazily built DFA scans each row for the end of the
+ * first match, so rows without one cost a table lookup per byte; in rows with a match, a Pike VM
+ * extracts the leftmost-longest span. To find every match in a row, one backward pass over the
+ * NFA works out the longest match from each position, and matches are then taken one after
+ * another. Nothing backtracks, so time stays linear in the row length whatever the pattern.
+ *
+ * Supports literals, `.`, classes (`[a-z]`, `[^...]`), `\d \w \s` and their negations, `^ $`,
+ * groups, `|` and the quantifiers `* + ? {m} {m,} {m,n}`. Empty matches are never reported.
+ */
+class Regex
+{
+private:
+    struct Program; ///< The compiled pattern, shared by copies of a Regex.
+
+    /**
+     * @brief A DFA state: the NFA instructions reached after consuming at least one byte.
+     */
+    struct DState
+    {
+        std::vector<int> pcs;
+        bool bol;      ///< At the start of the row, where ^ holds.
+        bool anchored; ///< Follows matches from one start only, instead of starting one at every byte.
+        bool match;    ///< A match ends here.
+        bool eolMatch; ///< A match ends here if the row does.
+    };
+
+    std::shared_ptr<const Program> prog;
+    std::string err;
+
+    // Lazy DFA cache, private to each copy
+    std::vector<DState> states;
+    std::unordered_map<std::string, int> stateIds;
+    std::vector<int> trans; ///< states x eqCount: next state's row offset << 2 | dead << 1 | match, -1 until computed.
+
+    // Scratch of the backward pass, kept between rows
+    std::vector<long> here, ahead;
+    std::vector<long> longest;
+
+    /**
+     * @brief Adds an instruction and everything reachable from it without consuming a byte.
+     */
+    void closure(std::vector<int> &out, std::vector<uint8_t> &seen, int pc, bool bol, bool eol) const;
+
+    /**
+     * @brief Interns a DFA state, flushing the cache when it grows too large.
+     */
+    int intern(std::vector<int> pcs, bool bol, bool anchored);
+
+    /**
+     * @brief Computes the transition of a state on a byte.
+     *
+     * @return The transition, encoded as in trans.
+     */
+    int step(int state, unsigned char c);
+
+    /**
+     * @brief Scans starts [from, ...) with the DFA for the end of the earliest match.
+     *
+     * @return The end, or std::string::npos when the row has no match.
+     */
+    size_t firstEnd(std::string_view hay, size_t from);
+
+    /**
+     * @brief Runs the Pike VM from a position until the leftmost match start is known.
+     */
+    size_t pike(std::string_view hay, size_t from) const;
+
+    /**
+     * @brief Scans with an anchored DFA for the end of the longest match from a start.
+     */
+    size_t longestEnd(std::string_view hay, size_t start);
+
+    /**
+     * @brief Works out the end of the longest match from every position in one backward pass.
+     *
+     * Sets longest[i] to the end of the longest match starting at i, or -1 when none does.
+     */
+    void longestEnds(std::string_view hay);
+
+public:
+    /**
+     * @brief Compiles a pattern.
+     *
+     * @param pattern The expression; on a syntax error the Regex never matches and error() says why.
+     * @param ignoreCase Whether ASCII letters match regardless of case.
+     */
+    Regex(std::string_view pattern, bool ignoreCase);
+
+    /**
+     * @brief Smart case: a pattern without uppercase letters, escapes aside, ignores case.
+     */
+    static bool smartCase(std::string_view pattern);
+
+    /**
+     * @brief Gets why the pattern failed to compile, empty if it did.
+     */
+    const std::string &error() const;
+
+    /**
+     * @brief Finds the leftmost-longest non-empty match starting at or after a position.
+     *
+     * @param hay The text to search, one row.
+     * @param from The first position a match may start at.
+     * @param len Set to the length of the match.
+     * @return The position of the match, or std::string::npos.
+     */
+    size_t find(std::string_view hay, size_t from, size_t &len);
+
+    /**
+     * @brief Finds every match in a row: the leftmost-longest, then the leftmost-longest from
+     * where it ends, and so on, so no two overlap.
+     *
+     * @param hay The text to search, one row.
+     * @param out Set to the position and length of each match, in order.
+     */
+    void findAll(std::string_view hay, std::vector<std::pair<size_t, size_t>> &out);
+};
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+/**
+ * @class Ring
+ * @brief A bounded queue between one producer thread and one consumer thread, without locks.
+ *
+ * Each side owns one index and only reads the other's, so a push or pop costs a pair of atomic
+ * loads and a store. The indices sit on cache lines of their own, and each side keeps a copy
+ * of the other's last seen index, so the line only moves between cores when the copy runs out.
+ * A full ring refuses the push rather than waiting; the producer keeps what did not fit.
+ */
+template <typename T>
+class Ring
+{
+private:
+    static constexpr size_t LINE = 64;
+
+    const size_t mask;
+    std::unique_ptr<T[]> slots;
+
+    alignas(LINE) std::atomic<size_t> head{0}; ///< Next slot to pop; written by the consumer.
+    size_t tailSeen = 0;                       ///< The consumer's copy of tail.
+    alignas(LINE) std::atomic<size_t> tail{0}; ///< Next slot to push; written by the producer.
+    size_t headSeen = 0;                       ///< The producer's copy of head.
+
+public:
+    /**
+     * @param capacity Slots in the ring, rounded up to a power of two.
+     */
+    explicit Ring(size_t capacity) : mask(std::bit_ceil(capacity) - 1), slots(new T[mask + 1]) {}
+
+    Ring(const Ring &) = delete;
+    Ring &operator=(const Ring &) = delete;
+
+    /**
+     * @brief Moves an item in; called by the producer only.
+     *
+     * @return false, leaving item as it was, if the ring is full.
+     */
+    bool push(T &item)
+    {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (t - headSeen > mask)
+        {
+            headSeen = head.load(std::memory_order_acquire);
+            if (t - headSeen > mask)
+                return false;
+        }
+        slots[t & mask] = std::move(item);
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief Moves the oldest item out; called by the consumer only.
+     *
+     * @return false if the ring is empty.
+     */
+    bool pop(T &item)
+    {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h == tailSeen)
+        {
+            tailSeen = tail.load(std::memory_order_acquire);
+            if (h == tailSeen)
+                return false;
+        }
+        item = std::move(slots[h & mask]);
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief Checks whether there is nothing to pop; called by the consumer only.
+     */
+    bool empty() const
+    {
+        return head.load(std::memory_order_relaxed) == tail.load(std::memory_order_acquire);
+    }
+
+    /**
+     * @brief Gets the number of slots.
+     */
+    size_t capacity() const
+    {
+        return mask + 1;
+    }
+};
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <config.hh>
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * @namespace Snapshot
+ * @brief Transfers the document to a peer joining a session.
+ *
+ * A peer joins by sending a hello: the magic "TTHI", a version byte, then two versions of the
+ * shared sequence, see Crdt::Version, as a varint count of sites and a site and clock for each:
+ * what it holds, and the floor of its log. A peer with no session to resume sends both empty.
+ * When the host's log reaches back to what the peer holds, and the peer's log back to what the
+ * host holds, the host resumes the session: it sends the magic "TTRS", a version byte and its
+ * version, then what the peer missed as frames, and the peer sends back what the host missed.
+ * Otherwise the host sends a snapshot of the whole document.
+ *
+ * The stream starts with the magic "TTSN", a version byte, the file path and the number of
+ * chunks, then the chunks. Each chunk holds whole rows, about CHUNK bytes of them joined by
+ * newlines, with a header of varints: its size, its stored size shifted left once with the low bit
+ * set when it is Lz-compressed, and an 8-byte checksum of the rows. Chunks are compressed and
+ * decompressed in parallel on the shared pool. The stream ends with the layout of the shared
+ * sequence, its ids and tombstones, as a varint length and Crdt::Sequence::encode's output.
+ */
+namespace Snapshot
+{
+    constexpr uint8_t FORMAT_VERSION = 3;
+    constexpr size_t CHUNK = 1 << 20;
+
+    /**
+     * @brief Appends a joining peer's hello to out.
+     *
+     * @param have The version the peer holds.
+     * @param floor The floor of the peer's log.
+     */
+    void hello(const Crdt::Version &have, const Crdt::Version &floor, std::string &out);
+
+    /**
+     * @brief Reads a hello from the front of in, consuming it.
+     *
+     * @return 1 once it is read, 0 if in ends first, -1 if in holds no hello; err says why.
+     */
+    int readHello(std::string_view &in, Crdt::Version &have, Crdt::Version &floor, std::string &err);
+
+    /**
+     * @brief Appends the header of a resumed session to out, to be followed by the frames the peer missed.
+     *
+     * @param have The version the host holds.
+     */
+    void resume(const Crdt::Version &have, std::string &out);
+
+    /**
+     * @brief Appends the snapshot of a document and its shared sequence to out, to be sent without blocking.
+     */
+    void encode(const TTEdFileData &fData, const Crdt::Sequence &doc, std::string &out);
+
+    /**
+     * @struct Transfer
+     * @brief A snapshot as read off the socket, its chunks not yet decompressed or checked.
+     */
+    struct Transfer
+    {
+        struct Chunk
+        {
+            uint64_t rawLen;
+            bool compressed;
+            uint64_t sum;
+            std::string stored;
+        };
+
+        std::string path;
+        std::vector<Chunk> chunks;
+        std::string layout;
+    };
+
+    /**
+     * @brief Reads a snapshot, or the header of a resumed session, off a socket, blocking until
+     * all of it has arrived. Touches no editor state, so it may run on any thread.
+     *
+     * @param fd The socket to the peer.
+     * @param out Set to the snapshot read.
+     * @param live Handed the bytes the peer sent after the snapshot.
+     * @param resumed Set to the host's version if it resumed the session, leaving out empty; emptied otherwise.
+     * @param err Set to why the transfer failed.
+     * @return false if the transfer failed.
+     */
+    bool read(int fd, Transfer &out, Protocol::Reader &live, Crdt::Version &resumed, std::string &err);
+
+    /**
+     * @brief Loads a snapshot read into the editor, decompressing and checking its chunks in parallel.
+     *
+     * Rows are highlighted for the file type of the path received.
+     *
+     * @param in The snapshot, its chunks consumed.
+     * @param cfg The configuration object whose file data and shared sequence are replaced.
+     * @param err Set to why loading failed, leaving cfg as it was.
+     * @return false if a chunk was corrupt or the layout does not match the text.
+     */
+    bool load(Transfer &in, Config &cfg, std::string &err);
+
+    /**
+     * @brief Reads a snapshot and loads it, or reads the header of a resumed session.
+     *
+     * @return false if either step failed.
+     */
+    bool receive(int fd, Config &cfg, Protocol::Reader &live, Crdt::Version &resumed, std::string &err);
+};
@@ -23,4 +23,26 @@ namespace TermActions
      * @brief Shows the cursor.
      */
     void showCursor(std::stringstream &buf);
+
+    /**
+     * @brief Scrolls a band of screen lines, leaving the lines outside it in place.
+     *
+     * Sets the scroll region (DECSTBM) and feeds index or reverse index at its edge, then
+     * restores the full-screen region, which also homes the cursor.
+     *
+     * @param top First line of the band, 1-based.
+     * @param bottom Last line of the band, 1-based.
+     * @param lines Lines to scroll the content up by; negative scrolls it down.
+     */
+    void scrollRegion(std::stringstream &buf, size_t top, size_t bottom, long lines);
+
+    /**
+     * @brief Starts a synchronized update (DEC mode 2026): the terminal holds output until endSync.
+     */
+    void beginSync(std::stringstream &buf);
+
+    /**
+     * @brief Ends a synchronized update, letting the terminal paint the frame at once.
+     */
+    void endSync(std::stringstream &buf);
 };
\ No newline at end of file
@@ -2,8 +2,25 @@
 
 #include <string>
 #include <config.hh>
+#include <perf.hh>
 #include <sstream>
 #include <map>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+
+/**
+ * @brief Time between two frames reaching the terminal during a burst of draws, about one 60 Hz refresh.
+ */
+#define FRAME_INTERVAL std::chrono::microseconds(16667)
+
+/**
+ * @brief Gap without a new draw after which a frame is presented at once, ending a burst early.
+ */
+#define FRAME_QUIET std::chrono::microseconds(250)
 
 /**
  * @class TerminalGUI
@@ -13,45 +30,195 @@ class TerminalGUI
 {
 private:
     /**
-     * @brief Buffer for accumulating terminal commands.
+     * @struct Line
+     * @brief What one text line of a frame shows, captured from the editor for the render thread.
+     *
+     * @param image Columns of the row shown, or null past the end of the file.
+     * @param begin First column of image->text shown on this line.
+     * @param end One past the last column of image->text shown.
+     * @param first Whether the line starts its row and so carries the row marker.
+     * @param foldLen Rows unfolding the fold ending on this line would show, 0 for none.
+     */
+    struct Line
+    {
+        std::shared_ptr<const RowImage> image;
+        size_t begin = 0;
+        size_t end = 0;
+        bool first = true;
+        size_t foldLen = 0;
+    };
+
+    /**
+     * @struct Frame
+     * @brief An immutable snapshot of the viewport: everything compose() and present() need,
+     * detached from the editor state.
+     *
+     * @param rows The text lines of the viewport.
+     * @param leftStatus Left side of the status bar, filename or the HUD.
+     * @param rightStatus Right side of the status bar, connection, filetype, position and M flag.
+     * @param message Status message, empty once expired.
+     * @param info Right side of the message bar, search position and HUD counters.
+     * @param textCols Width of the text area right of the gutter.
+     * @param lines The composed text lines, then the status and message bars.
+     * @param top Top row, or top visual line when indexed.
+     * @param indexed Whether top counts visual lines (soft wrap or folds).
+     * @param cols Terminal width the lines were composed for.
+     * @param sx Cursor column on screen, left of the gutter.
+     * @param sy Cursor row on screen.
+     * @param sync Whether to wrap the output in a synchronized update.
+     * @param timed Whether the HUD was on when the frame was captured.
+     * @param perf Per-frame metrics taken when the frame was captured, merged from frames it replaced.
+     * @param captureMs Milliseconds the main thread spent capturing the frame.
+     */
+    struct Frame
+    {
+        std::vector<Line> rows;
+        std::string leftStatus;
+        std::string rightStatus;
+        std::string message;
+        std::string info;
+        size_t textCols = 0;
+        std::vector<std::string> lines;
+        size_t top = 0;
+        bool indexed = false;
+        size_t cols = 0;
+        size_t sx = 0;
+        size_t sy = 0;
+        bool sync = false;
+        bool timed = false;
+        Perf::Sample perf{};
+        double captureMs = 0;
+    };
+
+    /**
+     * @brief Buffer for accumulating terminal commands, owned by the render thread while it runs.
      */
     std::stringstream buf;
 
+    /**
+     * @brief Lines as last sent to the terminal; empty until the first full repaint.
+     */
+    std::vector<std::string> screen;
+
+    /**
+     * @brief Width, top row (or visual line) and cursor position of the screen lines.
+     */
+    size_t screenCols = 0;
+    size_t screenTop = 0;
+    bool screenIndexed = false;
+    size_t screenSx = 0;
+    size_t screenSy = 0;
+
+    /**
+     * @brief Render thread state: the latest captured frame not yet presented replaces any
+     * older one, so a burst of draws is composed and reaches the terminal about once per FRAME_INTERVAL.
+     * A presented frame is kept as the spare, so its buffers are reused by the next draw.
+     */
+    std::thread renderThread;
+    std::mutex renderMutex;
+    std::condition_variable renderCv;
+    std::unique_ptr<Frame> pending;
+    std::unique_ptr<Frame> spare;
+    size_t pendingSeq = 0;
+    bool stopping = false;
+    std::atomic<size_t> bytesOut = 0;
+    std::atomic<size_t> framesPresented = 0;
+
     /**
      * @brief Reference to the configuration object holding editor state.
      */
     Config &config;
 
+    /**
+     * @brief Body of the render thread: composes and presents a pending frame once draws pause
+     * for FRAME_QUIET, or at the latest FRAME_INTERVAL after the previous frame.
+     */
+    void renderLoop();
+
     /**
      * @brief Flushes the accumulated terminal commands from the buffer to the terminal.
      */
     void flushBuf();
 
     /**
-     * @brief Draws the rows of text on the screen.
+     * @brief Captures the rows of text on the screen into a frame.
      *
      * @param cursor The cursor object containing the current cursor position.
      * @param fData The file data containing the text to be displayed.
      * @param tData The terminal data containing display parameters.
+     * @param search The search state whose matches are highlighted.
+     * @param f The frame to fill the rows of.
      */
-    void drawRows(const TTEdCursor &cursor, const TTEdFileData &fData, const TTEdTermData &tData);
+    void captureRows(const TTEdCursor &cursor, const TTEdFileData &fData, const TTEdTermData &tData, const TTEdSearch &search, Frame &f);
 
     /**
-     * @brief Draws the status bar at the bottom of the screen.
+     * @brief Captures rows through the visual line index, skipping folded rows and, under soft wrap,
+     * splitting rows into continuation lines without the row marker.
      *
-     * @param cursor The cursor object containing the current cursor position.
-     * @param fData The file data containing the text to be displayed.
+     * @param cursor The cursor object containing the current visual line offset.
+     * @param fData The file data, with its line index synced by Config::scroll.
      * @param tData The terminal data containing display parameters.
+     * @param search The search state whose matches are highlighted.
+     * @param f The frame to fill the rows of.
      */
-    void drawStatusBar(const Config &cfg);
+    void captureIndexedRows(const TTEdCursor &cursor, const TTEdFileData &fData, const TTEdTermData &tData, const TTEdSearch &search, Frame &f);
 
     /**
-     * @brief Draws the message bar at the bottom of the screen.
+     * @brief Captures the text of the status and message bars into a frame.
      *
-     * @param tData The terminal data containing display parameters.
-     * @param status The status object containing the message to be displayed.
+     * @param cfg The editor state.
+     * @param f The frame to fill the bar text of.
      */
-    void drawMessageBar(const TTEdTermData &tData, const TTEdStatus &status);
+    void captureBars(const Config &cfg, Frame &f);
+
+    /**
+     * @brief Finds the search matches of a row about to be drawn, unless already found for this query.
+     *
+     * Complete hit sets are looked up by binary search; otherwise the row is scanned. Matches
+     * are kept apart from textStates and only drop the row's image when they change,
+     * so a frame costs the same however many hits the file has.
+     *
+     * @param row The row to update Row::matches of.
+     * @param rowLoc Index of the row in the file.
+     * @param search The search state.
+     */
+    void overlayMatches(Row &row, size_t rowLoc, const TTEdSearch &search);
+
+    /**
+     * @brief Turns a captured frame into terminal lines: encodes the row images and lays out the bars.
+     *
+     * @param f The frame whose lines are filled.
+     */
+    void compose(Frame &f);
+
+    /**
+     * @brief Sends a composed frame, scrolling the text area when the viewport moved and
+     * rewriting only the lines that differ from the screen.
+     *
+     * @param f The frame; its lines are swapped into the screen model.
+     * @return Whether anything was written to the terminal.
+     */
+    bool present(Frame &f);
+
+    /**
+     * @brief Composes and presents a frame on the calling thread, then closes it in the HUD
+     * windows if it reached the terminal; idle frames record nothing.
+     *
+     * @param f The frame.
+     * @return Whether anything was written to the terminal.
+     */
+    bool show(Frame &f);
+
+    /**
+     * @brief Appends the terminal bytes (text plus SGR color changes) for columns [begin, end) of a
+     * row image, with its matches drawn over its syntax colors.
+     *
+     * @param image The row image to encode.
+     * @param begin First column of image.text.
+     * @param end One past the last column of image.text.
+     * @param out The string to append to.
+     */
+    void encodeWindow(const RowImage &image, size_t begin, size_t end, std::string &out);
 
     /**
      * @brief Centers the given text within the current screen width.
@@ -70,6 +237,20 @@ private:
      */
     static void genCoverPage(const Config &config, std::stringstream &s);
 
+    /**
+     * @brief Formats the timing half of the performance HUD shown in the status bar.
+     *
+     * @return Last and p99 frame time, plus highlight, render and input time of the last frame.
+     */
+    static std::string hudTimings();
+
+    /**
+     * @brief Formats the I/O half of the performance HUD shown in the message bar.
+     *
+     * @return Bytes written and rows re-highlighted last frame, plus p99 network latencies.
+     */
+    static std::string hudCounters();
+
 public:
     std::map<textState, int> stateToColor = {
         {TS_NORMAL, 37},
@@ -88,19 +269,40 @@ public:
      */
     TerminalGUI(Config &cfg);
 
+    /**
+     * @brief Stops the render thread, if running, after it presents its last frame.
+     */
+    ~TerminalGUI();
 
     /**
-     * @brief Updates the cursor position on the screen.
+     * @brief Draws the entire terminal interface including text, status bar, and message bar.
      *
-     * @param cursor The cursor object containing the current cursor position.
+     * Only a snapshot of the viewport is taken on the calling thread: the images of the visible
+     * rows, the bar text and the cursor. With the render thread running the snapshot is handed
+     * over and this returns at once; otherwise it is composed and presented before returning.
+     */
+    void draw();
+
+    /**
+     * @brief Starts presenting frames on a render thread, coalescing draws to the refresh cadence.
      */
-    void updateCursor(const TTEdCursor &cursor);
+    void startRenderThread();
 
+    /**
+     * @brief Presents any pending frame and stops the render thread, so the caller may write
+     * to the terminal directly again.
+     */
+    void stopRenderThread();
 
     /**
-     * @brief Draws the entire terminal interface including text, status bar, and message bar.
+     * @brief Gets the number of frames that reached the terminal.
      */
-    void draw();
+    size_t presentedFrames() const;
+
+    /**
+     * @brief Forgets what the screen shows, so the next draw repaints it in full.
+     */
+    void invalidate();
 
     /**
      * @brief Displays the splash screen and waits for user input.
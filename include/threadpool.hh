@@ -0,0 +1,67 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @class ThreadPool
+ * @brief Fixed set of worker threads running batches of indexed tasks.
+ *
+ * One batch runs at a time. The calling thread works on it too, and tasks are handed out one
+ * index at a time, so uneven tasks balance across threads.
+ */
+class ThreadPool
+{
+private:
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    std::mutex batchMutex; ///< Serializes run() callers.
+
+    const std::function<void(size_t)> *task = nullptr;
+    size_t tasks = 0;
+    size_t next = 0;      ///< Next task index to hand out.
+    size_t finished = 0;  ///< Tasks completed in the current batch.
+    size_t batch = 0;     ///< Batch number, so workers can tell a new batch from a spurious wakeup.
+    bool stopping = false;
+
+    void work();
+
+    /**
+     * @brief Runs tasks of the current batch until none are left; called with the lock held.
+     */
+    void drain(std::unique_lock<std::mutex> &lock);
+
+public:
+    /**
+     * @brief Starts the workers.
+     *
+     * @param threads Threads to run tasks on, counting the caller of run(); at least 1.
+     */
+    explicit ThreadPool(size_t threads);
+
+    /**
+     * @brief Stops and joins the workers.
+     */
+    ~ThreadPool();
+
+    /**
+     * @brief Gets the number of threads tasks run on, counting the caller of run().
+     */
+    size_t size() const;
+
+    /**
+     * @brief Runs fn(0) .. fn(count - 1) across the pool and waits for all of them.
+     */
+    void run(size_t count, const std::function<void(size_t)> &fn);
+
+    /**
+     * @brief Gets the pool shared by the editor, one thread per hardware thread.
+     */
+    static ThreadPool &shared();
+};
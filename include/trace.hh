@@ -0,0 +1,89 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+
+/**
+ * @brief Records the enclosing scope as a trace event named by a string literal.
+ *
+ * Expands to nothing unless built with TTED_TRACE (make TRACE=1, the default).
+ */
+#ifdef TTED_TRACE
+#define TRACE_SCOPE(name) Trace::Scope TRACE_CONCAT(traceScope, __LINE__)(name)
+#else
+#define TRACE_SCOPE(name) ((void)0)
+#endif
+
+/**
+ * @namespace Trace
+ * @brief Scoped probes emitting Chrome/Perfetto trace-event JSON.
+ *
+ * Each thread records into its own fixed-size ring buffer, so probes never take a lock;
+ * once full, the oldest events are overwritten.
+ */
+namespace Trace
+{
+    /**
+     * @brief Whether probes are currently recording.
+     */
+    extern std::atomic<bool> active;
+
+    /**
+     * @brief Starts recording, to be written to the given path by stop().
+     *
+     * @param path The file the trace-event JSON is written to.
+     */
+    void start(const std::string &path);
+
+    /**
+     * @brief Stops recording and writes every buffered event to the path given to start().
+     */
+    void stop();
+
+    /**
+     * @brief Records a complete event into the calling thread's ring buffer.
+     *
+     * @param name Static event name.
+     * @param startUs Start timestamp in microseconds.
+     * @param durUs Duration in microseconds.
+     */
+    void emit(const char *name, uint64_t startUs, uint64_t durUs);
+
+    /**
+     * @brief Current timestamp in microseconds on the trace clock.
+     */
+    inline uint64_t now()
+    {
+        using namespace std::chrono;
+        return duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+    }
+
+    /**
+     * @class Scope
+     * @brief Emits an event spanning its own lifetime while tracing is active.
+     */
+    class Scope
+    {
+    private:
+        const char *name;
+        uint64_t start = 0;
+
+    public:
+        explicit Scope(const char *name) : name(name)
+        {
+            if (active.load(std::memory_order_relaxed))
+                start = now();
+        }
+
+        ~Scope()
+        {
+            if (start)
+                emit(name, start, now() - start);
+        }
+    };
+};
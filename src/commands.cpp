@@ -8,73 +8,261 @@
 #include <unistd.h>
 #include <fstream>
 #include <fileio.hh>
+#include <trace.hh>
+#include <memstats.hh>
+#include <finder.hh>
+#include <regex.hh>
+#include <threadpool.hh>
+#include <grep.hh>
+#include <algorithm>
+
+// Collects every match in file order across the thread pool, counting past the cap
+template <typename Matcher>
+static void collectHits(Config &cfg, const Matcher &matcher)
+{
+    TRACE_SCOPE("collectHits");
+    TTEdSearch &search = cfg.search;
+    const auto &rows = cfg.fileData.fileData;
+
+    // Split the rows into more chunks than threads so long rows even out; each chunk keeps its own hits
+    ThreadPool &pool = ThreadPool::shared();
+    size_t chunks = std::clamp<size_t>(rows.size() / 1024, 1, pool.size() * 8);
+    size_t per = (rows.size() + chunks - 1) / chunks;
+    std::vector<std::vector<SearchHit>> found(chunks);
+    std::vector<size_t> counts(chunks, 0);
+
+    pool.run(chunks, [&](size_t c) {
+        // A Regex fills in its DFA as it scans, so every chunk works on its own copy
+        Matcher m = matcher;
+        auto &hits = found[c];
+        size_t count = 0;
+        std::vector<std::pair<size_t, size_t>> spans;
+        for (size_t r = c * per, end = std::min(rows.size(), r + per); r < end; r++)
+        {
+            m.findAll(rows[r]->sRaw, spans);
+            for (auto [col, len] : spans)
+            {
+                if (count++ < search.cap)
+                    hits.push_back({r, col, len});
+            }
+        }
+        counts[c] = count;
+    });
+
+    // Chunks are in file order, so joining them keeps the hits sorted
+    search.total = 0;
+    for (size_t n : counts)
+        search.total += n;
+    search.complete = search.total <= search.cap;
+    search.hits.clear();
+    if (search.complete)
+    {
+        search.hits.reserve(search.total);
+        for (const auto &hits : found)
+            search.hits.insert(search.hits.end(), hits.begin(), hits.end());
+    }
+}
 
-void Commands::Search::callback(Config &cfg, std::string_view s, int c)
+// Keeps the hits of the previous, shorter query where the longer one still matches
+static void narrowHits(Config &cfg, const Finder &finder)
 {
-    // Track the index of the previous match and the direction of movement
-    static int matchPrev = -1;
-    static int matchDir = 1;
+    const auto &rows = cfg.fileData.fileData;
+    auto &hits = cfg.search.hits;
+    hits.erase(std::remove_if(hits.begin(), hits.end(), [&](const SearchHit &h) {
+                   return !finder.matchesAt(rows[h.row]->sRaw, h.col);
+               }),
+               hits.end());
+    for (SearchHit &h : hits)
+        h.len = finder.size();
+}
+
+// Finds the match after (dir 1) or before (dir -1) a position by scanning rows, wrapping around
+template <typename Matcher>
+static bool scanHits(Config &cfg, Matcher &matcher, SearchHit from, int dir, SearchHit &out)
+{
+    // Rows are searched whole, so the matches stepped through are the ones counted and highlighted
+    const auto &rows = cfg.fileData.fileData;
+    std::vector<std::pair<size_t, size_t>> spans;
+    for (size_t i = 0; i <= rows.size(); i++)
+    {
+        size_t r = (from.row + rows.size() + dir * (long)i) % rows.size();
+        matcher.findAll(rows[r]->sRaw, spans);
+
+        if (dir > 0)
+        {
+            // The first match starting after the limit
+            for (auto [col, len] : spans)
+            {
+                if (i > 0 || col > from.col)
+                {
+                    out = {r, col, len};
+                    return true;
+                }
+            }
+        }
+        else
+        {
+            // The last match starting before the limit
+            for (auto it = spans.rbegin(); it != spans.rend(); ++it)
+            {
+                if (i > 0 || it->first < from.col)
+                {
+                    out = {r, it->first, it->second};
+                    return true;
+                }
+            }
+        }
+    }
+    return false;
+}
+
+// Brings the hits up to date with the query, then moves to the match dir steps away
+template <typename Matcher>
+static void searchWith(Config &cfg, Matcher &matcher, std::string_view s, bool ignoreCase, int dir)
+{
+    TTEdSearch &search = cfg.search;
+    if (s != search.query || search.edits != cfg.fileData.edits)
+    {
+        if constexpr (std::is_same_v<Matcher, Finder>)
+        {
+            // A longer query only has to be checked where the shorter one matched
+            bool extends = search.complete && search.edits == cfg.fileData.edits &&
+                           s.size() > search.query.size() && s.substr(0, search.query.size()) == search.query &&
+                           (search.ignoreCase || !ignoreCase);
+            if (extends)
+            {
+                narrowHits(cfg, matcher);
+                search.total = search.hits.size();
+            }
+            else if (s.size() > 1)
+                collectHits(cfg, matcher);
+            else
+            {
+                // A single byte matches nearly everywhere; step through it by scanning instead
+                search.hits.clear();
+                search.complete = false;
+                search.total = 0;
+            }
+        }
+        else
+        {
+            // A longer pattern may match more, so every change is collected afresh
+            collectHits(cfg, matcher);
+        }
 
-    static int matchLineIdx = -1;
-    static std::array<textState, UCHAR_MAX> matchLine;
-    if (matchLineIdx != -1) {
-        auto row = cfg.fileData.at(matchLineIdx);
-        std::copy(matchLine.begin(), matchLine.end(), row->textStates.begin());
-        matchLineIdx = -1;
+        search.query = s;
+        search.ignoreCase = ignoreCase;
+        search.edits = cfg.fileData.edits;
+        search.current = -1;
+        search.generation++;
+        dir = 0;
     }
 
+    // Step through the collected hits, or scan from the current match past the cap
+    SearchHit hit;
+    if (search.complete)
+    {
+        long n = search.hits.size();
+        if (n == 0)
+            return;
+        if (search.current < 0)
+        {
+            // A new query starts from where the search did; stepping back goes to the match before it
+            search.current = search.locate(search.origin);
+            if (dir < 0)
+                search.current = (search.current + n - 1) % n;
+        }
+        else
+            search.current = (search.current + dir + n) % n;
+        hit = search.hits[search.current];
+    }
+    else
+    {
+        // Scan from just before the origin, so a match right at it is found
+        SearchHit from = search.match;
+        if (search.current < 0)
+        {
+            const SearchHit &o = search.origin;
+            from = o.col > 0 ? SearchHit{o.row, o.col - 1}
+                             : SearchHit{(o.row + cfg.fileData.size() - 1) % cfg.fileData.size(), std::string::npos - 1};
+        }
+        if (!scanHits(cfg, matcher, from, dir < 0 ? -1 : 1, hit))
+            return;
+        search.current = 0;
+    }
+    search.match = hit;
+}
+
+void Commands::Search::callback(Config &cfg, std::string_view s, int c)
+{
+    TRACE_SCOPE("Commands::Search::callback");
+    TTEdSearch &search = cfg.search;
+
     // Handle input commands
+    int dir = 0; // 0: stay on the current match, or go to the first one from the origin
     if (c == '\r' || c == '\x1b')
-    {                   // Enter or Escape key
-        matchPrev = -1; // Reset match state
-        matchDir = 1;   // Default direction
+    { // Enter or Escape key
+        search.reset();
+        search.active = false;
         return;
     }
+    else if (c == K_CTRL('r'))
+    { // Toggle regex mode, collecting the query again
+        search.regex = !search.regex;
+        search.reset();
+    }
     else if (c == ARROW_RIGHT || c == ARROW_DOWN)
     {
-        matchDir = 1; // Move forward
+        dir = 1; // Move forward
     }
     else if (c == ARROW_LEFT || c == ARROW_UP)
     {
-        matchDir = -1; // Move backward
-    }
-    else
-    {
-        matchPrev = -1; // Reset on other key presses
-        matchDir = 1;
+        dir = -1; // Move backward
     }
 
-    // Start search from the current match or the beginning
-    if (matchPrev == -1)
-        matchDir = 1;
-    int current = matchPrev;
+    if (cfg.fileData.size() == 0)
+        return;
 
-    // Search through the file data
-    for (size_t i = 0; i < cfg.fileData.size(); i++)
+    // Smart case: an all-lowercase query ignores case
+    if (search.regex)
     {
-        current += matchDir;
-        if (current < 0)
-            current = cfg.fileData.size() - 1;
-        else if (current >= (int)cfg.fileData.size())
-            current = 0;
-
-        std::shared_ptr<Row> row = cfg.fileData.at(current);
-
-        size_t match = row->sRender.find(s);
-        if (match != std::string::npos)
-        { // Found a match
-            matchPrev = current;
-            cfg.cursor.cy = current;
-            cfg.cursor.cx = match + s.size();
-            cfg.cursor.rOffset = cfg.term.sRow; // Adjust row offset
-
-            matchLineIdx = current;
-            std::copy(row->textStates.begin(), row->textStates.end(), matchLine.begin());
-            std::fill(row->textStates.begin() + match, row->textStates.begin() + match + s.size(), TS_SEARCH);
-
-            break;
+        // Compile once per query; stepping through its matches reuses the DFA states built so far
+        bool ignoreCase = Regex::smartCase(s);
+        if (!search.compiled || s != search.query)
+        {
+            search.compiled = std::make_shared<Regex>(s, ignoreCase);
+            search.error = search.compiled->error();
+            if (!search.error.empty())
+            {
+                search.hits.clear();
+                search.complete = true;
+                search.total = 0;
+                search.current = -1;
+                search.query = s;
+                search.ignoreCase = ignoreCase;
+                search.generation++;
+            }
         }
+        if (!search.error.empty())
+            return;
+        searchWith(cfg, *search.compiled, s, ignoreCase, dir);
     }
+    else
+    {
+        bool ignoreCase = Finder::smartCase(s);
+        if (!search.finder || s != search.query)
+            search.finder = std::make_shared<Finder>(s, ignoreCase);
+        searchWith(cfg, *search.finder, s, ignoreCase, dir);
+    }
+    if (search.current < 0)
+        return;
+
+    // Matches are highlighted at draw time, see TerminalGUI::overlayMatches
+    SearchHit hit = search.match;
+    cfg.fileData.reveal(hit.row);
+    cfg.cursor.cy = hit.row;
+    cfg.cursor.cx = hit.col + hit.len;
+    cfg.cursor.rOffset = cfg.term.sRow; // Adjust row offset
 }
 
 void Commands::Search::run(TerminalGUI &gui, Config &cfg)
@@ -86,6 +274,8 @@ void Commands::Search::run(TerminalGUI &gui, Config &cfg)
     size_t prevROffset = cfg.cursor.rOffset;
 
     // Prompt user for search input
+    cfg.search.origin = {prevCY, prevCX};
+    cfg.search.active = true;
     std::string_view s = InputHandler::promptUser(gui, cfg, "Search: ", Commands::Search::callback);
 
     // Reset cursor position if no search term was provided
@@ -98,169 +288,383 @@ void Commands::Search::run(TerminalGUI &gui, Config &cfg)
     }
 }
 
-void Commands::LaunchServer::run(TerminalGUI &gui, Config &cfg)
+// Rebuilds each row with a match in one pass, then re-renders and re-highlights it once
+template <typename Matcher>
+static size_t replaceRows(Config &cfg, const Matcher &matcher, std::string_view with)
 {
-    int server_fd;
-    struct sockaddr_in address;
-    int addrlen = sizeof(address);
-    
-    // Creating socket file descriptor
-    if ((server_fd = socket(AF_INET, SOCK_STREAM, 0)) == 0) {
-        perror("Socket failed");
-        exit(EXIT_FAILURE);
-    }
-    
-   
-    std::string connectionPort = InputHandler::promptUser(gui, cfg, "INADDR_ANY <Port>: ", std::nullopt);
-    if (connectionPort.empty()) {
-      connectionPort = "8080";
+    TRACE_SCOPE("replaceRows");
+    TTEdFileData &fData = cfg.fileData;
+    const auto &rows = fData.fileData;
+
+    // Rows are independent, so chunks of them are rewritten across the thread pool
+    ThreadPool &pool = ThreadPool::shared();
+    size_t chunks = std::clamp<size_t>(rows.size() / 1024, 1, pool.size() * 8);
+    size_t per = (rows.size() + chunks - 1) / chunks;
+    std::vector<std::vector<size_t>> touched(chunks);
+    std::vector<size_t> counts(chunks, 0);
+    std::vector<std::vector<Crdt::Change>> journals(fData.journaling ? chunks : 0);
+
+    pool.run(chunks, [&](size_t c) {
+        Matcher m = matcher;
+        std::string out;
+        std::vector<std::pair<size_t, size_t>> spans;
+        for (size_t r = c * per, end = std::min(rows.size(), r + per); r < end; r++)
+        {
+            Row &row = *rows[r];
+            m.findAll(row.sRaw, spans);
+            if (spans.empty())
+                continue;
+
+            // Copy the text between matches, skipping literal ones that overlap a match replaced
+            out.clear();
+            size_t last = 0;
+            for (auto [col, len] : spans)
+            {
+                if (col < last)
+                    continue;
+                out.append(row.sRaw, last, col - last);
+                if (fData.journaling)
+                {
+                    // Each replacement erases the match, then inserts where it was in the row as rebuilt so far
+                    journals[c].push_back({r, out.size(), len, ""});
+                    journals[c].push_back({r, out.size(), 0, std::string(with)});
+                }
+                out += with;
+                last = col + len;
+                counts[c]++;
+            }
+            out.append(row.sRaw, last);
+            row.sRaw.swap(out);
+            row.updateRender();
+            touched[c].push_back(r);
+        }
+    });
+
+    // The line index is shared, so it catches up on this thread; the batch counts as one edit,
+    // though peers see it as the erase and insert journaled per match
+    size_t count = 0;
+    for (size_t c = 0; c < chunks; c++)
+    {
+        count += counts[c];
+        for (size_t r : touched[c])
+            fData.touchRow(r);
+        if (fData.journaling)
+            std::move(journals[c].begin(), journals[c].end(), std::back_inserter(fData.journal));
     }
+    if (count > 0)
+    {
+        fData.modified++;
+        fData.edits++;
+    }
+    return count;
+}
 
-    address.sin_family = AF_INET;
-    address.sin_addr.s_addr = INADDR_ANY;
-    address.sin_port = htons(std::stoi(connectionPort));
-    
-    // Bind the socket to the network address and port
-    if (bind(server_fd, (struct sockaddr *)&address, sizeof(address)) < 0) {
-        perror("Bind failed");
-        close(server_fd);
-        exit(EXIT_FAILURE);
-    }
-    
-    // Start listening for incoming connections
-    if (listen(server_fd, 3) < 0) {
-        perror("Listen failed");
-        close(server_fd);
-        exit(EXIT_FAILURE);
-    }
-    
-    cfg.status.setStatusMsg("TinyTed server launched on port: " + connectionPort);
-    gui.draw();
-    
-    // Accept an incoming connection
-    if ((cfg.conn.sockfd = accept(server_fd, (struct sockaddr *)&address, (socklen_t*)&addrlen)) < 0) {
-        perror("Accept failed");
-        close(server_fd);
-        exit(EXIT_FAILURE);
-    }
-
-    cfg.conn.host = true;
-    cfg.conn.connected = true;
-
-    cfg.status.setStatusMsg("Connection Established, transfering file data");
-    // gui.draw();
-
-    // Send path
-    size_t length =  cfg.fileData.path.string().size();
-    send(cfg.conn.sockfd, &length, sizeof(length), 0);
-    send(cfg.conn.sockfd, cfg.fileData.path.string().c_str(), length, 0);
-
-    // Send buffer data
-    std::string line;
-    for (auto line: cfg.fileData.fileData)
+size_t Commands::Replace::all(Config &cfg, std::string_view query, std::string_view with, bool regex)
+{
+    if (regex)
     {
-        uint32_t size = line->size();
-        // send size
-        send(cfg.conn.sockfd, &size, sizeof(size), 0);
+        Regex re(query, Regex::smartCase(query));
+        return re.error().empty() ? replaceRows(cfg, re, with) : 0;
+    }
+    Finder finder(query, Finder::smartCase(query));
+    return replaceRows(cfg, finder, with);
+}
 
-        // read ack
+void Commands::Replace::run(TerminalGUI &gui, Config &cfg)
+{
+    size_t prevCX = cfg.cursor.cx;
+    size_t prevCY = cfg.cursor.cy;
 
-        // send data
-        send(cfg.conn.sockfd, line->sRaw.c_str(), line->size(), 0);
+    // The query prompt is a search prompt, so matches light up and Ctrl-R toggles regex mode
+    cfg.search.origin = {prevCY, prevCX};
+    cfg.search.active = true;
+    std::string query = InputHandler::promptUser(gui, cfg, "Replace: ", Commands::Search::callback);
+    bool regex = cfg.search.regex;
+    cfg.cursor.cx = prevCX;
+    cfg.cursor.cy = prevCY;
+    if (query.empty())
+        return;
 
-        // read ack
+    if (regex)
+    {
+        Regex re(query, false);
+        if (!re.error().empty())
+        {
+            cfg.status.setStatusMsg("Regex: " + re.error());
+            return;
+        }
     }
 
-    // fin
-    int fin = -1;
-    send(cfg.conn.sockfd, &fin, sizeof(fin), 0);
+    bool cancelled = false;
+    std::string with = InputHandler::promptUser(gui, cfg, "Replace " + query + " with: ",
+                                                [&cancelled](Config &, std::string, int c) {
+                                                    cancelled = c == '\x1b' || c == K_CTRL('q');
+                                                });
+    if (cancelled)
+        return;
 
-    close(server_fd);
+    size_t count = all(cfg, query, with, regex);
+    if (cfg.cursor.cy < cfg.fileData.size())
+        cfg.cursor.cx = std::min(cfg.cursor.cx, cfg.fileData.at(cfg.cursor.cy)->sRaw.size());
+    cfg.status.setStatusMsg("Replaced " + std::to_string(count) + (count == 1 ? " match" : " matches"));
 }
 
-void Commands::ConnectServer::run(TerminalGUI &gui, Config &cfg)
+// Puts the buffer waiting in grep.other on screen, with its cursor and highlighting, and parks the one that was
+static void swapBuffers(Config &cfg)
 {
-    struct sockaddr_in serv_addr;
-    std::string message;
+    TTEdGrep &grep = cfg.grep;
+    std::swap(cfg.fileData, grep.other);
+    std::swap(cfg.cursor, grep.otherCursor);
+    std::swap(Config::syntax, grep.otherSyntax);
+    grep.showing = !grep.showing;
+
+    // Search hits point into the buffer that just left the screen
+    cfg.search.reset();
+}
 
-    // Create socket
-    if ((cfg.conn.sockfd = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
-        std::cerr << "Socket creation error" << std::endl;
-    }
+void Commands::ProjectSearch::run(TerminalGUI &gui, Config &cfg)
+{
+    TTEdGrep &grep = cfg.grep;
 
-    // Get Connection input
-    std::string connectionIP = InputHandler::promptUser(gui, cfg, "<IP>: ", std::nullopt);
-    if (connectionIP.empty()) {
-      connectionIP = "127.0.0.1";
+    // Edits from a peer apply to whatever is on screen, which must not be the results
+    if (cfg.session.connected || cfg.session.starting)
+    {
+        cfg.status.setStatusMsg("Grep is unavailable while connected");
+        return;
     }
 
-    std::string connectionPort = InputHandler::promptUser(gui, cfg, connectionIP + " <Port>: ", std::nullopt);
-    if (connectionPort.empty()) {
-      connectionPort = "8080";
+    bool regex = cfg.search.regex;
+    std::string query = InputHandler::promptUser(gui, cfg, regex ? "Grep regex: " : "Grep: ", std::nullopt);
+    if (query.empty())
+    {
+        if (grep.job && !grep.showing)
+            swapBuffers(cfg);
+        return;
     }
 
-    int port = std::stoi(connectionPort);
+    auto job = std::make_shared<Grep>(".", query, regex);
+    if (!job->error().empty())
+    {
+        cfg.status.setStatusMsg("Regex: " + job->error());
+        return;
+    }
 
-    serv_addr.sin_family = AF_INET;
-    serv_addr.sin_port = htons(port);
+    // A fresh results buffer takes the file's place, or the old results' if they are on screen
+    if (!grep.showing)
+    {
+        grep.other = TTEdFileData{};
+        swapBuffers(cfg);
+    }
+    cfg.fileData = TTEdFileData{};
+    cfg.fileData.filename = "grep: " + query;
+    cfg.cursor = TTEdCursor{};
+    Config::syntax = NULL;
+    cfg.search.reset();
+
+    grep.job = job; // Stops and joins the previous search, if any
+    grep.matches.clear();
+    grep.reported = false;
+}
 
-    // Convert IPv4 and IPv6 addresses from text to binary form
-    if (inet_pton(AF_INET, connectionIP.c_str(), &serv_addr.sin_addr) <= 0) {
-        cfg.status.setStatusMsg("Invalid address/ Address not supported");
+void Commands::ProjectSearch::poll(Config &cfg)
+{
+    TTEdGrep &grep = cfg.grep;
+    if (!grep.job || grep.reported)
         return;
+
+    // Checked before taking, so nothing found after the last take is missed
+    bool done = grep.job->done();
+    size_t first = grep.matches.size();
+    grep.job->take(grep.matches, 4096);
+
+    // Results rows are plain text, whatever the file parked behind them is highlighted as
+    TTEdFileData &results = grep.showing ? cfg.fileData : grep.other;
+    SyntaxHL *syntax = Config::syntax;
+    Config::syntax = NULL;
+    std::vector<std::shared_ptr<Row>> rows;
+    for (size_t i = first; i < grep.matches.size(); i++)
+    {
+        const GrepMatch &m = grep.matches[i];
+        rows.push_back(std::make_shared<Row>(m.path + ":" + std::to_string(m.row + 1) + ":" + std::to_string(m.col + 1) + ": " + m.line));
+    }
+    Config::syntax = syntax;
+    if (!rows.empty())
+    {
+        results.insertRows(results.size(), std::move(rows));
+        results.edits++;
     }
 
-    // Connect to the server
-    if (connect(cfg.conn.sockfd, (struct sockaddr *)&serv_addr, sizeof(serv_addr)) < 0) {
-        cfg.status.setStatusMsg("Connected Failed - No Server");
+    size_t n = grep.matches.size();
+    std::string summary = "Grep: " + std::to_string(n) + (n == 1 ? " match in " : " matches in ") +
+                          std::to_string(grep.job->files()) + " files";
+    grep.reported = done && n == grep.job->matches();
+    if (!grep.reported)
+        cfg.status.setStatusMsg(summary + "...");
+    else
+        cfg.status.setStatusMsg(summary + (grep.job->truncated() ? ", stopped at the limit" : ""));
+}
+
+void Commands::ProjectSearch::open(Config &cfg)
+{
+    TTEdGrep &grep = cfg.grep;
+    if (cfg.cursor.cy >= grep.matches.size())
         return;
+    GrepMatch m = grep.matches[cfg.cursor.cy];
+
+    // The file behind the results is kept if the match is in it
+    std::error_code ec;
+    bool same = !grep.other.path.empty() && std::filesystem::equivalent(grep.other.path, m.path, ec);
+    if (!same)
+    {
+        if (grep.other.modified)
+        {
+            cfg.status.setStatusMsg("UNSAVED CHANGES in " + grep.other.filename + " | Esc returns to it");
+            return;
+        }
+        if (access(m.path.c_str(), R_OK) != 0)
+        {
+            cfg.status.setStatusMsg("Cannot open " + m.path);
+            return;
+        }
     }
 
-    // std::cout << "Connected to the server. Enter a message: ";
-    cfg.status.setStatusMsg("Connected to TinyTed server");
+    swapBuffers(cfg);
+    if (!same)
+    {
+        cfg.fileData = TTEdFileData{};
+        cfg.cursor = TTEdCursor{};
+        if (FileIO::openFile(cfg, m.path) < 0)
+            cfg.status.setStatusMsg("Failed to read " + m.path);
+    }
 
-    size_t length;
+    // The file may have changed since it was searched
+    TTEdFileData &fData = cfg.fileData;
+    cfg.cursor.cy = std::min(m.row, fData.size());
+    cfg.cursor.cx = cfg.cursor.cy < fData.size() ? std::min(m.col, fData.at(cfg.cursor.cy)->sRaw.size()) : 0;
+    if (cfg.cursor.cy < fData.size())
+        fData.reveal(cfg.cursor.cy);
+}
 
-    // Recv file path for name/extension
-    recv(cfg.conn.sockfd, &length, sizeof(length), 0);
-    std::vector<char> buffer(length);
-    recv(cfg.conn.sockfd, buffer.data(), length, 0);
-    cfg.fileData.path = std::string(buffer.begin(), buffer.end());
+void Commands::ProjectSearch::back(Config &cfg)
+{
+    if (cfg.grep.showing)
+        swapBuffers(cfg);
+}
 
-    parseFileExtension(cfg);
+void Commands::LaunchServer::run(TerminalGUI &gui, Config &cfg)
+{
+    // The file is what gets shared, so it comes back from behind the grep results first
+    ProjectSearch::back(cfg);
 
-    size_t valread;
-    std::vector<std::shared_ptr<Row>> fileData;
+    std::string connectionPort = InputHandler::promptUser(gui, cfg, "INADDR_ANY <Port>: ", std::nullopt);
+    if (connectionPort.empty()) {
+      connectionPort = "8080";
+    }
 
-    while (true) {
+    // The network thread listens and reports back; peers join from then on, each given the document as it stands
+    NetMsg msg;
+    msg.kind = NetMsg::LISTEN;
+    msg.port = std::stoi(connectionPort);
+    cfg.session.connected = cfg.session.host = false;
+    cfg.session.starting = true;
+    cfg.net.post(std::move(msg));
+    cfg.status.setStatusMsg("Launching server on port " + connectionPort + "...");
+}
 
-        // Read size
-        uint32_t size;
-        valread = read(cfg.conn.sockfd, &size, sizeof(size));
+void Commands::ConnectServer::run(TerminalGUI &gui, Config &cfg)
+{
+    // The file is what a resumed session shares or a snapshot replaces, never the grep results
+    ProjectSearch::back(cfg);
 
-        if (valread <= 0 || size == -1) {
-            break;
-        }
-        // read data
-        char buf[size + 1];
-        memset(buf, '\0', size + 1);
+    // Get Connection input
+    std::string connectionIP = InputHandler::promptUser(gui, cfg, "<IP>: ", std::nullopt);
+    if (connectionIP.empty()) {
+      connectionIP = "127.0.0.1";
+    }
+
+    std::string connectionPort = InputHandler::promptUser(gui, cfg, connectionIP + " <Port>: ", std::nullopt);
+    if (connectionPort.empty()) {
+      connectionPort = "8080";
+    }
 
-        valread = read(cfg.conn.sockfd, buf, size);
+    // The network thread connects and reads the document while editing goes on; a buffer still shared
+    // from a session that dropped asks the host to resume it
+    NetMsg msg;
+    msg.kind = NetMsg::CONNECT;
+    msg.text = connectionIP;
+    msg.port = std::stoi(connectionPort);
+    if (cfg.fileData.journaling)
+    {
+        msg.have = cfg.session.doc.version();
+        msg.floor = cfg.session.log.floor();
+    }
+    cfg.session.connected = cfg.session.host = false;
+    cfg.session.starting = true;
+    cfg.net.post(std::move(msg));
+    cfg.status.setStatusMsg("Connecting to " + connectionIP + ":" + connectionPort + "...");
+}
 
-        std::string line(buf);
+void Commands::MemReport::run(TerminalGUI &, Config &cfg)
+{
+    cfg.status.setStatusMsg(::MemStats::collect(cfg).summary());
+}
+
+void Commands::Fold::run(TerminalGUI &gui, Config &cfg)
+{
+    auto &fData = cfg.fileData;
+    size_t header = cfg.cursor.cy;
+    if (header >= fData.size())
+    {
+        return;
+    }
 
-        auto r = std::make_shared<Row>(Row{line});
-        r->updateRender();
+    if (fData.at(header)->foldLen > 0)
+    {
+        fData.unfold(header);
+        cfg.status.setStatusMsg("Unfolded");
+        return;
+    }
 
-        fileData.emplace_back(r);
+    bool cancelled = false;
+    std::string last = InputHandler::promptUser(gui, cfg, "Fold through line (empty = auto): ",
+                                                [&cancelled](Config &, std::string, int c) {
+                                                    cancelled = c == '\x1b' || c == K_CTRL('q');
+                                                });
+    if (cancelled)
+    {
+        return;
     }
 
-    cfg.conn.connected = true;
+    size_t len;
+    if (last.empty())
+    {
+        len = fData.foldRange(header);
+    }
+    else
+    {
+        char *end;
+        unsigned long line = strtoul(last.c_str(), &end, 10);
+        if (*end != '\0' || line <= header + 1 || line > fData.size())
+        {
+            cfg.status.setStatusMsg("Invalid line: " + last);
+            return;
+        }
+        len = line - header - 1;
+    }
 
-    // Close the socket
-    // close(sock);
-    // cfg.fileData.fileData.clear
-    cfg.fileData.fileData = fileData;
-    cfg.status.setStatusMsg("File data transfer success, now editing: " + cfg.fileData.path.string());
+    if (len == 0)
+    {
+        cfg.status.setStatusMsg("Nothing to fold");
+        return;
+    }
 
+    // Entering indexed scrolling keeps the same top row on screen
+    bool indexed = cfg.term.softWrap || fData.folds > 0;
+    fData.fold(header, len);
+    if (!indexed)
+    {
+        fData.syncLines(0);
+        cfg.cursor.vOffset = fData.lines.prefix(std::min(cfg.cursor.rOffset, fData.size()));
+    }
+    cfg.status.setStatusMsg("Folded " + std::to_string(len) + " lines");
 }
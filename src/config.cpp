@@ -1,10 +1,20 @@
 #include <config.hh>
+#include <perf.hh>
+#include <trace.hh>
 #include <sstream>
 #include <unistd.h>
 #include <sys/ioctl.h>
 #include <ctime>
-#include <regex>
 #include <fcntl.h>
+#include <cstring>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <algorithm>
+#include <cerrno>
+#include <snapshot.hh>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <poll.h>
 
 ///////////////////
 // ROW METHODS
@@ -16,11 +26,8 @@ SyntaxHL *Config::syntax = NULL;
 
 Row::Row(std::string s) {
   // Update row string data
-  this->sRaw = s;
+  this->sRaw = std::move(s);
   this->updateRender();
-
-  // Fill values in textStates array
-  std::fill(this->textStates.begin(), this->textStates.end(), TS_NORMAL);  
 }
 
 void Row::insertChar(TTEdCursor &cursor, char c)
@@ -64,9 +71,16 @@ Row Row::splitRow(TTEdCursor &cursor)
 }
 
 void Row::parseStates() {
-    std::fill(this->textStates.begin(), this->textStates.end(), TS_NORMAL);  
+    TRACE_SCOPE("Row::parseStates");
+    Perf::Timer timer(Perf::HIGHLIGHT);
+    if (Perf::enabled)
+        Perf::record(Perf::REHIGHLIGHT, 1);
+
+    // One state per rendered column, so lines of any length can be highlighted
+    this->textStates.assign(this->sRender.size(), TS_NORMAL);
 
     if (Config::syntax == NULL) {
+      this->indexSpans();
       return;
     }
 
@@ -81,7 +95,7 @@ void Row::parseStates() {
         // Parse single line comments if not currently in string and syntax supports it
         size_t commentSize = Config::syntax->comment.size(); 
         if (( commentSize <= this->size() - i) && (!in_string)) {
-          if (this->sRender.substr(i, commentSize) == Config::syntax->comment) {
+          if (this->sRender.compare(i, commentSize, Config::syntax->comment) == 0) {
             std::fill(this->textStates.begin() + i, this->textStates.end(), TS_COMMENT);
             break;
           }          
@@ -126,7 +140,7 @@ void Row::parseStates() {
             for (std::string &s: Config::syntax->keywords) {
                 size_t kwSize = s.size();
                 if (kwSize <= this->size() - i) {
-                    if (this->sRender.substr(i, kwSize) == s) {
+                    if (s[0] == c && this->sRender.compare(i, kwSize, s) == 0) {
                         std::fill(this->textStates.begin() + i, this->textStates.begin() + i + kwSize, TS_KW1);
                         break;
                     }
@@ -137,7 +151,7 @@ void Row::parseStates() {
             for (std::string &s: Config::syntax->types) {
                 size_t typeSize = s.size();
                 if (typeSize <= this->size() - i) {
-                    if (this->sRender.substr(i, typeSize) == s) {
+                    if (s[0] == c && this->sRender.compare(i, typeSize, s) == 0) {
                         std::fill(this->textStates.begin() + i, this->textStates.begin() + i + typeSize, TS_TYPE);
                         break;
                     }
@@ -148,13 +162,97 @@ void Row::parseStates() {
         separator = this->isSeparator(c);
         i++;
     }
+
+    this->indexSpans();
+}
+
+void Row::indexSpans() {
+    this->spans.clear();
+    for (size_t i = 0; i < this->textStates.size(); i++) {
+        if (this->spans.empty() || this->spans.back().state != this->textStates[i]) {
+            this->spans.push_back({i, this->textStates[i]});
+        }
+    }
+    this->matchGen = 0; // Match columns may have moved with the text
+    this->invalidateImage();
+}
+
+size_t Row::spanAt(size_t col) const {
+    auto it = std::upper_bound(this->spans.begin(), this->spans.end(), col,
+                               [](size_t c, const StateSpan &s) { return c < s.start; });
+    return it == this->spans.begin() ? 0 : it - this->spans.begin() - 1;
+}
+
+std::shared_ptr<const RowImage> Row::imageOf(size_t offset, size_t width) {
+    if (this->image && this->image->offset == offset && this->image->width == width) {
+        return this->image;
+    }
+
+    // Copy only the window, clipping the spans and matches to it, so the cost is bounded by the screen width
+    auto img = std::make_shared<RowImage>();
+    img->offset = offset;
+    img->width = width;
+    size_t begin = std::min(offset, this->sRender.size());
+    size_t end = this->sRender.size() - begin > width ? begin + width : this->sRender.size();
+    img->text.assign(this->sRender, begin, end - begin);
+    for (size_t s = this->spanAt(begin); s < this->spans.size() && this->spans[s].start < end; s++) {
+        img->spans.push_back({std::max(this->spans[s].start, begin) - begin, this->spans[s].state});
+    }
+    for (auto [from, to] : this->matches) {
+        if (to > begin && from < end) {
+            img->matches.push_back({std::max(from, begin) - begin, std::min(to, end) - begin});
+        }
+    }
+    this->image = std::move(img);
+    return this->image;
+}
+
+void Row::invalidateImage() {
+    this->image.reset();
+}
+
+size_t Row::wrapLayout(size_t width) {
+    if (this->wrapWidth == width) {
+        return this->wrapBreaks.size() + 1;
+    }
+
+    this->wrapBreaks.clear();
+    size_t start = 0;
+    while (this->sRender.size() - start > width) {
+        size_t space = this->sRender.rfind(' ', start + width - 1);
+        start = (space != std::string::npos && space > start) ? space + 1 : start + width;
+        this->wrapBreaks.push_back(start);
+    }
+
+    this->wrapWidth = width;
+    return this->wrapBreaks.size() + 1;
+}
+
+size_t Row::segmentOf(size_t rx) const {
+    return std::upper_bound(this->wrapBreaks.begin(), this->wrapBreaks.end(), rx) - this->wrapBreaks.begin();
+}
+
+size_t Row::segmentStart(size_t seg) const {
+    return seg == 0 ? 0 : this->wrapBreaks.at(seg - 1);
 }
 
 void Row::updateRender() {
-    std::string spaceStr(TABSTOP, ' '); // String of spaces to replace tabs
-    
+    TRACE_SCOPE("Row::updateRender");
+    this->wrapWidth = 0; // Wrap layout depends on the rendered text
+
     // Replace tabs with spaces and store both raw and rendered versions of the line
-    this->sRender = std::regex_replace(this->sRaw, std::regex("\t"), spaceStr);
+    if (this->sRaw.find('\t') == std::string::npos) {
+        this->sRender = this->sRaw;
+    } else {
+        this->sRender.clear();
+        this->sRender.reserve(this->sRaw.size());
+        for (char c : this->sRaw) {
+            if (c == '\t')
+                this->sRender.append(TABSTOP, ' ');
+            else
+                this->sRender += c;
+        }
+    }
 
     this->parseStates();
 }
@@ -163,6 +261,12 @@ bool Row::isSeparator(int c) {
     return isspace(c) || c == '\0' || strchr(",.()+-/*=~&<>[];", c) != NULL;
 }
 
+size_t Row::rawToRender(size_t cx) const {
+    // updateRender expands each tab to TABSTOP spaces
+    size_t tabs = std::count(this->sRaw.begin(), this->sRaw.begin() + cx, '\t');
+    return cx + tabs * (TABSTOP - 1);
+}
+
 ///////////////////
 // CURSOR METHODS
 ///////////////////
@@ -182,6 +286,35 @@ int TTEdCursor::rowCxToRx(std::shared_ptr<Row> row)
     return rx;
 }
 
+///////////////////
+// SEARCH METHODS
+///////////////////
+
+void TTEdSearch::reset()
+{
+    this->query.clear();
+    this->hits.clear();
+    this->hits.shrink_to_fit(); // A broad query can leave a large result set behind
+    this->complete = false;
+    this->total = 0;
+    this->current = -1;
+    this->compiled.reset();
+    this->finder.reset();
+    this->error.clear();
+    this->generation++;
+}
+
+long TTEdSearch::locate(SearchHit at) const
+{
+    if (this->hits.empty())
+        return -1;
+
+    auto it = std::lower_bound(this->hits.begin(), this->hits.end(), at, [](const SearchHit &a, const SearchHit &b) {
+        return a.row != b.row ? a.row < b.row : a.col < b.col;
+    });
+    return it == this->hits.end() ? 0 : it - this->hits.begin();
+}
+
 ///////////////////
 // STATUS METHODS
 ///////////////////
@@ -216,6 +349,41 @@ void TTEdTermData::getWindowSize()
     }
 }
 
+size_t TTEdTermData::textCols() const
+{
+    return this->sCol > GUTTER_WIDTH ? this->sCol - GUTTER_WIDTH : 1;
+}
+
+void TTEdTermData::detectSyncOutput()
+{
+    static const char query[] = "\x1b[?2026$p\x1b[c";
+    if (!isatty(STDIN_FILENO) || write(STDOUT_FILENO, query, sizeof(query) - 1) != sizeof(query) - 1)
+    {
+        return;
+    }
+
+    // Collect replies until the device attributes one, which ends in 'c'
+    std::string reply;
+    char c = 0;
+    while (c != 'c' && reply.size() < 256)
+    {
+        fd_set readfds;
+        FD_ZERO(&readfds);
+        FD_SET(STDIN_FILENO, &readfds);
+        struct timeval timeout = {0, 250000};
+        if (select(STDIN_FILENO + 1, &readfds, nullptr, nullptr, &timeout) <= 0 || read(STDIN_FILENO, &c, 1) != 1)
+        {
+            break;
+        }
+        reply += c;
+    }
+
+    // DECRPM: 1 = set, 2 = reset, 3 = permanently set; 0 and 4 mean unsupported
+    this->syncOutput = reply.find("\x1b[?2026;1$y") != std::string::npos ||
+                       reply.find("\x1b[?2026;2$y") != std::string::npos ||
+                       reply.find("\x1b[?2026;3$y") != std::string::npos;
+}
+
 void TTEdTermData::enterRaw()
 {
     if (tcgetattr(STDIN_FILENO, &(this->tty)) == -1)
@@ -252,7 +420,196 @@ void TTEdTermData::exitRaw()
 void TTEdFileData::insertRow(size_t pos, Row row)
 {
     // Insert a new row at the specified position
-    this->fileData.insert(this->fileData.begin() + pos, std::make_shared<Row>(row));
+    this->insertRows(pos, {std::make_shared<Row>(row)});
+    this->edits++;
+}
+
+void TTEdFileData::insertRows(size_t pos, std::vector<std::shared_ptr<Row>> rows)
+{
+    bool indexed = !this->linesDirty && this->lines.size() == this->size();
+    size_t n = rows.size();
+    this->fileData.insert(this->fileData.begin() + pos, std::make_move_iterator(rows.begin()), std::make_move_iterator(rows.end()));
+    if (!indexed)
+    {
+        return;
+    }
+
+    // Splice the new rows into the index instead of rebuilding it for every row
+    std::vector<size_t> counts(n);
+    for (size_t i = 0; i < n; i++)
+    {
+        counts[i] = this->rowLines(pos + i);
+    }
+    this->lines.insert(pos, counts);
+}
+
+void TTEdFileData::eraseRows(size_t pos, size_t n)
+{
+    bool indexed = !this->linesDirty && this->lines.size() == this->size();
+    this->fileData.erase(this->fileData.begin() + pos, this->fileData.begin() + pos + n);
+    if (indexed)
+    {
+        this->lines.erase(pos, n);
+    }
+}
+
+void TTEdFileData::syncLines(size_t wrapWidth)
+{
+    if (!this->linesDirty && this->linesWidth == wrapWidth && this->lines.size() == this->size())
+    {
+        return;
+    }
+
+    // Rows carry their fold, so the folds come back with the rebuilt index
+    this->linesWidth = wrapWidth;
+    std::vector<size_t> counts(this->size()), folds;
+    for (size_t i = 0; i < this->size(); i++)
+    {
+        counts[i] = this->rowLines(i);
+    }
+    if (this->folds > 0)
+    {
+        folds.resize(this->size());
+        for (size_t i = 0; i < this->size(); i++)
+        {
+            folds[i] = this->fileData[i]->foldLen;
+        }
+    }
+
+    this->lines.build(std::move(counts), folds);
+    this->linesDirty = false;
+}
+
+size_t TTEdFileData::rowLines(size_t pos) const
+{
+    return this->linesWidth ? this->fileData.at(pos)->wrapLayout(this->linesWidth) : 1;
+}
+
+void TTEdFileData::touchRow(size_t pos)
+{
+    // Nothing to maintain unless the index is in use and current
+    if (this->linesDirty || this->lines.size() != this->size())
+    {
+        return;
+    }
+    this->lines.set(pos, this->rowLines(pos));
+}
+
+void TTEdFileData::fold(size_t header, size_t len)
+{
+    auto &row = this->fileData.at(header);
+    len = std::min(len, this->size() - header - 1);
+    if (row->foldLen > 0 || len == 0)
+    {
+        return;
+    }
+
+    // The index covers the rows in one range update; if it is not in use, it picks the fold up when built
+    row->foldLen = len;
+    if (!this->linesDirty && this->lines.size() == this->size())
+    {
+        this->lines.fold(header, len);
+    }
+    this->folds++;
+}
+
+void TTEdFileData::unfold(size_t header)
+{
+    auto &row = this->fileData.at(header);
+    if (row->foldLen == 0)
+    {
+        return;
+    }
+
+    row->foldLen = 0;
+    if (!this->linesDirty && this->lines.size() == this->size())
+    {
+        this->lines.unfold(header);
+    }
+    this->folds--;
+}
+
+void TTEdFileData::reveal(size_t pos)
+{
+    if (this->folds == 0 || pos >= this->size())
+    {
+        return;
+    }
+
+    // Every fold covering the row hides it, so all of them are unfolded
+    this->syncLines(this->linesWidth);
+    for (size_t header : this->lines.covering(pos))
+    {
+        this->unfold(header);
+    }
+}
+
+size_t TTEdFileData::foldRange(size_t header) const
+{
+    const Row &row = *this->fileData.at(header);
+
+    // Brace folding: from a row opening more braces than it closes to the row closing them
+    int depth = 0;
+    auto countBraces = [](const Row &r) {
+        int d = 0;
+        for (size_t i = 0; i < r.sRender.size(); i++)
+        {
+            textState st = i < r.textStates.size() ? r.textStates[i] : TS_NORMAL;
+            if (st == TS_STRING || st == TS_COMMENT)
+                continue;
+            d += r.sRender[i] == '{' ? 1 : r.sRender[i] == '}' ? -1 : 0;
+        }
+        return d;
+    };
+
+    depth = countBraces(row);
+    if (depth > 0)
+    {
+        for (size_t i = header + 1; i < this->size(); i++)
+        {
+            depth += countBraces(*this->fileData[i]);
+            if (depth <= 0)
+            {
+                return i - header - 1; // Keep the closing row visible
+            }
+        }
+        return this->size() - header - 1;
+    }
+
+    // Indentation folding: the following rows indented deeper than the header, ignoring blank rows
+    auto indent = [](const Row &r) { return r.sRender.find_first_not_of(' '); };
+    size_t base = indent(row);
+    size_t last = header;
+    for (size_t i = header + 1; i < this->size(); i++)
+    {
+        size_t ind = indent(*this->fileData[i]);
+        if (ind == std::string::npos)
+            continue;
+        if (base == std::string::npos || ind <= base)
+            break;
+        last = i;
+    }
+    return last - header;
+}
+
+size_t TTEdFileData::nextVisible(size_t pos) const
+{
+    if (this->folds == 0 || this->linesDirty || this->lines.size() != this->size() || pos >= this->size())
+    {
+        return pos + 1;
+    }
+    size_t line = this->lines.prefix(pos) + this->lines.count(pos);
+    return line < this->lines.total() ? this->lines.find(line).first : this->size();
+}
+
+size_t TTEdFileData::prevVisible(size_t pos) const
+{
+    if (this->folds == 0 || this->linesDirty || this->lines.size() != this->size() || pos == 0)
+    {
+        return pos - 1;
+    }
+    size_t line = this->lines.prefix(std::min(pos, this->size()));
+    return line > 0 ? this->lines.find(line - 1).first : 0;
 }
 
 size_t TTEdFileData::size() const
@@ -270,13 +627,24 @@ void TTEdFileData::insertChar(TTEdCursor &cursor, char c)
     // Insert a character into the file data at the cursor position
     if (cursor.cy == this->size())
     {
+        if (this->journaling)
+        {
+            this->journal.push_back({cursor.cy, 0, 0, "\n"});
+        }
         this->insertRow(cursor.cy); // Add a new row if at end of file
     }
 
+    this->reveal(cursor.cy);
     std::shared_ptr<Row> insertRow = this->fileData.at(cursor.cy);
+    if (this->journaling)
+    {
+        this->journal.push_back({cursor.cy, std::min(cursor.cx, insertRow->size()), 0, std::string(1, c)});
+    }
     insertRow->insertChar(cursor, c);
+    this->touchRow(cursor.cy);
     cursor.cx++;
     this->modified++;
+    this->edits++;
 }
 
 void TTEdFileData::deleteChar(TTEdCursor &cursor)
@@ -286,9 +654,17 @@ void TTEdFileData::deleteChar(TTEdCursor &cursor)
         return; // No action if at the start or invalid position
     }
 
+    this->reveal(cursor.cy);
+    if (this->journaling)
+    {
+        // Deleting at the start of a row deletes the newline ending the row before
+        size_t col = cursor.cx > 0 ? cursor.cx - 1 : this->at(cursor.cy - 1)->size();
+        this->journal.push_back({cursor.cx > 0 ? cursor.cy : cursor.cy - 1, col, 1, ""});
+    }
     if (cursor.cx > 0)
     {
         this->at(cursor.cy)->deleteChar(cursor);
+        this->touchRow(cursor.cy);
         cursor.cx--;
     }
     else
@@ -297,21 +673,42 @@ void TTEdFileData::deleteChar(TTEdCursor &cursor)
         size_t oldcy = cursor.cy;
         size_t newcy = --(cursor.cy);
 
+        // Folds are anchored to their header row, so none may span the rows being merged
+        this->reveal(oldcy);
+        this->unfold(oldcy);
+        this->reveal(newcy);
+        this->unfold(newcy);
+
         // Append the current row to the previous row
         cursor.cx = this->at(newcy)->sRaw.size();
         this->at(newcy)->sRaw += this->at(oldcy)->sRaw;
-        this->at(newcy)->sRender += this->at(oldcy)->sRender;
+        this->at(newcy)->updateRender();
 
         // Remove the old row
-        this->fileData.erase(this->fileData.begin() + oldcy);
+        this->eraseRows(oldcy, 1);
+        this->touchRow(newcy);
     }
 
     this->modified++;
+    this->edits++;
 }
 
 void TTEdFileData::insertNewLine(TTEdCursor &cursor)
 {
+    this->edits++;
+
+    // Splitting a fold header would move the rows its fold covers
+    if (cursor.cy < this->size())
+    {
+        this->reveal(cursor.cy);
+        this->unfold(cursor.cy);
+    }
+
     // Insert a new line at the cursor position
+    if (this->journaling)
+    {
+        this->journal.push_back({cursor.cy, cursor.cx, 0, "\n"});
+    }
     if (cursor.cx == 0)
     {
         this->insertRow(cursor.cy);
@@ -321,6 +718,7 @@ void TTEdFileData::insertNewLine(TTEdCursor &cursor)
         std::shared_ptr<Row> rowToSplit = this->fileData.at(cursor.cy);
         Row newRow = rowToSplit->splitRow(cursor);
         this->insertRow(cursor.cy + 1, newRow);
+        this->touchRow(cursor.cy);
     }
 
     // Move cursor to the new line
@@ -328,6 +726,122 @@ void TTEdFileData::insertNewLine(TTEdCursor &cursor)
     cursor.cx = 0;
 }
 
+void TTEdFileData::splice(const Crdt::Change &change, TTEdCursor &cursor)
+{
+    size_t row = change.row;
+    size_t col = change.col;
+    if (row >= this->size() && change.erase > 0)
+    {
+        return; // Nothing past the last row's newline to erase
+    }
+
+    // Folds are anchored to their header row, so none may span rows being joined or split
+    if (row < this->size())
+    {
+        this->reveal(row);
+        this->unfold(row);
+        col = std::min(col, this->at(row)->size());
+    }
+
+    if (change.erase > 0)
+    {
+        // Find where the erased text ends, each row's newline counting as a character
+        size_t endRow = row, endCol = col, left = change.erase;
+        while (endRow + 1 < this->size() && left > this->at(endRow)->size() - endCol)
+        {
+            left -= this->at(endRow)->size() - endCol + 1;
+            endRow++;
+            endCol = 0;
+            this->reveal(endRow);
+            this->unfold(endRow);
+        }
+        endCol = std::min(endCol + left, this->at(endRow)->size());
+
+        std::shared_ptr<Row> first = this->at(row);
+        if (endRow == row)
+        {
+            first->sRaw.erase(col, endCol - col);
+        }
+        else
+        {
+            first->sRaw.replace(col, std::string::npos, this->at(endRow)->sRaw, endCol);
+            this->eraseRows(row + 1, endRow - row);
+        }
+        first->updateRender();
+        this->touchRow(row);
+
+        if (cursor.cy > endRow || (cursor.cy == endRow && cursor.cx >= endCol))
+        {
+            cursor.cx = cursor.cy == endRow ? col + cursor.cx - endCol : cursor.cx;
+            cursor.cy -= endRow - row;
+        }
+        else if (cursor.cy > row || (cursor.cy == row && cursor.cx > col))
+        {
+            cursor.cy = row;
+            cursor.cx = col;
+        }
+    }
+    else
+    {
+        // Each newline inserted ends a row, and the text after the last goes before the rest of the row
+        std::vector<std::string> pieces{""};
+        for (char c : change.text)
+        {
+            if (c == '\n')
+                pieces.emplace_back();
+            else
+                pieces.back() += c;
+        }
+        size_t added = pieces.size() - 1;
+
+        if (row >= this->size())
+        {
+            // Past the last row only whole rows are inserted
+            if (pieces.back().empty())
+                pieces.pop_back();
+            std::vector<std::shared_ptr<Row>> rows;
+            for (std::string &piece : pieces)
+                rows.push_back(std::make_shared<Row>(std::move(piece)));
+            this->insertRows(this->size(), std::move(rows));
+        }
+        else if (added == 0)
+        {
+            this->at(row)->sRaw.insert(col, pieces[0]);
+            this->at(row)->updateRender();
+            this->touchRow(row);
+        }
+        else
+        {
+            std::shared_ptr<Row> first = this->at(row);
+            std::string tail = first->sRaw.substr(col);
+            first->sRaw.replace(col, std::string::npos, pieces[0]);
+            first->updateRender();
+
+            std::vector<std::shared_ptr<Row>> rows;
+            pieces.back() += tail;
+            for (size_t i = 1; i < pieces.size(); i++)
+                rows.push_back(std::make_shared<Row>(std::move(pieces[i])));
+            this->insertRows(row + 1, std::move(rows));
+            this->touchRow(row);
+        }
+
+        // The cursor moves with the text after it; one right where the text went stays put
+        if (cursor.cy == row && cursor.cx > col)
+        {
+            size_t last = added > 0 ? change.text.size() - change.text.rfind('\n') - 1 : col + change.text.size();
+            cursor.cx = cursor.cx - col + last;
+            cursor.cy += added;
+        }
+        else if (cursor.cy > row)
+        {
+            cursor.cy += added;
+        }
+    }
+
+    this->modified++;
+    this->edits++;
+}
+
 std::stringstream TTEdFileData::streamify()
 {
     std::stringstream ss;
@@ -338,34 +852,976 @@ std::stringstream TTEdFileData::streamify()
     return ss;
 }
 
-void Config::scroll()
+///////////////////
+// CONNECTION METHODS
+///////////////////
+
+bool TTEdConnection::listen(uint16_t port, std::string &err)
 {
-    cursor.rx = 0; // Reset horizontal cursor position
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        err = std::strerror(errno);
+        return false;
+    }
+    int on = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
 
-    // Adjust row offset
-    if (cursor.cy < fileData.size())
+    struct sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = INADDR_ANY;
+    address.sin_port = htons(port);
+    if (bind(fd, (struct sockaddr *)&address, sizeof(address)) < 0 || ::listen(fd, SOMAXCONN) < 0)
     {
-        cursor.rx = cursor.rowCxToRx(fileData.at(cursor.cy));
+        err = std::strerror(errno);
+        ::close(fd);
+        return false;
     }
 
-    if (cursor.cy < cursor.rOffset)
+    if (this->epollfd < 0)
     {
-        cursor.rOffset = cursor.cy;
+        this->epollfd = epoll_create1(EPOLL_CLOEXEC);
+    }
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.u32 = 0; // Peer ids start at 1
+    if (this->epollfd < 0 || epoll_ctl(this->epollfd, EPOLL_CTL_ADD, fd, &ev) < 0)
+    {
+        err = std::strerror(errno);
+        ::close(fd);
+        return false;
     }
 
-    if (cursor.cy >= cursor.rOffset + term.sRow)
+    this->listenfd = fd;
+    this->host = true;
+    this->connected = true;
+    return true;
+}
+
+TTEdPeer &TTEdConnection::add(int fd, const std::string &ip)
+{
+    uint32_t id = this->nextId++;
+    TTEdPeer &peer = this->peers[id];
+    peer.id = id;
+    peer.fd = fd;
+    peer.ip = ip;
+    peer.sent = this->end();
+
+    int on = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    if (this->epollfd < 0)
     {
-        cursor.rOffset = cursor.cy - term.sRow + 1;
+        this->epollfd = epoll_create1(EPOLL_CLOEXEC);
+    }
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.u32 = id;
+    if (fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) < 0 || this->epollfd < 0 ||
+        epoll_ctl(this->epollfd, EPOLL_CTL_ADD, fd, &ev) < 0)
+    {
+        peer.error = std::strerror(errno);
     }
 
-    // Adjust column offset
-    if (cursor.rx < cursor.cOffset)
+    this->connected = true;
+    return peer;
+}
+
+void TTEdConnection::drop(uint32_t id)
+{
+    auto it = this->peers.find(id);
+    if (it == this->peers.end())
     {
-        cursor.cOffset = cursor.rx;
+        return;
+    }
+    epoll_ctl(this->epollfd, EPOLL_CTL_DEL, it->second.fd, NULL);
+    ::close(it->second.fd);
+    this->peers.erase(it);
+    this->trim();
+}
+
+void TTEdConnection::close()
+{
+    for (auto &[id, peer] : this->peers)
+    {
+        ::close(peer.fd);
+    }
+    if (this->listenfd >= 0)
+    {
+        ::close(this->listenfd);
+    }
+    if (this->epollfd >= 0)
+    {
+        ::close(this->epollfd);
+    }
+    *this = TTEdConnection();
+}
+
+size_t TTEdConnection::end() const
+{
+    return this->outBase + this->outbox.size();
+}
+
+void TTEdConnection::queue(const Protocol::Op &op)
+{
+    // A frame holds the operations of one origin, so each peer can be sent all but its own
+    if (this->batch.size() > 0 && op.origin != this->batchOrigin)
+    {
+        this->seal();
+    }
+    if (this->batch.size() == 0)
+    {
+        this->batchStart = std::chrono::steady_clock::now();
+        this->batchOrigin = op.origin;
+    }
+    this->batch.add(op);
+}
+
+void TTEdConnection::seal()
+{
+    if (this->batch.size() == 0)
+    {
+        return;
     }
+    this->batch.finish(this->outbox);
+    this->frames.push_back(Frame{this->end(), this->batchOrigin});
+}
 
-    if (cursor.rx >= cursor.cOffset + term.sCol)
+void TTEdConnection::flush(bool force)
+{
+    if (this->batch.size() > 0 &&
+        (force || this->batch.bytes() >= MAX_BATCH || std::chrono::steady_clock::now() - this->batchStart >= BATCH_WINDOW))
     {
-        cursor.cOffset = cursor.rx - term.sCol + 1;
+        this->seal();
     }
+
+    // Peers whose sockets are full wait for epoll to report them writable rather than being retried
+    for (auto &[id, peer] : this->peers)
+    {
+        if (!peer.synced || peer.blocked || !peer.error.empty())
+        {
+            continue;
+        }
+        this->send(peer);
+        if (this->end() - peer.sent + peer.pending.size() - peer.pendHead > MAX_LAG)
+        {
+            peer.error = "too far behind";
+        }
+    }
+    this->trim();
+}
+
+int TTEdConnection::receive(std::vector<Protocol::Op> &ops)
+{
+    if (this->epollfd < 0)
+    {
+        return 0;
+    }
+
+    epoll_event events[64];
+    int ready = epoll_wait(this->epollfd, events, 64, 0);
+    size_t before = ops.size();
+    for (int e = 0; e < ready; e++)
+    {
+        // Peers joining are added unsynced, to be given the document before anything else
+        if (events[e].data.u32 == 0)
+        {
+            struct sockaddr_in address;
+            socklen_t len = sizeof(address);
+            int fd;
+            while ((fd = accept4(this->listenfd, (struct sockaddr *)&address, &len, SOCK_CLOEXEC)) >= 0)
+            {
+                char ip[INET_ADDRSTRLEN] = "?";
+                inet_ntop(AF_INET, &address.sin_addr, ip, sizeof(ip));
+                this->add(fd, ip);
+                len = sizeof(address);
+            }
+            continue;
+        }
+
+        auto it = this->peers.find(events[e].data.u32);
+        if (it == this->peers.end() || !it->second.error.empty())
+        {
+            continue;
+        }
+        TTEdPeer &peer = it->second;
+        if (events[e].events & EPOLLOUT)
+        {
+            this->watch(peer, false);
+            this->send(peer);
+        }
+        if (!(events[e].events & (EPOLLIN | EPOLLHUP | EPOLLERR)))
+        {
+            continue;
+        }
+
+        // A peer joining says hello before its frames, which waits in greeting until it is answered
+        char buf[1 << 16];
+        ssize_t n;
+        while ((n = ::recv(peer.fd, buf, sizeof(buf), 0)) > 0)
+        {
+            if (peer.synced)
+                peer.inbox.feed(buf, n);
+            else
+                peer.greeting.append(buf, n);
+        }
+        bool closed = n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK);
+        std::string reason = n == 0 ? "closed by peer" : std::strerror(errno);
+        if (peer.greeting.size() > MAX_HELLO)
+        {
+            peer.error = "hello too long";
+        }
+        else if (closed)
+        {
+            (peer.synced ? peer.closing : peer.error) = reason;
+        }
+    }
+
+    // Every inbox is decoded, as frames that came in with a peer's snapshot or hello have no event
+    // of their own. What arrived before a peer left is still applied
+    for (auto &[id, peer] : this->peers)
+    {
+        if (!peer.synced || !peer.error.empty())
+        {
+            continue;
+        }
+        size_t from = ops.size();
+        if (!peer.inbox.decode(ops))
+        {
+            peer.error = peer.inbox.error();
+        }
+        else if (!peer.closing.empty())
+        {
+            peer.error = peer.closing;
+        }
+        for (size_t i = from; i < ops.size(); i++)
+        {
+            ops[i].origin = peer.id;
+        }
+    }
+    return ops.size() - before;
+}
+
+void TTEdConnection::watch(TTEdPeer &peer, bool writable)
+{
+    peer.blocked = writable;
+    epoll_event ev{};
+    ev.events = EPOLLIN | (writable ? uint32_t(EPOLLOUT) : 0u);
+    ev.data.u32 = peer.id;
+    epoll_ctl(this->epollfd, EPOLL_CTL_MOD, peer.fd, &ev);
+}
+
+void TTEdConnection::send(TTEdPeer &peer)
+{
+    auto failed = [&](ssize_t n) {
+        if (n >= 0)
+            return false;
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+            this->watch(peer, true);
+        else
+            peer.error = std::strerror(errno);
+        return true;
+    };
+
+    // A joining peer's snapshot goes out before the stream
+    while (peer.pendHead < peer.pending.size())
+    {
+        ssize_t n = ::send(peer.fd, peer.pending.data() + peer.pendHead, peer.pending.size() - peer.pendHead, MSG_NOSIGNAL);
+        if (failed(n))
+            return;
+        peer.pendHead += n;
+    }
+    if (peer.pendHead > 0)
+    {
+        std::string().swap(peer.pending);
+        peer.pendHead = 0;
+    }
+
+    // Send the stream in runs of frames from other origins, stepping over the peer's own
+    auto frame = std::upper_bound(this->frames.begin(), this->frames.end(), peer.sent,
+                                  [](size_t at, const Frame &f) { return at < f.end; });
+    while (frame != this->frames.end())
+    {
+        if (frame->origin == peer.id)
+        {
+            peer.sent = (frame++)->end;
+            continue;
+        }
+        auto last = frame;
+        while (last != this->frames.end() && last->origin != peer.id)
+            ++last;
+        size_t runEnd = std::prev(last)->end;
+        while (peer.sent < runEnd)
+        {
+            ssize_t n = ::send(peer.fd, this->outbox.data() + (peer.sent - this->outBase), runEnd - peer.sent, MSG_NOSIGNAL);
+            if (failed(n))
+                return;
+            peer.sent += n;
+        }
+        frame = last;
+    }
+}
+
+void TTEdConnection::trim()
+{
+    size_t low = this->end();
+    for (const auto &[id, peer] : this->peers)
+    {
+        if (peer.synced)
+        {
+            low = std::min(low, peer.sent);
+        }
+    }
+
+    // Frames every peer is past are erased once they are most of the buffer, keeping the copy amortized
+    auto done = std::upper_bound(this->frames.begin(), this->frames.end(), low,
+                                 [](size_t at, const Frame &f) { return at < f.end; });
+    size_t cut = done == this->frames.begin() ? this->outBase : std::prev(done)->end;
+    if (cut > this->outBase && (cut == this->end() || 2 * (cut - this->outBase) >= this->outbox.size()))
+    {
+        this->outbox.erase(0, cut - this->outBase);
+        this->frames.erase(this->frames.begin(), done);
+        this->outBase = cut;
+    }
+}
+
+///////////////////
+// NETWORK THREAD
+///////////////////
+
+NetThread::NetThread()
+{
+    this->netWake = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    this->editorWake = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+}
+
+NetThread::~NetThread()
+{
+    this->stop();
+    ::close(this->netWake);
+    ::close(this->editorWake);
+}
+
+void NetThread::post(NetMsg msg)
+{
+    if (!this->thread.joinable())
+    {
+        this->stopping = false;
+        this->thread = std::thread(&NetThread::run, this);
+    }
+
+    // Messages keep their order, so none passes those waiting for room
+    while (!this->outSpill.empty() && this->toNet.push(this->outSpill.front()))
+    {
+        this->outSpill.pop_front();
+    }
+    if (!this->outSpill.empty() || !this->toNet.push(msg))
+    {
+        this->outSpill.push_back(std::move(msg));
+    }
+    this->wake();
+}
+
+bool NetThread::next(NetMsg &msg)
+{
+    if (!this->outSpill.empty())
+    {
+        while (!this->outSpill.empty() && this->toNet.push(this->outSpill.front()))
+        {
+            this->outSpill.pop_front();
+        }
+        this->wake();
+    }
+    return this->toEditor.pop(msg);
+}
+
+void NetThread::wake()
+{
+    // Pairs with the fence in run: either the thread sees what was pushed before it sleeps, or this sees it asleep
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (this->asleep.load(std::memory_order_relaxed) && this->asleep.exchange(false))
+    {
+        uint64_t one = 1;
+        (void)!::write(this->netWake, &one, sizeof(one));
+    }
+}
+
+int NetThread::wakeFd() const
+{
+    return this->editorWake;
+}
+
+size_t NetThread::bytes() const
+{
+    return this->held.load(std::memory_order_relaxed);
+}
+
+void NetThread::stop()
+{
+    if (!this->thread.joinable())
+    {
+        return;
+    }
+    this->stopping = true;
+    uint64_t one = 1;
+    (void)!::write(this->netWake, &one, sizeof(one));
+    this->thread.join();
+
+    // The thread is gone, so its side of the rings and the connection are the editor's now
+    this->conn.close();
+    NetMsg msg;
+    while (this->toNet.pop(msg) || this->toEditor.pop(msg))
+    {
+    }
+    this->outSpill.clear();
+    this->inSpill.clear();
+    this->held = 0;
+}
+
+void NetThread::run()
+{
+    bool woke = false;
+    while (!this->stopping.load(std::memory_order_acquire))
+    {
+        // Sleep until the editor posts or a socket is ready, or the batch window or a full ring needs a retry.
+        // The sockets are left alone while the editor is far behind, so peers are held back by TCP instead
+        bool backlog = this->inSpill.size() >= RING;
+        int timeout = -1;
+        if (this->conn.batch.size() > 0)
+        {
+            auto left = this->conn.batchStart + TTEdConnection::BATCH_WINDOW - std::chrono::steady_clock::now();
+            timeout = std::max<long>(0, std::chrono::ceil<std::chrono::milliseconds>(left).count());
+        }
+        if (!this->inSpill.empty())
+        {
+            timeout = timeout < 0 ? 1 : std::min(timeout, 1);
+        }
+        this->asleep.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!this->toNet.empty())
+        {
+            timeout = 0;
+        }
+        pollfd fds[2] = {{this->netWake, POLLIN, 0}, {backlog ? -1 : this->conn.epollfd, POLLIN, 0}};
+        poll(fds, 2, timeout);
+        this->asleep.store(false, std::memory_order_relaxed);
+        uint64_t count;
+        (void)!::read(this->netWake, &count, sizeof(count));
+
+        NetMsg msg;
+        while (!this->stopping.load(std::memory_order_relaxed) && this->toNet.pop(msg))
+        {
+            this->handle(msg);
+        }
+
+        if (!backlog)
+        {
+            std::vector<Protocol::Op> ops;
+            this->conn.receive(ops);
+            for (Protocol::Op &op : ops)
+            {
+                NetMsg in;
+                in.op = std::move(op);
+                this->deliver(std::move(in));
+            }
+        }
+
+        // Peers joining are answered by the editor, which has the document; their frames wait in greeting till then
+        for (auto &[id, peer] : this->conn.peers)
+        {
+            if (peer.synced || peer.greeted || !peer.error.empty())
+            {
+                continue;
+            }
+            NetMsg joined;
+            std::string_view in = peer.greeting;
+            if (Snapshot::readHello(in, joined.have, joined.floor, peer.error) <= 0)
+            {
+                continue;
+            }
+            peer.greeting.erase(0, peer.greeting.size() - in.size());
+            peer.greeted = true;
+            joined.kind = NetMsg::JOINED;
+            joined.peer = id;
+            joined.text = peer.ip;
+            joined.peers = this->conn.peers.size();
+            this->deliver(std::move(joined));
+        }
+
+        std::vector<uint32_t> lost;
+        for (const auto &[id, peer] : this->conn.peers)
+        {
+            if (!peer.error.empty())
+            {
+                lost.push_back(id);
+            }
+        }
+        for (uint32_t id : lost)
+        {
+            const TTEdPeer &peer = this->conn.peers.at(id);
+            NetMsg left;
+            left.kind = NetMsg::LEFT;
+            left.peer = id;
+            left.text = peer.ip;
+            left.error = peer.error;
+            if (!this->conn.host)
+            {
+                this->conn.close();
+                this->deliver(std::move(left));
+                break;
+            }
+            this->conn.drop(id);
+            left.peers = this->conn.peers.size();
+            this->deliver(std::move(left));
+        }
+
+        this->conn.flush();
+        size_t bytes = this->conn.outbox.capacity() + this->conn.frames.size() * sizeof(TTEdConnection::Frame);
+        for (const auto &[id, peer] : this->conn.peers)
+        {
+            bytes += sizeof(peer) + peer.ip.capacity() + peer.pending.capacity() + peer.greeting.capacity();
+        }
+        this->held.store(bytes, std::memory_order_relaxed);
+
+        while (!this->inSpill.empty() && this->toEditor.push(this->inSpill.front()))
+        {
+            this->inSpill.pop_front();
+            woke = true;
+        }
+        if (woke || this->delivered)
+        {
+            uint64_t one = 1;
+            (void)!::write(this->editorWake, &one, sizeof(one));
+            woke = this->delivered = false;
+        }
+    }
+}
+
+void NetThread::handle(NetMsg &msg)
+{
+    switch (msg.kind)
+    {
+    case NetMsg::OP:
+        this->conn.queue(msg.op);
+        break;
+
+    case NetMsg::LISTEN:
+    {
+        NetMsg reply;
+        reply.kind = NetMsg::HOSTING;
+        reply.port = msg.port;
+        this->conn.close();
+        this->conn.listen(msg.port, reply.error);
+        this->deliver(std::move(reply));
+        break;
+    }
+
+    case NetMsg::CONNECT:
+        this->attach(msg);
+        break;
+
+    // A peer joining is sent its snapshot before anything queued after it, and its own frames are read from here on
+    case NetMsg::SYNC:
+    {
+        auto it = this->conn.peers.find(msg.peer);
+        if (it == this->conn.peers.end() || !it->second.error.empty())
+        {
+            break;
+        }
+        TTEdPeer &peer = it->second;
+        this->conn.seal();
+        peer.pending = std::move(msg.text);
+        peer.inbox.feed(peer.greeting.data(), peer.greeting.size());
+        std::string().swap(peer.greeting);
+        peer.sent = this->conn.end();
+        peer.synced = true;
+        break;
+    }
+
+    case NetMsg::CLOSE:
+        this->conn.close();
+        break;
+
+    default:
+        break;
+    }
+}
+
+void NetThread::attach(NetMsg &msg)
+{
+    static constexpr int CONNECT_TIMEOUT = 5000; ///< Milliseconds to wait for the host to answer.
+    static constexpr time_t TRANSFER_TIMEOUT = 10; ///< Seconds the transfer may stall.
+
+    this->conn.close();
+    NetMsg reply;
+    reply.kind = NetMsg::ATTACHED;
+    reply.text = msg.text;
+
+    struct sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(msg.port);
+    if (inet_pton(AF_INET, msg.text.c_str(), &address.sin_addr) <= 0)
+    {
+        reply.error = "Invalid address/ Address not supported";
+        this->deliver(std::move(reply));
+        return;
+    }
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        reply.error = "Socket creation error";
+        this->deliver(std::move(reply));
+        return;
+    }
+
+    // A host that does not answer is given up on well before the kernel would
+    int err = 0;
+    if (connect(fd, (struct sockaddr *)&address, sizeof(address)) < 0)
+    {
+        err = errno;
+        pollfd p{fd, POLLOUT, 0};
+        socklen_t len = sizeof(err);
+        if (err == EINPROGRESS)
+        {
+            err = poll(&p, 1, CONNECT_TIMEOUT) == 1 ? (getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len), err) : ETIMEDOUT;
+        }
+    }
+    if (err != 0)
+    {
+        reply.error = std::string("No Server - ") + std::strerror(err);
+        ::close(fd);
+        this->deliver(std::move(reply));
+        return;
+    }
+
+    // The hello and the transfer block this thread alone, up to a stall of TRANSFER_TIMEOUT
+    struct timeval stall{TRANSFER_TIMEOUT, 0};
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &stall, sizeof(stall));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &stall, sizeof(stall));
+    std::string hello;
+    Snapshot::hello(msg.have, msg.floor, hello);
+    for (size_t at = 0; at < hello.size();)
+    {
+        ssize_t n = ::send(fd, hello.data() + at, hello.size() - at, MSG_NOSIGNAL);
+        if (n <= 0)
+        {
+            reply.error = "could not say hello";
+            ::close(fd);
+            this->deliver(std::move(reply));
+            return;
+        }
+        at += n;
+    }
+
+    // The chunks are decompressed by the editor, which owns the document they replace
+    Protocol::Reader live;
+    reply.transfer = std::make_shared<Snapshot::Transfer>();
+    if (!Snapshot::read(fd, *reply.transfer, live, reply.have, reply.error))
+    {
+        ::close(fd);
+        reply.transfer.reset();
+        this->deliver(std::move(reply));
+        return;
+    }
+    if (!reply.have.empty())
+    {
+        reply.transfer.reset();
+    }
+    TTEdPeer &host = this->conn.add(fd, msg.text);
+    host.inbox = std::move(live);
+    host.synced = true;
+    reply.peers = 1;
+    this->deliver(std::move(reply));
+}
+
+void NetThread::deliver(NetMsg msg)
+{
+    this->delivered = true;
+    if (!this->inSpill.empty() || !this->toEditor.push(msg))
+    {
+        this->inSpill.push_back(std::move(msg));
+    }
+}
+
+///////////////////
+// CONFIG METHODS
+///////////////////
+
+int Config::recv()
+{
+    int applied = 0;
+    std::string snapshot;
+    NetMsg msg;
+    while (net.next(msg))
+    {
+        switch (msg.kind)
+        {
+        case NetMsg::OP:
+        {
+            // What is still arriving from a session left or failed to load has no place in the document
+            if (!session.connected)
+            {
+                break;
+            }
+            TRACE_SCOPE("collab.apply");
+            Perf::Timer timer(Perf::NET_APPLY);
+
+            // The host relays what a guest sent to every other guest
+            if (session.host)
+            {
+                net.post(msg);
+            }
+            apply(msg.op);
+            applied++;
+            break;
+        }
+
+        // A joining peer is answered as of the document as it stands: everything posted before the answer
+        // is in it, and everything posted after reaches the peer relayed
+        case NetMsg::JOINED:
+        {
+            NetMsg sync;
+            sync.kind = NetMsg::SYNC;
+            sync.peer = msg.peer;
+            session.peers = msg.peers;
+
+            // A peer resumes when each side's log reaches back to what the other lacks; else it is given the document
+            if (Crdt::includes(msg.have, session.log.floor()) && Crdt::includes(session.doc.version(), msg.floor))
+            {
+                std::vector<Protocol::Op> missed;
+                session.log.since(msg.have, missed);
+                Snapshot::resume(session.doc.version(), sync.text);
+                if (!missed.empty())
+                {
+                    Protocol::Writer writer;
+                    for (const Protocol::Op &op : missed)
+                    {
+                        writer.add(op);
+                    }
+                    writer.finish(sync.text);
+                }
+                status.setStatusMsg(msg.text + " resumed, " + std::to_string(missed.size()) + " edits behind, " +
+                                    std::to_string(session.peers) + " connected.");
+            }
+            else
+            {
+                if (snapshot.empty())
+                {
+                    Snapshot::encode(fileData, session.doc, snapshot);
+                }
+                sync.text = snapshot;
+                status.setStatusMsg(msg.text + " joined, " + std::to_string(session.peers) + " connected.");
+            }
+            net.post(std::move(sync));
+            break;
+        }
+
+        case NetMsg::LEFT:
+            session.peers = msg.peers;
+            if (!session.host)
+            {
+                // Editing goes on into the shared sequence, to be sent when the session is resumed
+                session.connected = false;
+                status.setStatusMsg((msg.error == "closed by peer" ? "Connection closed by peer" : "Connection dropped: " + msg.error) +
+                                    "; connect again to resume.");
+                break;
+            }
+            status.setStatusMsg(msg.text + " left: " + msg.error + ", " + std::to_string(session.peers) + " connected.");
+            break;
+
+        case NetMsg::HOSTING:
+            session.starting = false;
+            if (!msg.error.empty())
+            {
+                status.setStatusMsg("Could not host on port " + std::to_string(msg.port) + ": " + msg.error);
+                break;
+            }
+
+            // Edits from here on are made to the shared sequence too
+            session.connected = session.host = true;
+            session.peers = 0;
+            session.doc.load(fileData);
+            session.log.start(session.doc.version());
+            fileData.journaling = true;
+            fileData.journal.clear();
+            status.setStatusMsg("TinyTed server launched on port: " + std::to_string(msg.port));
+            break;
+
+        case NetMsg::ATTACHED:
+        {
+            session.starting = false;
+            std::string err = msg.error;
+            if (err.empty() && msg.transfer && !Snapshot::load(*msg.transfer, *this, err))
+            {
+                NetMsg close;
+                close.kind = NetMsg::CLOSE;
+                net.post(std::move(close));
+            }
+            if (!err.empty())
+            {
+                status.setStatusMsg("File data transfer failed: " + err);
+                break;
+            }
+            session.connected = true;
+            session.host = false;
+            session.peers = msg.peers;
+
+            // Resumed, the host is sent what it missed while the frames it sent back arrive
+            if (!msg.transfer)
+            {
+                std::vector<Protocol::Op> missed;
+                session.log.since(msg.have, missed);
+                for (Protocol::Op &op : missed)
+                {
+                    NetMsg out;
+                    out.op = std::move(op);
+                    net.post(std::move(out));
+                }
+                status.setStatusMsg("Session resumed, " + std::to_string(missed.size()) + " edits sent: " + fileData.path.string());
+                break;
+            }
+            session.log.start(session.doc.version());
+            fileData.journaling = true;
+            cursor = TTEdCursor{};
+            search.reset();
+            status.setStatusMsg("File data transfer success, now editing: " + fileData.path.string());
+            break;
+        }
+
+        default:
+            break;
+        }
+    }
+    return applied;
+}
+
+void Config::share()
+{
+    // Changes are taken in order, each against the text the one before it left. Offline, they are
+    // only logged, for the host to be sent on resuming
+    for (const Crdt::Change &change : fileData.journal)
+    {
+        NetMsg msg;
+        if (session.doc.local(change, msg.op))
+        {
+            session.log.keep(msg.op);
+            if (session.connected)
+            {
+                net.post(std::move(msg));
+            }
+        }
+    }
+    fileData.journal.clear();
+}
+
+void Config::apply(const Protocol::Op &op)
+{
+    // A peer resuming may send again what it sent just before it dropped
+    auto known = session.doc.version().find(op.id.site);
+    if (known != session.doc.version().end() && Crdt::last(op) <= known->second)
+    {
+        return;
+    }
+
+    std::vector<Crdt::Change> changes;
+    session.doc.apply(op, changes);
+    session.log.keep(op);
+    for (const Crdt::Change &change : changes)
+    {
+        fileData.splice(change, cursor);
+    }
+}
+
+void Config::scroll()
+{
+    if (term.softWrap || fileData.folds > 0)
+    {
+        scrollIndexed();
+        return;
+    }
+
+    cursor.rx = 0; // Reset horizontal cursor position
+
+    // Adjust row offset
+    if (cursor.cy < fileData.size())
+    {
+        cursor.rx = cursor.rowCxToRx(fileData.at(cursor.cy));
+    }
+
+    if (cursor.cy < cursor.rOffset)
+    {
+        cursor.rOffset = cursor.cy;
+    }
+
+    if (cursor.cy >= cursor.rOffset + term.sRow)
+    {
+        cursor.rOffset = cursor.cy - term.sRow + 1;
+    }
+
+    // Adjust column offset
+    if (cursor.rx < cursor.cOffset)
+    {
+        cursor.cOffset = cursor.rx;
+    }
+
+    // Text starts after the row marker gutter, so fewer columns than sCol are visible
+    size_t textCols = term.textCols();
+    if (cursor.rx >= cursor.cOffset + textCols)
+    {
+        cursor.cOffset = cursor.rx - textCols + 1;
+    }
+
+    cursor.sy = cursor.cy - cursor.rOffset;
+    cursor.sx = cursor.rx - cursor.cOffset;
+}
+
+void Config::scrollIndexed()
+{
+    size_t textCols = term.textCols();
+    fileData.syncLines(term.softWrap ? textCols : 0);
+    fileData.reveal(cursor.cy);
+
+    cursor.rx = 0;
+    size_t seg = 0;
+    size_t segStart = 0;
+    if (cursor.cy < fileData.size())
+    {
+        auto row = fileData.at(cursor.cy);
+        cursor.rx = cursor.rowCxToRx(row);
+        if (term.softWrap)
+        {
+            seg = row->segmentOf(cursor.rx);
+            segStart = row->segmentStart(seg);
+        }
+    }
+
+    // Wrapped rows never scroll sideways; otherwise the column offset behaves as in scroll()
+    if (term.softWrap)
+    {
+        cursor.cOffset = 0;
+    }
+    else
+    {
+        if (cursor.rx < cursor.cOffset)
+            cursor.cOffset = cursor.rx;
+        if (cursor.rx >= cursor.cOffset + textCols)
+            cursor.cOffset = cursor.rx - textCols + 1;
+        segStart = cursor.cOffset;
+    }
+    cursor.sx = cursor.rx - segStart;
+
+    // Scroll by visual lines so a row taller than the screen can still be paged through
+    size_t line = fileData.lines.prefix(cursor.cy) + seg;
+    if (line < cursor.vOffset)
+    {
+        cursor.vOffset = line;
+    }
+
+    if (line >= cursor.vOffset + term.sRow)
+    {
+        cursor.vOffset = line - term.sRow + 1;
+    }
+
+    cursor.sy = line - cursor.vOffset;
+    cursor.rOffset = cursor.vOffset < fileData.lines.total() ? fileData.lines.find(cursor.vOffset).first : fileData.size();
 }
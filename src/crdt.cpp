@@ -0,0 +1,725 @@
+#include <crdt.hh>
+#include <config.hh>
+#include <algorithm>
+#include <random>
+
+using Protocol::Id;
+
+static size_t newlines(std::string_view s)
+{
+    return std::count(s.begin(), s.end(), '\n');
+}
+
+// A site is picked at random, so peers need no coordination to tell their characters apart
+static uint32_t newSite()
+{
+    std::random_device rd;
+    uint32_t site;
+    while ((site = rd()) == 0);
+    return site;
+}
+
+bool Crdt::includes(const Version &a, const Version &b)
+{
+    for (const auto &[site, clock] : b)
+    {
+        auto it = a.find(site);
+        if (it == a.end() || it->second < clock)
+            return false;
+    }
+    return true;
+}
+
+uint64_t Crdt::last(const Protocol::Op &op)
+{
+    return op.type == Protocol::OP_INSERT && !op.text.empty() ? op.id.clock + op.text.size() - 1 : op.id.clock;
+}
+
+static void see(Crdt::Version &seen, const Protocol::Op &op)
+{
+    uint64_t &clock = seen[op.id.site];
+    clock = std::max(clock, Crdt::last(op));
+}
+
+Crdt::Sequence::Sequence()
+{
+    chunks.push_back(std::make_unique<Chunk>());
+    rebuild();
+}
+
+///////////////////
+// LAYOUT
+///////////////////
+
+void Crdt::Sequence::rebuild()
+{
+    std::vector<size_t> c(chunks.size()), l(chunks.size());
+    for (size_t i = 0; i < chunks.size(); i++)
+    {
+        chunks[i]->at = i;
+        c[i] = chunks[i]->chars;
+        l[i] = chunks[i]->lines;
+    }
+    chars.build(std::move(c));
+    lines.build(std::move(l));
+}
+
+void Crdt::Sequence::recount(Chunk &chunk)
+{
+    chunk.chars = chunk.lines = 0;
+    for (const Block &b : chunk.blocks)
+    {
+        if (!b.deleted)
+        {
+            chunk.chars += b.len;
+            chunk.lines += b.lines;
+        }
+    }
+}
+
+// Adds a block at the end while loading, leaving room in each chunk to grow
+void Crdt::Sequence::append(Block block)
+{
+    if (chunks.back()->blocks.size() >= CHUNK_BLOCKS / 2)
+    {
+        chunks.push_back(std::make_unique<Chunk>());
+    }
+    Chunk &chunk = *chunks.back();
+    index[{block.id.site, block.id.clock}] = &chunk;
+    clock = std::max(clock, block.id.clock + block.len - 1);
+    if (!block.deleted)
+    {
+        chunk.chars += block.len;
+        chunk.lines += block.lines;
+    }
+    chunk.blocks.push_back(std::move(block));
+}
+
+void Crdt::Sequence::splitChunk(size_t c)
+{
+    Chunk &full = *chunks[c];
+    auto next = std::make_unique<Chunk>();
+    size_t half = full.blocks.size() / 2;
+    std::move(full.blocks.begin() + half, full.blocks.end(), std::back_inserter(next->blocks));
+    full.blocks.resize(half);
+    for (const Block &b : next->blocks)
+    {
+        index[{b.id.site, b.id.clock}] = next.get();
+    }
+    recount(full);
+    recount(*next);
+    chunks.insert(chunks.begin() + c + 1, std::move(next));
+    rebuild();
+}
+
+// Cuts the block at p in two, returning the position of the second half
+Crdt::Sequence::Pos Crdt::Sequence::split(Pos p)
+{
+    Chunk &chunk = *chunks[p.chunk];
+    Block &b = chunk.blocks[p.block];
+    Block tail{Id{b.id.clock + p.off, b.id.site}, b.len - p.off, 0, b.deleted, {}};
+    if (!b.deleted)
+    {
+        tail.text = b.text.substr(p.off);
+        b.text.resize(p.off);
+        b.text.shrink_to_fit(); // A loaded block would otherwise keep all its text's room for a piece of it
+        tail.lines = newlines(tail.text);
+        b.lines -= tail.lines;
+    }
+    b.len = p.off;
+    index[{tail.id.site, tail.id.clock}] = &chunk;
+    chunk.blocks.insert(chunk.blocks.begin() + p.block + 1, std::move(tail));
+
+    Pos q{p.chunk, p.block + 1, 0};
+    if (chunk.blocks.size() > CHUNK_BLOCKS)
+    {
+        size_t half = chunk.blocks.size() / 2;
+        splitChunk(p.chunk);
+        if (q.block >= half)
+        {
+            q.chunk++;
+            q.block -= half;
+        }
+    }
+    return q;
+}
+
+///////////////////
+// POSITIONS
+///////////////////
+
+// Moves a position off the end of a block or chunk onto the start of the next
+void Crdt::Sequence::normalize(Pos &p) const
+{
+    while (true)
+    {
+        const auto &blocks = chunks[p.chunk]->blocks;
+        if (p.block < blocks.size() && p.off == blocks[p.block].len)
+        {
+            p.block++;
+            p.off = 0;
+        }
+        else if (p.block == blocks.size() && p.chunk + 1 < chunks.size())
+        {
+            p.chunk++;
+            p.block = 0;
+        }
+        else
+        {
+            return;
+        }
+    }
+}
+
+bool Crdt::Sequence::atEnd(const Pos &p) const
+{
+    return p.chunk + 1 == chunks.size() && p.block == chunks.back()->blocks.size();
+}
+
+bool Crdt::Sequence::find(const Id &id, Pos &p) const
+{
+    auto it = index.upper_bound({id.site, id.clock});
+    if (it == index.begin())
+        return false;
+    --it;
+    if (it->first.first != id.site)
+        return false;
+
+    const Chunk &chunk = *it->second;
+    for (size_t b = 0; b < chunk.blocks.size(); b++)
+    {
+        const Block &block = chunk.blocks[b];
+        if (block.id.site == id.site && block.id.clock == it->first.second)
+        {
+            if (id.clock >= block.id.clock + block.len)
+                return false;
+            p = Pos{chunk.at, b, id.clock - block.id.clock};
+            return true;
+        }
+    }
+    return false;
+}
+
+// Finds the character offset characters in, counting only those not deleted; past the end for size()
+Crdt::Sequence::Pos Crdt::Sequence::at(size_t offset) const
+{
+    if (offset >= chars.total())
+    {
+        return Pos{chunks.size() - 1, chunks.back()->blocks.size(), 0};
+    }
+    auto [c, rem] = chars.find(offset);
+    const auto &blocks = chunks[c]->blocks;
+    for (size_t b = 0; b < blocks.size(); b++)
+    {
+        if (blocks[b].deleted)
+            continue;
+        if (rem < blocks[b].len)
+            return Pos{c, b, rem};
+        rem -= blocks[b].len;
+    }
+    return Pos{c, blocks.size(), 0};
+}
+
+size_t Crdt::Sequence::offsetOf(const Pos &p) const
+{
+    size_t offset = chars.prefix(p.chunk);
+    const auto &blocks = chunks[p.chunk]->blocks;
+    for (size_t b = 0; b < p.block; b++)
+    {
+        if (!blocks[b].deleted)
+            offset += blocks[b].len;
+    }
+    if (p.block < blocks.size() && !blocks[p.block].deleted)
+        offset += p.off;
+    return offset;
+}
+
+size_t Crdt::Sequence::rowStart(size_t row) const
+{
+    if (row == 0)
+        return 0;
+    if (row > lines.total())
+        return chars.total();
+
+    // The row starts after the newline ending the row before it
+    auto [c, k] = lines.find(row - 1);
+    size_t offset = chars.prefix(c);
+    for (const Block &b : chunks[c]->blocks)
+    {
+        if (b.deleted)
+            continue;
+        if (k < b.lines)
+        {
+            size_t nl = b.text.find('\n');
+            while (k-- > 0)
+                nl = b.text.find('\n', nl + 1);
+            return offset + nl + 1;
+        }
+        k -= b.lines;
+        offset += b.len;
+    }
+    return offset;
+}
+
+// Gets the row and column of a position, for a change to the rows there
+Crdt::Change Crdt::Sequence::change(const Pos &p) const
+{
+    size_t row = lines.prefix(p.chunk);
+    const auto &blocks = chunks[p.chunk]->blocks;
+    for (size_t b = 0; b < p.block; b++)
+    {
+        if (!blocks[b].deleted)
+            row += blocks[b].lines;
+    }
+    if (p.block < blocks.size() && !blocks[p.block].deleted)
+        row += newlines(std::string_view(blocks[p.block].text).substr(0, p.off));
+
+    Change c;
+    c.row = row;
+    c.col = offsetOf(p) - rowStart(row);
+    return c;
+}
+
+///////////////////
+// INTEGRATION
+///////////////////
+
+void Crdt::Sequence::insert(const Protocol::Op &op, std::vector<Change> *changes)
+{
+    Pos p{0, 0, 0};
+    if (op.text.empty() || find(op.id, p))
+        return; // Nothing to insert, or inserted already
+    if (op.after != Id{})
+    {
+        if (!find(op.after, p))
+            return;
+        p.off++;
+    }
+    else
+    {
+        p = Pos{0, 0, 0};
+    }
+    normalize(p);
+
+    // Characters inserted after the same one with a greater id stay closer to it. Ids grow
+    // along a block, so once the first character looked at is greater, the rest of its block is too
+    while (!atEnd(p))
+    {
+        const Block &b = chunks[p.chunk]->blocks[p.block];
+        if (Id{b.id.clock + p.off, b.id.site} < op.id)
+            break;
+        p.block++;
+        p.off = 0;
+        normalize(p);
+    }
+    if (p.off > 0)
+    {
+        p = split(p);
+    }
+
+    if (changes)
+    {
+        Change c = change(p);
+        c.text = op.text;
+        changes->push_back(std::move(c));
+    }
+    clock = std::max(clock, last(op));
+    see(seen, op);
+    size_t nl = newlines(op.text);
+
+    // Typing on extends the block before, whichever chunk it is in
+    Chunk *before = chunks[p.chunk].get();
+    for (size_t c = p.chunk; p.block == 0 && c-- > 0;)
+    {
+        if (!chunks[c]->blocks.empty())
+        {
+            before = chunks[c].get();
+            break;
+        }
+    }
+    size_t b = before == chunks[p.chunk].get() ? p.block : before->blocks.size();
+    if (b > 0)
+    {
+        Block &prev = before->blocks[b - 1];
+        if (!prev.deleted && prev.id.site == op.id.site && prev.id.clock + prev.len == op.id.clock)
+        {
+            prev.text += op.text;
+            prev.len += op.text.size();
+            prev.lines += nl;
+            before->chars += op.text.size();
+            before->lines += nl;
+            chars.set(before->at, before->chars);
+            lines.set(before->at, before->lines);
+            return;
+        }
+    }
+
+    Chunk &chunk = *chunks[p.chunk];
+    chunk.blocks.insert(chunk.blocks.begin() + p.block, Block{op.id, op.text.size(), nl, false, op.text});
+    index[{op.id.site, op.id.clock}] = &chunk;
+    chunk.chars += op.text.size();
+    chunk.lines += nl;
+    chars.set(chunk.at, chunk.chars);
+    lines.set(chunk.at, chunk.lines);
+    if (chunk.blocks.size() > CHUNK_BLOCKS)
+    {
+        splitChunk(chunk.at);
+    }
+}
+
+void Crdt::Sequence::erase(Protocol::Span span, std::vector<Change> *changes)
+{
+    while (span.len > 0)
+    {
+        // The span's characters may have been split apart by inserts between them
+        Pos p;
+        if (!find(span.id, p))
+            return;
+        if (p.off > 0)
+        {
+            p = split(p);
+        }
+        size_t n = std::min<size_t>(span.len, chunks[p.chunk]->blocks[p.block].len);
+        if (n < chunks[p.chunk]->blocks[p.block].len)
+        {
+            split(Pos{p.chunk, p.block, n});
+            find(span.id, p);
+        }
+
+        Chunk &chunk = *chunks[p.chunk];
+        Block &b = chunk.blocks[p.block];
+        if (!b.deleted)
+        {
+            if (changes)
+            {
+                Change c = change(p);
+                c.erase = n;
+                changes->push_back(std::move(c));
+            }
+            chunk.chars -= n;
+            chunk.lines -= b.lines;
+            chars.set(chunk.at, chunk.chars);
+            lines.set(chunk.at, chunk.lines);
+            b.deleted = true;
+            b.lines = 0;
+            std::string().swap(b.text);
+        }
+        span.id.clock += n;
+        span.len -= n;
+    }
+}
+
+///////////////////
+// PUBLIC
+///////////////////
+
+void Crdt::Sequence::load(const TTEdFileData &fData)
+{
+    *this = Sequence();
+    chunks.back()->blocks.reserve(CHUNK_BLOCKS);
+
+    // The document as loaded is one run of a site of its own, cut into blocks small enough to split cheaply
+    uint32_t base = newSite();
+    std::string text;
+    auto add = [&](std::string_view s) {
+        while (!s.empty())
+        {
+            size_t take = std::min(s.size(), BASE_BLOCK - text.size());
+            text.append(s.substr(0, take));
+            s.remove_prefix(take);
+            if (text.size() == BASE_BLOCK)
+            {
+                size_t nl = newlines(text);
+                append(Block{Id{clock + 1, base}, text.size(), nl, false, std::move(text)});
+                text.clear();
+            }
+        }
+    };
+    for (const auto &row : fData.fileData)
+    {
+        add(row->sRaw);
+        add("\n");
+    }
+    if (!text.empty())
+    {
+        size_t nl = newlines(text);
+        append(Block{Id{clock + 1, base}, text.size(), nl, false, std::move(text)});
+    }
+    rebuild();
+    seen[base] = clock; // Present even for an empty document, naming it
+    while ((site = newSite()) == base);
+}
+
+void Crdt::Sequence::encode(std::string &out) const
+{
+    Protocol::putVarint(out, blocks());
+    for (const auto &chunk : chunks)
+    {
+        for (const Block &b : chunk->blocks)
+        {
+            Protocol::putVarint(out, b.id.site);
+            Protocol::putVarint(out, b.id.clock);
+            Protocol::putVarint(out, b.len << 1 | b.deleted);
+        }
+    }
+    Protocol::putVarint(out, seen.size());
+    for (const auto &[s, c] : seen)
+    {
+        Protocol::putVarint(out, s);
+        Protocol::putVarint(out, c);
+    }
+}
+
+bool Crdt::Sequence::decode(std::string_view in, const TTEdFileData &fData)
+{
+    Sequence seq;
+    uint64_t count;
+    if (!Protocol::getVarint(in, count) || count > in.size() / 3)
+        return false;
+
+    // Blocks not deleted take their text from the rows in order, a newline ending each row
+    const auto &rows = fData.fileData;
+    size_t row = 0, col = 0;
+    auto take = [&](size_t n, std::string &text) {
+        while (n > 0)
+        {
+            if (row >= rows.size())
+                return false;
+            const std::string &raw = rows[row]->sRaw;
+            size_t part = std::min(n, raw.size() - col);
+            text.append(raw, col, part);
+            col += part;
+            n -= part;
+            if (n > 0)
+            {
+                text += '\n';
+                n--;
+                row++;
+                col = 0;
+            }
+        }
+        return true;
+    };
+
+    for (uint64_t i = 0; i < count; i++)
+    {
+        uint64_t site, clock, len;
+        if (!Protocol::getVarint(in, site) || !Protocol::getVarint(in, clock) || !Protocol::getVarint(in, len) ||
+            site > UINT32_MAX || len < 2 || clock == 0)
+            return false;
+        Block b{Id{clock, uint32_t(site)}, len >> 1, 0, (len & 1) != 0, {}};
+        if (!b.deleted)
+        {
+            if (!take(b.len, b.text))
+                return false;
+            b.lines = newlines(b.text);
+        }
+        seq.append(std::move(b));
+    }
+
+    uint64_t sites;
+    if (!Protocol::getVarint(in, sites) || sites > in.size() / 2)
+        return false;
+    for (uint64_t i = 0; i < sites; i++)
+    {
+        uint64_t s, c;
+        if (!Protocol::getVarint(in, s) || !Protocol::getVarint(in, c) || s > UINT32_MAX)
+            return false;
+        seq.seen[uint32_t(s)] = c;
+        seq.clock = std::max(seq.clock, c);
+    }
+
+    // Every row's text is in some block; concurrent deletes can leave the last without its newline
+    bool whole = row == rows.size() && col == 0;
+    bool open = row + 1 == rows.size() && col == rows[row]->sRaw.size();
+    if (!in.empty() || !(whole || open))
+        return false;
+    seq.rebuild();
+    while (seq.seen.count(seq.site = newSite()));
+    *this = std::move(seq);
+    return true;
+}
+
+bool Crdt::Sequence::local(const Change &change, Protocol::Op &op)
+{
+    size_t offset = rowStart(change.row) + change.col;
+    if (change.erase > 0)
+    {
+        // Name the characters erased, a span for each run of them
+        op.type = Protocol::OP_DELETE;
+        op.spans.clear();
+        Pos p = at(offset);
+        for (size_t left = change.erase; left > 0 && !atEnd(p);)
+        {
+            const Block &b = chunks[p.chunk]->blocks[p.block];
+            if (!b.deleted)
+            {
+                size_t n = std::min(left, b.len - p.off);
+                op.spans.push_back(Protocol::Span{Id{b.id.clock + p.off, b.id.site}, n});
+                left -= n;
+            }
+            p.block++;
+            p.off = 0;
+            normalize(p);
+        }
+        for (const Protocol::Span &span : op.spans)
+        {
+            erase(span, nullptr);
+        }
+        if (op.spans.empty())
+            return false;
+        op.id = Id{++clock, site}; // Stamped, so versions count deletes too
+        seen[site] = clock;
+        return true;
+    }
+
+    if (change.text.empty())
+        return false;
+
+    // A new id is greater than any this site has seen, so the text lands right after the character before it
+    op.type = Protocol::OP_INSERT;
+    op.after = Id{};
+    if (offset > 0)
+    {
+        Pos before = at(offset - 1);
+        const Block &b = chunks[before.chunk]->blocks[before.block];
+        op.after = Id{b.id.clock + before.off, b.id.site};
+    }
+    op.id = Id{clock + 1, site};
+    op.text = change.text;
+    insert(op, nullptr);
+    return true;
+}
+
+void Crdt::Sequence::apply(const Protocol::Op &op, std::vector<Change> &changes)
+{
+    switch (op.type)
+    {
+    case Protocol::OP_INSERT:
+        insert(op, &changes);
+        break;
+    case Protocol::OP_DELETE:
+        for (const Protocol::Span &span : op.spans)
+        {
+            erase(span, &changes);
+        }
+        clock = std::max(clock, op.id.clock);
+        see(seen, op);
+        break;
+    }
+}
+
+const Crdt::Version &Crdt::Sequence::version() const
+{
+    return seen;
+}
+
+size_t Crdt::Sequence::size() const
+{
+    return chars.total();
+}
+
+size_t Crdt::Sequence::blocks() const
+{
+    size_t n = 0;
+    for (const auto &chunk : chunks)
+    {
+        n += chunk->blocks.size();
+    }
+    return n;
+}
+
+size_t Crdt::Sequence::bytes() const
+{
+    // A map node holds its key and value beside three pointers and a color
+    size_t n = chunks.capacity() * sizeof(chunks[0]) + index.size() * (sizeof(*index.begin()) + 32);
+    for (const auto &chunk : chunks)
+    {
+        n += sizeof(Chunk) + chunk->blocks.capacity() * sizeof(Block);
+        for (const Block &b : chunk->blocks)
+        {
+            if (b.text.capacity() > 15)
+                n += b.text.capacity() + 1;
+        }
+    }
+    return n + (chars.size() + lines.size()) * 2 * sizeof(size_t) + seen.size() * (sizeof(*seen.begin()) + 32);
+}
+
+///////////////////
+// LOG
+///////////////////
+
+static size_t cost(const Protocol::Op &op)
+{
+    return sizeof(op) + op.text.size() + op.spans.size() * sizeof(Protocol::Span);
+}
+
+void Crdt::Log::start(const Version &base)
+{
+    ops.clear();
+    held = 0;
+    dropped = base;
+}
+
+void Crdt::Log::keep(const Protocol::Op &op)
+{
+    // Typing on extends the run kept last, as the wire does
+    if (op.type == Protocol::OP_INSERT && !ops.empty() && ops.back().type == Protocol::OP_INSERT)
+    {
+        Protocol::Op &run = ops.back();
+        uint64_t next = last(run) + 1;
+        if (op.id.site == run.id.site && op.id.clock == next && op.after == Id{next - 1, op.id.site})
+        {
+            run.text += op.text;
+            held += op.text.size();
+            return;
+        }
+    }
+    ops.push_back(op);
+    ops.back().origin = 0;
+    held += cost(op);
+
+    while (held > WINDOW && ops.size() > 1)
+    {
+        uint64_t &reach = dropped[ops.front().id.site];
+        reach = std::max(reach, last(ops.front()));
+        held -= cost(ops.front());
+        ops.pop_front();
+    }
+}
+
+const Crdt::Version &Crdt::Log::floor() const
+{
+    return dropped;
+}
+
+void Crdt::Log::since(const Version &have, std::vector<Protocol::Op> &out) const
+{
+    for (const Protocol::Op &op : ops)
+    {
+        auto it = have.find(op.id.site);
+        uint64_t known = it == have.end() ? 0 : it->second;
+        if (last(op) <= known)
+            continue;
+        out.push_back(op);
+
+        // A run the replica has the start of is cut down to the rest, each character following the one before
+        if (op.type == Protocol::OP_INSERT && op.id.clock <= known)
+        {
+            Protocol::Op &rest = out.back();
+            rest.text.erase(0, known - op.id.clock + 1);
+            rest.id.clock = known + 1;
+            rest.after = Id{known, op.id.site};
+        }
+    }
+}
+
+size_t Crdt::Log::size() const
+{
+    return ops.size();
+}
+
+size_t Crdt::Log::bytes() const
+{
+    return held;
+}
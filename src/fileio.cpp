@@ -5,6 +5,7 @@
 #include <config.hh>
 #include <iostream>
 #include <filesystem>
+#include <trace.hh>
 
 void parseFileExtension(Config &cfg) {
   cfg.syntax = NULL;
@@ -30,11 +31,11 @@ void parseFileExtension(Config &cfg) {
 
 int FileIO::openFile(Config &cfg, const std::string &path)
 {
+    TRACE_SCOPE("FileIO::openFile");
     std::ifstream ifs(path);
     if (!ifs)
     {
-        ErrorMgr::err("Failed to open file"); // Report the file path in error
-        return -1;                            // Return an error code
+        return -1; // Callers report the failure their own way
     }
     std::filesystem::path p(path);
     cfg.fileData.path = path;
@@ -50,13 +51,16 @@ int FileIO::openFile(Config &cfg, const std::string &path)
         cfg.fileData.fileData.emplace_back(r);
     }
 
+    // Reading stops at end of file with failbit set, so only badbit means the read went wrong
+    bool bad = ifs.bad();
     ifs.close();
     cfg.fileData.modified = 0;       // Reset modified flag after successful file load
-    return ifs.failbit ? -1 : 0; // Return error code if failbit is set
+    return bad ? -1 : 0;
 }
 
 int FileIO::saveFile(Config &cfg)
 {
+    TRACE_SCOPE("FileIO::saveFile");
     std::stringstream ss = cfg.fileData.streamify();
     std::ofstream ofs(cfg.fileData.path, std::ofstream::trunc);
 
@@ -72,5 +76,5 @@ int FileIO::saveFile(Config &cfg)
     
     parseFileExtension(cfg);
 
-    return ofs.failbit ? -1 : 0; // Return error code if failbit is set
+    return ofs.fail() ? -1 : 0; // Return error code if writing or closing failed
 }
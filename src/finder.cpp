@@ -0,0 +1,249 @@
+#include <finder.hh>
+#include <cctype>
+#include <cstring>
+#include <algorithm>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+static inline unsigned char lower(unsigned char c)
+{
+    return c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c;
+}
+
+static inline unsigned char upper(unsigned char c)
+{
+    return c >= 'a' && c <= 'z' ? c - ('a' - 'A') : c;
+}
+
+// Rough frequency rank of bytes in source code and logs, most common first; unlisted bytes are rarest
+static unsigned char rarity(unsigned char c)
+{
+    static const std::array<unsigned char, 256> rank = [] {
+        static const char common[] = " etaoinsrlcdhupmf\t\"=_,.();:/-0123456789gbywvkxjqz{}[]<>*#'+!&|\\$%@^~`?"
+                                     "ETAOINSRLCDHUPMFGBYWVKXJQZ";
+        std::array<unsigned char, 256> r;
+        r.fill(255);
+        for (size_t i = 0; common[i]; i++)
+            r[(unsigned char)common[i]] = i;
+        return r;
+    }();
+    return rank[c];
+}
+
+Finder::Finder(std::string_view query, bool ignoreCase) : needle(query), ignoreCase(ignoreCase)
+{
+    if (ignoreCase)
+    {
+        for (char &c : needle)
+            c = lower(c);
+    }
+
+    // Bad-character shifts; under ignoreCase both cases of a letter share one
+    shift.fill(needle.size());
+    for (size_t i = 0; i + 1 < needle.size(); i++)
+    {
+        unsigned char c = needle[i];
+        shift[c] = needle.size() - 1 - i;
+        if (ignoreCase)
+            shift[upper(c)] = shift[c];
+    }
+
+    // Filter on the two rarest bytes, so common letters cause few false candidates
+    for (size_t i = 0; i < needle.size(); i++)
+    {
+        if (rarity(needle[i]) > rarity(needle[rare1]))
+            rare1 = i;
+    }
+    rare2 = rare1 == 0 ? needle.size() - 1 : 0;
+    for (size_t i = 0; i < needle.size(); i++)
+    {
+        if (i != rare1 && rarity(needle[i]) > rarity(needle[rare2]))
+            rare2 = i;
+    }
+}
+
+bool Finder::smartCase(std::string_view query)
+{
+    for (unsigned char c : query)
+    {
+        if (std::isupper(c))
+            return false;
+    }
+    return true;
+}
+
+size_t Finder::size() const
+{
+    return needle.size();
+}
+
+bool Finder::verify(const char *at) const
+{
+    if (!ignoreCase)
+        return std::memcmp(at, needle.data(), needle.size()) == 0;
+
+    for (size_t i = 0; i < needle.size(); i++)
+    {
+        if (lower(at[i]) != (unsigned char)needle[i])
+            return false;
+    }
+    return true;
+}
+
+size_t Finder::scan(std::string_view hay, size_t from, size_t to) const
+{
+    size_t n = needle.size();
+    unsigned char last = needle.back();
+
+    for (size_t i = from; i < to;)
+    {
+        unsigned char c = hay[i + n - 1];
+        if ((ignoreCase ? lower(c) : c) == last && verify(hay.data() + i))
+            return i;
+        i += shift[c];
+    }
+    return std::string::npos;
+}
+
+size_t Finder::skim(std::string_view hay, size_t &i, size_t end) const
+{
+    // Let memchr run ahead to the rarest byte; too many false candidates hand over to the sieve
+    const char *base = hay.data();
+    size_t from = i;
+    size_t misses = 0;
+    while (i < end)
+    {
+        const void *hit = std::memchr(base + i + rare1, needle[rare1], end - i);
+        if (!hit)
+        {
+            i = end;
+            return std::string::npos;
+        }
+
+        size_t at = static_cast<const char *>(hit) - base - rare1;
+        if (verify(base + at))
+            return at;
+        i = at + 1;
+
+        if (++misses > 8 && misses * 64 > i - from)
+            break;
+    }
+    return std::string::npos;
+}
+
+#ifdef __SSE2__
+template <bool Fold>
+size_t Finder::sieve(std::string_view hay, size_t i, size_t end) const
+{
+    // Compare candidate starts 16 at a time on their two rarest bytes (both cases when folding)
+    const __m128i rare1a = _mm_set1_epi8(needle[rare1]);
+    const __m128i rare2a = _mm_set1_epi8(needle[rare2]);
+    const __m128i rare1b = _mm_set1_epi8(upper(needle[rare1]));
+    const __m128i rare2b = _mm_set1_epi8(upper(needle[rare2]));
+    const char *base1 = hay.data() + rare1;
+    const char *base2 = hay.data() + rare2;
+
+    auto candidates = [&](size_t at) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(base1 + at));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(base2 + at));
+        __m128i ma = _mm_cmpeq_epi8(a, rare1a);
+        __m128i mb = _mm_cmpeq_epi8(b, rare2a);
+        if constexpr (Fold)
+        {
+            ma = _mm_or_si128(ma, _mm_cmpeq_epi8(a, rare1b));
+            mb = _mm_or_si128(mb, _mm_cmpeq_epi8(b, rare2b));
+        }
+        return _mm_and_si128(ma, mb);
+    };
+
+    while (i + 16 <= end)
+    {
+        // Candidates are rare: test 64 starts per step, with no calls to spill the constants
+        for (; i + 64 <= end; i += 64)
+        {
+            __m128i any = _mm_or_si128(_mm_or_si128(candidates(i), candidates(i + 16)),
+                                       _mm_or_si128(candidates(i + 32), candidates(i + 48)));
+            if (_mm_movemask_epi8(any))
+                break;
+        }
+
+        // Narrow down to 16 starts and verify each candidate among them
+        size_t stop = std::min(i + 64, end);
+        for (; i + 16 <= stop; i += 16)
+        {
+            for (unsigned mask = _mm_movemask_epi8(candidates(i)); mask; mask &= mask - 1)
+            {
+                size_t at = i + __builtin_ctz(mask);
+                if (verify(hay.data() + at))
+                    return at;
+            }
+        }
+    }
+
+    // The last few starts: re-test the final 16, masking off those already ruled out
+    if (i < end && end >= 16)
+    {
+        size_t at = end - 16;
+        unsigned mask = _mm_movemask_epi8(candidates(at)) & (0xffffu << (i - at));
+        for (; mask; mask &= mask - 1)
+        {
+            size_t pos = at + __builtin_ctz(mask);
+            if (verify(hay.data() + pos))
+                return pos;
+        }
+        return end;
+    }
+
+    // Rows too short for a single block are left to the scalar scan
+    size_t found = scan(hay, i, end);
+    return found == std::string::npos ? end : found;
+}
+#endif
+
+size_t Finder::find(std::string_view hay, size_t from) const
+{
+    size_t n = needle.size();
+    if (n == 0 || from > hay.size() || hay.size() - from < n)
+        return std::string::npos;
+
+    // Positions a match may start at: [from, end)
+    size_t end = hay.size() - n + 1;
+    size_t i = from;
+
+    // memchr needs a byte without a second case to look for
+    if (!ignoreCase || lower(needle[rare1]) == upper(needle[rare1]))
+    {
+        size_t found = skim(hay, i, end);
+        if (found != std::string::npos || i >= end)
+            return found;
+    }
+
+#ifdef __SSE2__
+    i = ignoreCase ? sieve<true>(hay, i, end) : sieve<false>(hay, i, end);
+    return i < end ? i : std::string::npos;
+#else
+    return scan(hay, i, end);
+#endif
+}
+
+size_t Finder::find(std::string_view hay, size_t from, size_t &len) const
+{
+    len = needle.size();
+    return find(hay, from);
+}
+
+void Finder::findAll(std::string_view hay, std::vector<std::pair<size_t, size_t>> &out) const
+{
+    out.clear();
+    for (size_t at = find(hay, 0); at != std::string::npos; at = find(hay, at + 1))
+    {
+        out.push_back({at, needle.size()});
+    }
+}
+
+bool Finder::matchesAt(std::string_view hay, size_t pos) const
+{
+    return pos <= hay.size() && hay.size() - pos >= needle.size() && verify(hay.data() + pos);
+}
@@ -0,0 +1,276 @@
+#include <grep.hh>
+#include <finder.hh>
+#include <regex.hh>
+#include <threadpool.hh>
+#include <trace.hh>
+#include <algorithm>
+#include <cstring>
+#include <deque>
+#include <optional>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+struct Grep::Task
+{
+    fs::path path;
+    bool dir;
+};
+
+// Each thread owns one; others only touch its deque, to steal
+struct alignas(64) Grep::Worker
+{
+    std::mutex mutex;
+    std::deque<Task> tasks;
+    std::vector<GrepMatch> found; ///< Matches of the file being scanned.
+};
+
+Grep::Grep(fs::path root, std::string_view query, bool regex) : root(std::move(root))
+{
+    if (regex)
+    {
+        auto re = std::make_shared<Regex>(query, Regex::smartCase(query));
+        err = re->error();
+        pattern = re;
+    }
+    else
+        finder = std::make_shared<Finder>(query, Finder::smartCase(query));
+
+    if (query.empty() || !err.empty())
+    {
+        finished = true;
+        return;
+    }
+    driver = std::thread(&Grep::walk, this);
+}
+
+Grep::~Grep()
+{
+    stopping = true;
+    if (driver.joinable())
+        driver.join();
+}
+
+void Grep::walk()
+{
+    TRACE_SCOPE("Grep::walk");
+    ThreadPool pool(std::max(1u, std::thread::hardware_concurrency()));
+    std::vector<Worker> workers(pool.size());
+    workers[0].tasks.push_back({root, true});
+    pending = 1;
+
+    // Every index runs until the walk is over, so each thread gets one worker and keeps it
+    pool.run(workers.size(), [&](size_t id) { work(workers, id); });
+    finished = true;
+}
+
+void Grep::work(std::vector<Worker> &workers, size_t id)
+{
+    Worker &self = workers[id];
+
+    // A Regex fills in its DFA as it scans, so every thread works on its own copy
+    std::optional<Regex> re;
+    if (pattern)
+        re.emplace(*pattern);
+
+    Task task;
+    while (!stopping.load(std::memory_order_relaxed))
+    {
+        bool got = false;
+        {
+            // Newest first from its own deque, depth first, keeping the deque short
+            std::lock_guard<std::mutex> lock(self.mutex);
+            if (!self.tasks.empty())
+            {
+                task = std::move(self.tasks.back());
+                self.tasks.pop_back();
+                got = true;
+            }
+        }
+        for (size_t i = 1; !got && i < workers.size(); i++)
+        {
+            // Oldest first from another's, the task with the most work behind it
+            Worker &victim = workers[(id + i) % workers.size()];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.tasks.empty())
+            {
+                task = std::move(victim.tasks.front());
+                victim.tasks.pop_front();
+                got = true;
+            }
+        }
+
+        if (!got)
+        {
+            // Tasks still running may list more; the walk is over once none are left at all
+            if (pending.load(std::memory_order_acquire) == 0)
+                return;
+            std::this_thread::yield();
+            continue;
+        }
+
+        if (task.dir)
+            list(self, task.path);
+        else
+            scan(self, task.path, re ? &*re : nullptr);
+        pending.fetch_sub(1, std::memory_order_acq_rel);
+    }
+}
+
+void Grep::list(Worker &self, const fs::path &dir)
+{
+    std::vector<Task> tasks;
+    std::error_code ec;
+    for (fs::directory_iterator it(dir, fs::directory_options::skip_permission_denied, ec), end; !ec && it != end; it.increment(ec))
+    {
+        // Hidden entries such as .git are skipped; symlinks are not followed, so there are no cycles
+        const fs::path &path = it->path();
+        if (path.filename().native().front() == '.')
+            continue;
+
+        std::error_code typeEc;
+        fs::file_type type = it->symlink_status(typeEc).type();
+        if (type == fs::file_type::directory)
+            tasks.push_back({path, true});
+        else if (type == fs::file_type::regular)
+            tasks.push_back({path, false});
+    }
+    if (tasks.empty())
+        return;
+
+    // Counted before the listing task itself is, so pending never drops to 0 early
+    pending.fetch_add(tasks.size(), std::memory_order_acq_rel);
+    std::lock_guard<std::mutex> lock(self.mutex);
+    for (Task &t : tasks)
+        self.tasks.push_back(std::move(t));
+}
+
+void Grep::scan(Worker &self, const fs::path &file, Regex *re)
+{
+    int fd = open(file.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0)
+    {
+        close(fd);
+        return;
+    }
+    void *map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return;
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+    scanned.fetch_add(1, std::memory_order_relaxed);
+
+    std::string_view text(static_cast<const char *>(map), st.st_size);
+    std::string path;
+    auto record = [&](size_t row, size_t start, size_t end, size_t col, size_t len) {
+        if (path.empty())
+            path = file.lexically_relative(root).string();
+        size_t keep = std::min(end - start, MAX_LINE);
+        self.found.push_back({path, row, col, len, std::string(text.substr(start, keep))});
+    };
+
+    if (!std::memchr(text.data(), '\0', std::min<size_t>(text.size(), 8192)))
+    {
+        if (re)
+        {
+            // Patterns anchor to rows, so they are matched one row at a time
+            size_t row = 0;
+            for (size_t start = 0; start < text.size(); row++)
+            {
+                const char *nl = static_cast<const char *>(std::memchr(text.data() + start, '\n', text.size() - start));
+                size_t end = nl ? nl - text.data() : text.size();
+                size_t len;
+                size_t col = re->find(text.substr(start, end - start), 0, len);
+                if (col != std::string::npos)
+                    record(row, start, end, col, len);
+                start = end + 1;
+            }
+        }
+        else
+        {
+            // A literal never spans rows, so the whole file is searched at once and rows are counted
+            // only up to each match; after one, the search resumes on the next row
+            size_t row = 0, lineStart = 0;
+            for (size_t at = finder->find(text, 0); at != std::string::npos; at = finder->find(text, lineStart))
+            {
+                row += std::count(text.begin() + lineStart, text.begin() + at, '\n');
+                const void *prev = memrchr(text.data() + lineStart, '\n', at - lineStart);
+                if (prev)
+                    lineStart = static_cast<const char *>(prev) - text.data() + 1;
+
+                const char *nl = static_cast<const char *>(std::memchr(text.data() + at, '\n', text.size() - at));
+                size_t end = nl ? nl - text.data() : text.size();
+                record(row, lineStart, end, at - lineStart, finder->size());
+                if (!nl || stopping.load(std::memory_order_relaxed))
+                    break;
+                row++;
+                lineStart = end + 1;
+            }
+        }
+    }
+    munmap(map, st.st_size);
+
+    if (self.found.empty())
+        return;
+    std::lock_guard<std::mutex> lock(mutex);
+    size_t room = MAX_MATCHES - std::min(MAX_MATCHES, count.load(std::memory_order_relaxed));
+    if (self.found.size() >= room)
+    {
+        self.found.resize(room);
+        capped = true;
+        stopping = true;
+    }
+    std::move(self.found.begin(), self.found.end(), std::back_inserter(found));
+    count.fetch_add(self.found.size(), std::memory_order_relaxed);
+    self.found.clear();
+}
+
+void Grep::take(std::vector<GrepMatch> &out, size_t max)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    size_t n = std::min(max, found.size() - head);
+    std::move(found.begin() + head, found.begin() + head + n, std::back_inserter(out));
+    head += n;
+    if (head == found.size())
+    {
+        found.clear();
+        head = 0;
+    }
+}
+
+void Grep::wait()
+{
+    if (driver.joinable())
+        driver.join();
+}
+
+bool Grep::done() const
+{
+    return finished.load(std::memory_order_acquire);
+}
+
+size_t Grep::files() const
+{
+    return scanned.load(std::memory_order_relaxed);
+}
+
+size_t Grep::matches() const
+{
+    return count.load(std::memory_order_relaxed);
+}
+
+bool Grep::truncated() const
+{
+    return capped.load(std::memory_order_relaxed);
+}
+
+const std::string &Grep::error() const
+{
+    return err;
+}
@@ -7,16 +7,23 @@
 #include <cctype>
 #include <optional>
 #include <commands.hh>
+#include <perf.hh>
 
 void InputHandler::moveCursor(TTEdCursor &cursor, TTEdFileData &fData, int c)
 {
     std::shared_ptr<Row> data = cursor.cy >= fData.size() ? nullptr : fData.at(cursor.cy);
 
+    // Vertical moves step over folded rows through the visual line index
+    if (fData.folds > 0)
+    {
+        fData.syncLines(fData.linesWidth);
+    }
+
     switch (c)
     {
     case ARROW_UP:
         if (cursor.cy > 0)
-            cursor.cy--;
+            cursor.cy = fData.prevVisible(cursor.cy);
         break;
     case ARROW_LEFT:
         if (cursor.cx > 0)
@@ -25,13 +32,13 @@ void InputHandler::moveCursor(TTEdCursor &cursor, TTEdFileData &fData, int c)
         }
         else if (cursor.cy > 0)
         {
-            cursor.cy--;
+            cursor.cy = fData.prevVisible(cursor.cy);
             cursor.cx = fData.at(cursor.cy)->sRaw.size();
         }
         break;
     case ARROW_DOWN:
         if (cursor.cy < fData.size())
-            cursor.cy++;
+            cursor.cy = fData.nextVisible(cursor.cy);
         break;
     case ARROW_RIGHT:
         if (data && cursor.cx < data->sRaw.size())
@@ -40,7 +47,7 @@ void InputHandler::moveCursor(TTEdCursor &cursor, TTEdFileData &fData, int c)
         }
         else if (data && cursor.cx == data->sRaw.size())
         {
-            cursor.cy++;
+            cursor.cy = fData.nextVisible(cursor.cy);
             cursor.cx = 0;
         }
         break;
@@ -105,11 +112,13 @@ int InputHandler::processKey(Config &cfg, bool breakAny)
     switch (cfg.mod.c)
     {
     case '\r': // Newline
+        if (cfg.grep.showing)
+            return procval::GREPOPEN; // The grep results are read-only; Enter opens a match
         cfg.fileData.insertNewLine(cfg.cursor);
         return procval::PROMPTMOD;
     case K_CTRL('q'):
     {
-        if (cfg.fileData.modified && quitStroke > 0)
+        if ((cfg.fileData.modified || cfg.grep.other.modified) && quitStroke > 0)
         {
             cfg.status.setStatusMsg("UNSAVED CHANGES | Press quit again to discard changes");
             quitStroke--;
@@ -128,9 +137,54 @@ int InputHandler::processKey(Config &cfg, bool breakAny)
     case K_CTRL('b'):
         return procval::PROMPTCONNECT;
 
+    case K_CTRL('e'):
+        return procval::MEMREPORT;
+
+    case K_CTRL('w'):
+        cfg.term.softWrap = !cfg.term.softWrap;
+        cfg.fileData.linesDirty = true;
+        cfg.cursor.cOffset = 0;
+        if (cfg.term.softWrap)
+        {
+            // Keep the same top row on screen
+            cfg.fileData.syncLines(cfg.term.textCols());
+            cfg.cursor.vOffset = cfg.fileData.lines.prefix(std::min(cfg.cursor.rOffset, cfg.fileData.size()));
+        }
+        cfg.status.setStatusMsg(cfg.term.softWrap ? "Soft wrap on" : "Soft wrap off");
+        break;
+
+    case K_CTRL('k'):
+        return procval::PROMPTFOLD;
+
+    case K_CTRL('r'):
+        if (cfg.grep.showing)
+            break;
+        return procval::PROMPTREPLACE;
+
+    case K_CTRL('g'):
+        return procval::PROMPTGREP;
+
+    case K_CTRL('p'):
+        Perf::toggle();
+        break;
+
     case PAGE_UP:
     case PAGE_DOWN:
     {
+        if (cfg.term.softWrap || cfg.fileData.folds > 0)
+        {
+            // Page by screen lines: one lookup in the visual line index, however many rows are folded
+            auto &fData = cfg.fileData;
+            fData.syncLines(fData.linesWidth);
+            size_t total = fData.lines.total();
+            size_t top = cfg.cursor.vOffset;
+            size_t line = c == PAGE_UP ? (top > cfg.term.sRow ? top - cfg.term.sRow : 0)
+                                       : top + 2 * cfg.term.sRow - 1;
+            cfg.cursor.cy = line < total ? fData.lines.find(line).first : fData.size();
+            moveCursor(cfg.cursor, fData, 0); // Clamp cx to the new row
+            break;
+        }
+
         if (c == PAGE_UP)
         {
             cfg.cursor.cy = cfg.cursor.rOffset;
@@ -163,6 +217,8 @@ int InputHandler::processKey(Config &cfg, bool breakAny)
     case BACKSPACE:
     case K_CTRL('h'):
     case DEL:
+        if (cfg.grep.showing)
+            break;
         if (c == DEL)
             moveCursor(cfg.cursor, cfg.fileData, ARROW_RIGHT); // Move cursor to the right for DEL
         cfg.fileData.deleteChar(cfg.cursor);
@@ -173,12 +229,17 @@ int InputHandler::processKey(Config &cfg, bool breakAny)
     case ARROW_RIGHT:
         moveCursor(cfg.cursor, cfg.fileData, c);
         break;
-    case K_CTRL('l'):
     case '\x1b':
+        if (cfg.grep.showing)
+            return procval::GREPBACK;
+        break;
+    case K_CTRL('l'):
         // No action needed for these keys
         break;
     default:
         // Handle other keys by inserting them
+        if (cfg.grep.showing)
+            break;
         if (c >= 0 && c < 128)
         {
             cfg.fileData.insertChar(cfg.cursor, static_cast<char>(c));
@@ -4,6 +4,15 @@
 #include <errmgr.hh>
 #include <config.hh>
 #include <fcntl.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+
+static int wakeFd = -1;
+
+void InputReader::wakeOn(int fd) {
+    wakeFd = fd;
+}
 
 int InputReader::readKey() {
     char c;
@@ -17,13 +26,22 @@ int InputReader::readKey() {
     timeout.tv_sec = 0;
     timeout.tv_usec = 5000; // Timeout in microseconds
 
-    // Wait for input on STDIN using select
-    int ready = select(STDIN_FILENO + 1, &readfds, nullptr, nullptr, &timeout);
+    // Wait for input on STDIN using select, or for the network thread to wake us
+    fd_set waitfds = readfds;
+    if (wakeFd >= 0)
+        FD_SET(wakeFd, &waitfds);
+    int ready = select(std::max(STDIN_FILENO, wakeFd) + 1, &waitfds, nullptr, nullptr, &timeout);
     if (ready == -1) {
         ErrorMgr::err("select");
     } else if (ready == 0) {
         return -1; // Timeout, no input
     }
+    if (!FD_ISSET(STDIN_FILENO, &waitfds)) {
+        uint64_t count;
+        if (read(wakeFd, &count, sizeof(count)) < 0 && errno != EAGAIN)
+            ErrorMgr::err("read");
+        return -1;
+    }
 
     // Read the input character
     r = read(STDIN_FILENO, &c, sizeof(c));
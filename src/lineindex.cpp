@@ -0,0 +1,502 @@
+#include <lineindex.hh>
+#include <algorithm>
+#include <stdexcept>
+
+uint32_t LineIndex::random()
+{
+    // xorshift32: priorities only need to look random to keep the tree balanced
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    return seed;
+}
+
+uint32_t LineIndex::alloc(size_t count)
+{
+    uint32_t t;
+    if (!spare.empty())
+    {
+        t = spare.back();
+        spare.pop_back();
+    }
+    else
+    {
+        t = nodes.size();
+        nodes.emplace_back();
+    }
+    nodes[t] = Node{};
+    nodes[t].prio = random();
+    nodes[t].count = nodes[t].sum = count;
+    return t;
+}
+
+void LineIndex::release(uint32_t t)
+{
+    // Iterative, as a subtree of erased rows may be arbitrarily deep on one side
+    std::vector<uint32_t> stack;
+    if (t != NIL)
+        stack.push_back(t);
+    while (!stack.empty())
+    {
+        uint32_t u = stack.back();
+        stack.pop_back();
+        if (nodes[u].left != NIL)
+            stack.push_back(nodes[u].left);
+        if (nodes[u].right != NIL)
+            stack.push_back(nodes[u].right);
+        spare.push_back(u);
+    }
+}
+
+uint32_t LineIndex::rowsOf(uint32_t t) const
+{
+    return t == NIL ? 0 : nodes[t].rows;
+}
+
+size_t LineIndex::shownOf(uint32_t t, int32_t above) const
+{
+    // Only rows no fold covers are shown, and they are at the subtree's least depth when any are
+    return t == NIL || nodes[t].low + above != 0 ? 0 : nodes[t].sum;
+}
+
+void LineIndex::apply(uint32_t t, int32_t delta)
+{
+    if (t == NIL)
+    {
+        return;
+    }
+    nodes[t].depth += delta;
+    nodes[t].low += delta;
+    nodes[t].lazy += delta;
+}
+
+void LineIndex::push(uint32_t t)
+{
+    if (nodes[t].lazy != 0)
+    {
+        apply(nodes[t].left, nodes[t].lazy);
+        apply(nodes[t].right, nodes[t].lazy);
+        nodes[t].lazy = 0;
+    }
+}
+
+void LineIndex::pull(uint32_t t)
+{
+    Node &n = nodes[t];
+    size_t left = rowsOf(n.left);
+    n.rows = left + 1 + rowsOf(n.right);
+    n.low = n.depth;
+    n.lowRows = 1;
+    n.sum = n.count;
+    for (uint32_t c : {n.left, n.right})
+    {
+        if (c == NIL)
+            continue;
+        int32_t low = nodes[c].low + n.lazy;
+        if (low < n.low)
+        {
+            n.low = low;
+            n.lowRows = nodes[c].lowRows;
+            n.sum = nodes[c].sum;
+        }
+        else if (low == n.low)
+        {
+            n.lowRows += nodes[c].lowRows;
+            n.sum += nodes[c].sum;
+        }
+    }
+
+    n.reach = n.left == NIL ? -1 : nodes[n.left].reach;
+    if (n.fold > 0)
+        n.reach = std::max<int64_t>(n.reach, left + n.fold);
+    if (n.right != NIL && nodes[n.right].reach >= 0)
+        n.reach = std::max<int64_t>(n.reach, left + 1 + nodes[n.right].reach);
+}
+
+void LineIndex::heapify(uint32_t t)
+{
+    // Sift the priority down rather than the node, so the balanced shape is kept
+    while (true)
+    {
+        uint32_t top = t;
+        for (uint32_t c : {nodes[t].left, nodes[t].right})
+        {
+            if (c != NIL && nodes[c].prio > nodes[top].prio)
+                top = c;
+        }
+        if (top == t)
+            return;
+        std::swap(nodes[t].prio, nodes[top].prio);
+        t = top;
+    }
+}
+
+uint32_t LineIndex::build(const std::vector<size_t> &rowCounts, const std::vector<int32_t> &depths,
+                          const std::vector<size_t> &folds, size_t begin, size_t end)
+{
+    if (begin == end)
+    {
+        return NIL;
+    }
+    size_t mid = begin + (end - begin) / 2;
+    uint32_t t = alloc(rowCounts[mid]);
+    uint32_t left = build(rowCounts, depths, folds, begin, mid);
+    uint32_t right = build(rowCounts, depths, folds, mid + 1, end);
+    nodes[t].left = left;
+    nodes[t].right = right;
+    nodes[t].depth = depths.empty() ? 0 : depths[mid];
+    nodes[t].fold = folds.empty() ? 0 : folds[mid];
+    pull(t);
+    heapify(t);
+    return t;
+}
+
+std::pair<uint32_t, uint32_t> LineIndex::split(uint32_t t, size_t k)
+{
+    if (t == NIL)
+    {
+        return {NIL, NIL};
+    }
+    push(t);
+    if (k <= rowsOf(nodes[t].left))
+    {
+        auto [a, b] = split(nodes[t].left, k);
+        nodes[t].left = b;
+        pull(t);
+        return {a, t};
+    }
+    auto [a, b] = split(nodes[t].right, k - rowsOf(nodes[t].left) - 1);
+    nodes[t].right = a;
+    pull(t);
+    return {t, b};
+}
+
+uint32_t LineIndex::merge(uint32_t a, uint32_t b)
+{
+    if (a == NIL || b == NIL)
+    {
+        return a == NIL ? b : a;
+    }
+    if (nodes[a].prio > nodes[b].prio)
+    {
+        push(a);
+        nodes[a].right = merge(nodes[a].right, b);
+        pull(a);
+        return a;
+    }
+    push(b);
+    nodes[b].left = merge(a, nodes[b].left);
+    pull(b);
+    return b;
+}
+
+void LineIndex::build(std::vector<size_t> rowCounts, const std::vector<size_t> &rowFolds)
+{
+    // Each fold adds one to the depth of the rows it covers, summed in one sweep
+    size_t n = rowCounts.size();
+    std::vector<int32_t> depths;
+    std::vector<size_t> folds;
+    if (!rowFolds.empty())
+    {
+        std::vector<int32_t> diff(n + 1, 0);
+        folds.assign(n, 0);
+        for (size_t h = 0; h < n; h++)
+        {
+            folds[h] = std::min(rowFolds[h], n - h - 1);
+            if (folds[h] > 0)
+            {
+                diff[h + 1]++;
+                diff[h + folds[h] + 1]--;
+            }
+        }
+        depths.assign(n, 0);
+        int32_t depth = 0;
+        for (size_t i = 0; i < n; i++)
+        {
+            depth += diff[i];
+            depths[i] = depth;
+        }
+    }
+
+    nodes.clear();
+    spare.clear();
+    nodes.reserve(n);
+    root = build(rowCounts, depths, folds, 0, n);
+}
+
+void LineIndex::insert(size_t row, const std::vector<size_t> &rowCounts)
+{
+    auto [a, b] = split(root, row);
+    root = merge(merge(a, build(rowCounts, {}, {}, 0, rowCounts.size())), b);
+}
+
+void LineIndex::erase(size_t row, size_t n)
+{
+    auto [a, rest] = split(root, row);
+    auto [gone, b] = split(rest, n);
+    release(gone);
+    root = merge(a, b);
+}
+
+uint32_t LineIndex::descend(size_t row, std::vector<uint32_t> &path)
+{
+    if (row >= size())
+    {
+        throw std::out_of_range("LineIndex::descend");
+    }
+    for (uint32_t t = root;;)
+    {
+        push(t);
+        path.push_back(t);
+        size_t left = rowsOf(nodes[t].left);
+        if (row == left)
+            return t;
+        if (row < left)
+        {
+            t = nodes[t].left;
+        }
+        else
+        {
+            row -= left + 1;
+            t = nodes[t].right;
+        }
+    }
+}
+
+void LineIndex::cover(size_t row, size_t n, int32_t delta)
+{
+    // Cut out the covered rows and adjust their depth at the root of their subtree only
+    auto [a, rest] = split(root, row);
+    auto [mid, b] = split(rest, n);
+    apply(mid, delta);
+    root = merge(merge(a, mid), b);
+}
+
+void LineIndex::covering(uint32_t t, size_t base, size_t row, std::vector<size_t> &out) const
+{
+    // Skip subtrees starting at or after the row, or with no fold reaching it
+    if (t == NIL || base >= row || nodes[t].reach < 0 || base + nodes[t].reach < row)
+    {
+        return;
+    }
+    covering(nodes[t].left, base, row, out);
+    size_t header = base + rowsOf(nodes[t].left);
+    if (header < row && nodes[t].fold > 0 && header + nodes[t].fold >= row)
+    {
+        out.push_back(header);
+    }
+    covering(nodes[t].right, header + 1, row, out);
+}
+
+size_t LineIndex::rowsAt(uint32_t t, size_t base, size_t begin, size_t end, int32_t above, int32_t depth) const
+{
+    // Subtrees inside the range answer from their summary, so only the two edges are descended
+    if (t == NIL || base >= end || base + nodes[t].rows <= begin)
+    {
+        return 0;
+    }
+    if (begin <= base && base + nodes[t].rows <= end)
+    {
+        return nodes[t].low + above == depth ? nodes[t].lowRows : 0;
+    }
+    size_t header = base + rowsOf(nodes[t].left);
+    int32_t below = above + nodes[t].lazy;
+    size_t own = header >= begin && header < end && nodes[t].depth + above == depth ? 1 : 0;
+    return rowsAt(nodes[t].left, base, begin, end, below, depth) + own +
+           rowsAt(nodes[t].right, header + 1, begin, end, below, depth);
+}
+
+size_t LineIndex::size() const
+{
+    return rowsOf(root);
+}
+
+size_t LineIndex::bytes() const
+{
+    return nodes.capacity() * sizeof(Node) + spare.capacity() * sizeof(uint32_t);
+}
+
+size_t LineIndex::count(size_t row) const
+{
+    if (row >= size())
+    {
+        throw std::out_of_range("LineIndex::count");
+    }
+
+    // Folds not yet pushed down are summed on the way to the row
+    int32_t above = 0;
+    for (uint32_t t = root;;)
+    {
+        size_t left = rowsOf(nodes[t].left);
+        if (row == left)
+            return nodes[t].depth + above == 0 ? nodes[t].count : 0;
+        above += nodes[t].lazy;
+        if (row < left)
+        {
+            t = nodes[t].left;
+        }
+        else
+        {
+            row -= left + 1;
+            t = nodes[t].right;
+        }
+    }
+}
+
+void LineIndex::set(size_t row, size_t n)
+{
+    // Walk down to the row, then recompute the subtrees containing it
+    std::vector<uint32_t> path;
+    nodes[descend(row, path)].count = n;
+    for (size_t i = path.size(); i-- > 0;)
+    {
+        pull(path[i]);
+    }
+}
+
+void LineIndex::fold(size_t header, size_t len)
+{
+    std::vector<uint32_t> path;
+    nodes[descend(header, path)].fold = len;
+    for (size_t i = path.size(); i-- > 0;)
+    {
+        pull(path[i]);
+    }
+    cover(header + 1, len, 1);
+}
+
+void LineIndex::unfold(size_t header)
+{
+    std::vector<uint32_t> path;
+    uint32_t t = descend(header, path);
+    size_t len = nodes[t].fold;
+    if (len == 0)
+    {
+        return;
+    }
+    nodes[t].fold = 0;
+    for (size_t i = path.size(); i-- > 0;)
+    {
+        pull(path[i]);
+    }
+    cover(header + 1, len, -1);
+}
+
+bool LineIndex::hidden(size_t row) const
+{
+    if (row >= size())
+    {
+        throw std::out_of_range("LineIndex::hidden");
+    }
+    int32_t above = 0;
+    for (uint32_t t = root;;)
+    {
+        size_t left = rowsOf(nodes[t].left);
+        if (row == left)
+            return nodes[t].depth + above > 0;
+        above += nodes[t].lazy;
+        if (row < left)
+        {
+            t = nodes[t].left;
+        }
+        else
+        {
+            row -= left + 1;
+            t = nodes[t].right;
+        }
+    }
+}
+
+std::vector<size_t> LineIndex::covering(size_t row) const
+{
+    std::vector<size_t> out;
+    covering(root, 0, row, out);
+    return out;
+}
+
+size_t LineIndex::revealed(size_t header) const
+{
+    if (header >= size())
+    {
+        throw std::out_of_range("LineIndex::revealed");
+    }
+    size_t len = 0, row = header;
+    for (uint32_t t = root;;)
+    {
+        size_t left = rowsOf(nodes[t].left);
+        if (row == left)
+        {
+            len = nodes[t].fold;
+            break;
+        }
+        if (row < left)
+        {
+            t = nodes[t].left;
+        }
+        else
+        {
+            row -= left + 1;
+            t = nodes[t].right;
+        }
+    }
+
+    // The fold's own rows are all at depth 1 or more; those at exactly 1 have no other fold over them
+    return len == 0 ? 0 : rowsAt(root, 0, header + 1, header + 1 + len, 0, 1);
+}
+
+size_t LineIndex::prefix(size_t row) const
+{
+    size_t sum = 0;
+    int32_t above = 0;
+    for (uint32_t t = root; t != NIL;)
+    {
+        size_t left = rowsOf(nodes[t].left);
+        int32_t below = above + nodes[t].lazy;
+        if (row <= left)
+        {
+            t = nodes[t].left;
+            above = below;
+            continue;
+        }
+        sum += shownOf(nodes[t].left, below) + (nodes[t].depth + above == 0 ? nodes[t].count : 0);
+        row -= left + 1;
+        t = nodes[t].right;
+        above = below;
+    }
+    return sum;
+}
+
+size_t LineIndex::total() const
+{
+    return shownOf(root, 0);
+}
+
+std::pair<size_t, size_t> LineIndex::find(size_t line) const
+{
+    // Descend towards the line, counting the rows passed on the way
+    size_t pos = 0;
+    int32_t above = 0;
+    for (uint32_t t = root; t != NIL;)
+    {
+        int32_t below = above + nodes[t].lazy;
+        size_t left = shownOf(nodes[t].left, below);
+        if (line < left)
+        {
+            t = nodes[t].left;
+            above = below;
+            continue;
+        }
+        line -= left;
+        pos += rowsOf(nodes[t].left);
+        size_t own = nodes[t].depth + above == 0 ? nodes[t].count : 0;
+        if (line < own)
+        {
+            return {pos, line};
+        }
+        line -= own;
+        pos++;
+        t = nodes[t].right;
+        above = below;
+    }
+    return {pos, line};
+}
@@ -0,0 +1,175 @@
+#include <lz.hh>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+static constexpr size_t MIN_MATCH = 4;
+static constexpr size_t MAX_OFFSET = 65535;
+static constexpr int HASH_BITS = 16;
+static constexpr size_t SLACK = 16; ///< Bytes decompress may scribble past the end of its output.
+
+static inline uint32_t load32(const char *p)
+{
+    uint32_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint32_t hash4(uint32_t v)
+{
+    return (v * 2654435761u) >> (32 - HASH_BITS);
+}
+
+// A length past what fits in a nibble continues in bytes of up to 255
+static void putLength(std::string &out, size_t len)
+{
+    for (; len >= 255; len -= 255)
+        out += static_cast<char>(255);
+    out += static_cast<char>(len);
+}
+
+static void putSequence(std::string &out, std::string_view literals, size_t offset, size_t matchLen)
+{
+    size_t lit = literals.size();
+    size_t match = matchLen ? matchLen - MIN_MATCH : 0;
+    out += static_cast<char>((std::min<size_t>(lit, 15) << 4) | std::min<size_t>(match, 15));
+    if (lit >= 15)
+        putLength(out, lit - 15);
+    out += literals;
+    if (matchLen == 0)
+        return;
+
+    out += static_cast<char>(offset & 0xff);
+    out += static_cast<char>(offset >> 8);
+    if (match >= 15)
+        putLength(out, match - 15);
+}
+
+void Lz::compress(std::string_view in, std::string &out)
+{
+    const char *base = in.data();
+    size_t n = in.size();
+    std::vector<uint32_t> table(size_t(1) << HASH_BITS, 0); // Position + 1 of the last prefix with each hash
+
+    size_t anchor = 0; // Start of the literals not yet emitted
+    size_t i = 0;
+    while (i + MIN_MATCH <= n)
+    {
+        uint32_t seq = load32(base + i);
+        uint32_t &slot = table[hash4(seq)];
+        size_t cand = slot;
+        slot = i + 1;
+
+        if (cand == 0 || i - (cand - 1) > MAX_OFFSET || load32(base + cand - 1) != seq)
+        {
+            // The longer nothing matches, the bigger the steps, so incompressible data goes by fast
+            i += 1 + ((i - anchor) >> 6);
+            continue;
+        }
+
+        // Extend the match 8 bytes at a time, the first differing byte found from the XOR
+        size_t from = cand - 1;
+        size_t len = MIN_MATCH;
+        while (i + len + 8 <= n)
+        {
+            uint64_t a, b;
+            std::memcpy(&a, base + from + len, 8);
+            std::memcpy(&b, base + i + len, 8);
+            if (a != b)
+            {
+                uint64_t diff = a ^ b;
+                len += (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__ ? __builtin_ctzll(diff) : __builtin_clzll(diff)) >> 3;
+                goto matched;
+            }
+            len += 8;
+        }
+        while (i + len < n && base[from + len] == base[i + len])
+            len++;
+    matched:
+
+        putSequence(out, in.substr(anchor, i - anchor), i - from, len);
+        i += len;
+        anchor = i;
+
+        // Index a position inside the match too, so the next repeat of it is found
+        if (i + 2 <= n)
+            table[hash4(load32(base + i - 2))] = i - 1;
+    }
+    putSequence(out, in.substr(anchor), 0, 0);
+}
+
+bool Lz::decompress(std::string_view in, size_t rawLen, std::string &out)
+{
+    // Decode straight into the final buffer; a malformed block leaves out as it was. The slack
+    // past the end lets short copies move a fixed 16 bytes, which is much cheaper than memcpy(len)
+    size_t start = out.size();
+    out.resize(start + rawLen + SLACK);
+    char *dst = out.data() + start;
+    size_t pos = 0;
+
+    const unsigned char *p = reinterpret_cast<const unsigned char *>(in.data());
+    const unsigned char *end = p + in.size();
+    auto getLength = [&](size_t &len) {
+        while (p < end)
+        {
+            unsigned char b = *p++;
+            len += b;
+            if (b != 255)
+                return true;
+        }
+        return false;
+    };
+    auto fail = [&] {
+        out.resize(start);
+        return false;
+    };
+
+    while (p < end)
+    {
+        unsigned char token = *p++;
+        size_t lit = token >> 4;
+        if (lit == 15 && !getLength(lit))
+            return fail();
+        if (size_t(end - p) < lit || rawLen - pos < lit)
+            return fail();
+        if (lit <= 16 && end - p >= 16)
+            std::memcpy(dst + pos, p, 16);
+        else
+            std::memcpy(dst + pos, p, lit);
+        pos += lit;
+        p += lit;
+
+        // The last sequence has no match
+        if (p == end)
+            break;
+
+        if (end - p < 2)
+            return fail();
+        size_t offset = p[0] | size_t(p[1]) << 8;
+        p += 2;
+        size_t len = token & 15;
+        if (len == 15 && !getLength(len))
+            return fail();
+        len += MIN_MATCH;
+        if (offset == 0 || offset > pos || rawLen - pos < len)
+            return fail();
+
+        // Matches may overlap what they copy, so a short offset repeats a pattern
+        const char *from = dst + pos - offset;
+        if (offset >= 16 && len <= 16)
+            std::memcpy(dst + pos, from, 16);
+        else if (offset >= len)
+            std::memcpy(dst + pos, from, len);
+        else if (offset >= 8)
+            for (size_t k = 0; k < len; k += 8)
+                std::memcpy(dst + pos + k, from + k, 8);
+        else
+            for (size_t k = 0; k < len; k++)
+                dst[pos + k] = from[k];
+        pos += len;
+    }
+    if (pos != rawLen)
+        return fail();
+    out.resize(start + rawLen);
+    return true;
+}
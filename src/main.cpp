@@ -9,10 +9,15 @@
 #include <commands.hh>
 #include <fcntl.h>
 #include <inreader.hh>
+#include <perf.hh>
+#include <trace.hh>
+
+#define TRACE_FILE "tinyted.trace.json"
 
 const std::map<char, std::string> commands = {
     {'v', "Launches TinyTEd in verbose mode"},
     {'h', "Lists launch options for TinyTEd"},
+    {'t', "Records a Chrome trace of hot paths to " TRACE_FILE},
 };
 
 /**
@@ -39,6 +44,14 @@ void processInput(TerminalGUI &gui, Config &config, int argc, char *argv[])
                 case 'v':
                     gui.splashScreen();
                     break;
+                case 't':
+#ifdef TTED_TRACE
+                    Trace::start(TRACE_FILE);
+#else
+                    std::cerr << "Tracing disabled at build time, rebuild with make TRACE=1" << std::endl;
+                    exit(1);
+#endif
+                    break;
                 case 'h':
                     std::cout << "TinyTEd Help Page:\r\n";
                     for (const auto &[key, description] : commands)
@@ -57,7 +70,7 @@ void processInput(TerminalGUI &gui, Config &config, int argc, char *argv[])
         else
         {
             // Assume argument is a filename
-            if (!FileIO::openFile(config, arg))
+            if (FileIO::openFile(config, arg) < 0)
             {
                 std::cerr << "Failed to open file: " << arg << std::endl;
                 exit(1);
@@ -73,40 +86,35 @@ int main(int argc, char *argv[])
 
     config.term.enterRaw();
     config.term.getWindowSize();
+    config.term.detectSyncOutput();
 
     terminalGUI.reset();
     processInput(terminalGUI, config, argc, argv);
     config.status.setStatusMsg("HELP: Ctrl-Q = quit");
 
+    // Frames are composed here and presented on their own thread at the refresh cadence
+    terminalGUI.startRenderThread();
+
+    // Waiting for a key ends early when the network thread has something for the editor
+    InputReader::wakeOn(config.net.wakeFd());
+
     // // Non blocking keystroke read
     // int flags = fcntl(STDIN_FILENO, F_GETFL, 0);
     // fcntl(STDIN_FILENO, F_SETFL, flags | O_NONBLOCK);
     while (true) {
-        // Handle incoming data from the server if connected
-        if (config.conn.connected) {
-            while (config.recv() > 0) {
-                config.status.setStatusMsg("recv at " + std::to_string(config.mod.x) + ", " + std::to_string(config.mod.x));
-                size_t copyX = config.cursor.cx;
-                size_t copyY = config.cursor.cy;
-                size_t copyRX = config.cursor.rx;
-
-                // Adjust cursor
-                config.cursor.cy = config.mod.y;
-                config.cursor.cx = config.mod.x;
-                config.cursor.rx = config.mod.rx;
-                terminalGUI.updateCursor(config.cursor);
-
-                // Process the input received from the server
-                InputHandler::processKey(config);
-
-                // Reset cursor to original position
-                config.cursor.cx = copyX;
-                config.cursor.cy = copyY;
-                config.cursor.rx = copyRX;
-                terminalGUI.updateCursor(config.cursor);
+        // Apply what the network thread received; it sends and batches on its own
+        {
+            TRACE_SCOPE("collab.recv");
+            Perf::Timer timer(Perf::NET_RECV);
+            if (config.recv() == 0)
+            {
+                timer.cancel();
             }
         }
 
+        // Stream project grep matches into the results buffer
+        Commands::ProjectSearch::poll(config);
+
         // Draw the terminal UI
         terminalGUI.draw();
 
@@ -120,7 +128,13 @@ int main(int argc, char *argv[])
         config.mod.y = config.cursor.cy;
         config.mod.rx = config.cursor.rx;
 
-        switch (InputHandler::processKey(config)) {
+        int result;
+        {
+            Perf::Timer timer(Perf::INPUT);
+            result = InputHandler::processKey(config);
+        }
+
+        switch (result) {
             case InputHandler::procval::FAILURE:
                 goto exit;
                 break;
@@ -135,40 +149,58 @@ int main(int argc, char *argv[])
 
             case InputHandler::procval::PROMPTSERVER:
                 Commands::LaunchServer::run(terminalGUI, config);
-                if (fcntl(config.conn.sockfd, F_SETFL, O_NONBLOCK) < 0) {
-                    std::cerr << "fcntl error" << std::endl;
-                }
                 break;
 
             case InputHandler::procval::PROMPTCONNECT:
                 Commands::ConnectServer::run(terminalGUI, config);
-                if (fcntl(config.conn.sockfd, F_SETFL, O_NONBLOCK) < 0) {
-                    std::cerr << "fcntl error" << std::endl;
-                }
                 break;
 
-            case InputHandler::procval::SHUTDOWN:
-                goto exit;
+            case InputHandler::procval::MEMREPORT:
+                Commands::MemReport::run(terminalGUI, config);
                 break;
 
-            case InputHandler::procval::PROMPTMOD:
-                if (config.conn.connected) {
-                    send(config.conn.sockfd, &config.mod, sizeof(config.mod), 0);
-                }
+            case InputHandler::procval::PROMPTFOLD:
+                Commands::Fold::run(terminalGUI, config);
+                break;
+
+            case InputHandler::procval::PROMPTREPLACE:
+                Commands::Replace::run(terminalGUI, config);
+                break;
+
+            case InputHandler::procval::PROMPTGREP:
+                Commands::ProjectSearch::run(terminalGUI, config);
+                break;
+
+            case InputHandler::procval::GREPOPEN:
+                Commands::ProjectSearch::open(config);
+                break;
+
+            case InputHandler::procval::GREPBACK:
+                Commands::ProjectSearch::back(config);
+                break;
+
+            case InputHandler::procval::SHUTDOWN:
+                goto exit;
                 break;
 
             default:
                 break;
         }
-    }
 
-    exit:
-    if (config.conn.connected) {
-        config.conn.connected = false;
-        close(config.conn.sockfd);
+        // Whatever the key changed in the rows is sent as operations on the shared sequence
+        if (config.fileData.journaling)
+        {
+            config.share();
+        }
     }
 
+    exit:
+    config.net.stop();
+    config.grep.job.reset(); // Stops and joins the project grep, if any
     terminalGUI.reset();
+
+    // Every traced thread has stopped, so no ring is written while the trace is saved
+    Trace::stop();
     config.term.exitRaw();
     return 0;
 
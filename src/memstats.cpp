@@ -0,0 +1,96 @@
+#include <memstats.hh>
+#include <cstdio>
+
+// Bytes a std::string keeps on the heap; short strings live inside the object
+static size_t heapBytes(const std::string &s)
+{
+    static const size_t inlineCapacity = std::string().capacity();
+    return s.capacity() > inlineCapacity ? s.capacity() + 1 : 0;
+}
+
+// make_shared places the reference counts next to the object in one allocation
+struct ControlBlock
+{
+    void *vtable;
+    int shared;
+    int weak;
+};
+
+size_t MemStats::Breakdown::total() const
+{
+    return rawText + render + highlight + layout + search + rows + undo + crdt + network;
+}
+
+std::string MemStats::Breakdown::summary() const
+{
+    return "mem " + formatBytes(total()) +
+           ": text " + formatBytes(rawText) +
+           " render " + formatBytes(render) +
+           " hl " + formatBytes(highlight) +
+           " layout " + formatBytes(layout) +
+           " search " + formatBytes(search) +
+           " rows " + formatBytes(rows) +
+           " undo " + formatBytes(undo) +
+           " crdt " + formatBytes(crdt) +
+           " net " + formatBytes(network);
+}
+
+static void collectFile(const TTEdFileData &file, MemStats::Breakdown &b)
+{
+    const auto &rows = file.fileData;
+    b.rows += rows.capacity() * sizeof(std::shared_ptr<Row>);
+    for (const auto &row : rows)
+    {
+        b.rawText += heapBytes(row->sRaw);
+        b.render += heapBytes(row->sRender);
+        if (row->image)
+        {
+            b.render += sizeof(RowImage) + heapBytes(row->image->text) + heapBytes(row->image->encoded) +
+                        row->image->spans.capacity() * sizeof(StateSpan) +
+                        row->image->matches.capacity() * sizeof(row->image->matches[0]);
+        }
+        b.highlight += row->textStates.capacity() * sizeof(textState) + row->spans.capacity() * sizeof(StateSpan);
+        b.layout += row->wrapBreaks.capacity() * sizeof(size_t);
+        b.search += row->matches.capacity() * sizeof(row->matches[0]);
+        b.rows += sizeof(Row) + sizeof(ControlBlock);
+    }
+    b.layout += file.lines.bytes();
+    b.crdt += file.journal.capacity() * sizeof(Crdt::Change);
+}
+
+MemStats::Breakdown MemStats::collect(const Config &cfg)
+{
+    Breakdown b;
+    collectFile(cfg.fileData, b);
+    collectFile(cfg.grep.other, b);
+
+    b.search += cfg.search.hits.capacity() * sizeof(SearchHit) + cfg.grep.matches.capacity() * sizeof(GrepMatch);
+    for (const GrepMatch &m : cfg.grep.matches)
+    {
+        b.search += heapBytes(m.path) + heapBytes(m.line);
+    }
+
+    // No undo history is kept yet
+    b.undo = 0;
+    b.crdt += cfg.session.doc.bytes() + cfg.session.log.bytes();
+    b.network = sizeof(cfg.session) + sizeof(cfg.net) + sizeof(cfg.mod) + 2 * NetThread::RING * sizeof(NetMsg) +
+                cfg.net.bytes();
+
+    return b;
+}
+
+std::string MemStats::formatBytes(size_t bytes)
+{
+    static const char *units[] = {"B", "K", "M", "G", "T"};
+    double v = bytes;
+    size_t u = 0;
+    while (v >= 1024 && u + 1 < std::size(units))
+    {
+        v /= 1024;
+        u++;
+    }
+
+    char s[32];
+    snprintf(s, sizeof(s), u ? "%.1f%s" : "%.0f%s", v, units[u]);
+    return s;
+}
@@ -0,0 +1,87 @@
+#include <perf.hh>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+
+std::atomic<bool> Perf::enabled{false};
+
+// Windows are pushed by the render thread and read by the main thread
+static std::mutex windowsMutex;
+static std::array<Perf::Window, Perf::METRIC_COUNT> windows;
+// Per-frame sums are atomic so rows highlighted on pool threads can record too
+static std::array<std::atomic<double>, Perf::FRAME_METRICS> frameAcc{};
+
+void Perf::Window::push(double v)
+{
+    samples[head] = v;
+    head = (head + 1) % CAPACITY;
+    count = std::min(count + 1, CAPACITY);
+}
+
+double Perf::Window::last() const
+{
+    return count ? samples[(head + CAPACITY - 1) % CAPACITY] : 0;
+}
+
+double Perf::Window::p99() const
+{
+    if (!count)
+        return 0;
+
+    // Only the populated part of the ring is considered
+    std::array<double, CAPACITY> sorted = samples;
+    size_t idx = (count * 99) / 100;
+    std::nth_element(sorted.begin(), sorted.begin() + idx, sorted.begin() + count);
+    return sorted[idx];
+}
+
+void Perf::record(metric m, double v)
+{
+    if (m < FRAME_METRICS)
+    {
+        frameAcc[m].fetch_add(v, std::memory_order_relaxed);
+        return;
+    }
+    std::lock_guard<std::mutex> lock(windowsMutex);
+    windows[m].push(v);
+}
+
+Perf::Sample Perf::take()
+{
+    Sample frame;
+    for (size_t m = 0; m < FRAME_METRICS; m++)
+    {
+        frame[m] = frameAcc[m].exchange(0, std::memory_order_relaxed);
+    }
+    return frame;
+}
+
+void Perf::endFrame(const Sample &frame, double ms)
+{
+    std::lock_guard<std::mutex> lock(windowsMutex);
+    for (size_t m = 0; m < FRAME_METRICS; m++)
+    {
+        windows[m].push(frame[m]);
+    }
+    windows[FRAME].push(ms);
+}
+
+Perf::Window Perf::window(metric m)
+{
+    std::lock_guard<std::mutex> lock(windowsMutex);
+    return windows[m];
+}
+
+void Perf::toggle()
+{
+    // Only the main thread toggles; others only read the flag
+    bool on = !enabled;
+    enabled = on;
+    if (on)
+    {
+        std::lock_guard<std::mutex> lock(windowsMutex);
+        windows = {};
+        for (auto &acc : frameAcc)
+            acc.store(0, std::memory_order_relaxed);
+    }
+}
@@ -0,0 +1,271 @@
+#include <protocol.hh>
+#include <climits>
+
+void Protocol::putVarint(std::string &out, uint64_t v)
+{
+    while (v >= 0x80)
+    {
+        out += static_cast<char>(v | 0x80);
+        v >>= 7;
+    }
+    out += static_cast<char>(v);
+}
+
+bool Protocol::getVarint(std::string_view &in, uint64_t &v)
+{
+    v = 0;
+    for (size_t i = 0; i < in.size() && i < 10; i++)
+    {
+        uint8_t b = in[i];
+        v |= uint64_t(b & 0x7f) << (7 * i);
+        if (!(b & 0x80))
+        {
+            in.remove_prefix(i + 1);
+            return true;
+        }
+    }
+    return false;
+}
+
+static inline uint64_t zigzag(int64_t v)
+{
+    return (uint64_t(v) << 1) ^ uint64_t(v >> 63);
+}
+
+static inline int64_t unzigzag(uint64_t v)
+{
+    return int64_t(v >> 1) ^ -int64_t(v & 1);
+}
+
+static void putString(std::string &out, std::string_view s)
+{
+    Protocol::putVarint(out, s.size());
+    out += s;
+}
+
+static bool getString(std::string_view &in, std::string &s)
+{
+    uint64_t n;
+    if (!Protocol::getVarint(in, n) || n > in.size())
+        return false;
+    s.assign(in.substr(0, n));
+    in.remove_prefix(n);
+    return true;
+}
+
+///////////////////
+// WRITER
+///////////////////
+
+// Ids in a frame mostly come from one site with nearby clocks, so they are sent relative to the last one
+void Protocol::Writer::putId(const Id &id)
+{
+    putVarint(body, id.site == last.site ? 0 : uint64_t(id.site) + 1);
+    putVarint(body, zigzag(int64_t(id.clock - last.clock)));
+    last = id;
+}
+
+void Protocol::Writer::encode(const Op &op)
+{
+    putVarint(body, op.type);
+    switch (op.type)
+    {
+    case OP_INSERT:
+        putId(op.id);
+        putId(op.after);
+        putString(body, op.text);
+        break;
+    case OP_DELETE:
+        putId(op.id);
+        putVarint(body, op.spans.size());
+        for (const Span &span : op.spans)
+        {
+            putId(span.id);
+            putVarint(body, span.len);
+        }
+        break;
+    }
+    count++;
+}
+
+void Protocol::Writer::add(const Op &op)
+{
+    if (hasOpen && open.type == op.type && op.type == OP_INSERT)
+    {
+        // Typing on: the next character's clock follows and it goes right after the last one
+        uint64_t next = open.id.clock + open.text.size();
+        if (op.id.site == open.id.site && op.id.clock == next && op.after == Id{next - 1, op.id.site})
+        {
+            open.text += op.text;
+            return;
+        }
+    }
+    else if (hasOpen && open.type == op.type && op.type == OP_DELETE && op.id.site == open.id.site)
+    {
+        // Deleting on, backwards or forwards through one site's run of characters, stamped as the last delete
+        open.id = std::max(open.id, op.id);
+        for (const Span &span : op.spans)
+        {
+            Span &back = open.spans.back();
+            if (span.id.site == back.id.site && span.id.clock + span.len == back.id.clock)
+            {
+                back.id = span.id;
+                back.len += span.len;
+            }
+            else if (span.id.site == back.id.site && back.id.clock + back.len == span.id.clock)
+            {
+                back.len += span.len;
+            }
+            else
+            {
+                open.spans.push_back(span);
+            }
+        }
+        return;
+    }
+
+    if (hasOpen)
+        encode(open);
+    open = op;
+    hasOpen = !(op.type == OP_DELETE && op.spans.empty());
+}
+
+size_t Protocol::Writer::size() const
+{
+    return count + hasOpen;
+}
+
+size_t Protocol::Writer::bytes() const
+{
+    return body.size() + (hasOpen ? open.text.size() + open.spans.size() * 4 : 0);
+}
+
+void Protocol::Writer::finish(std::string &out)
+{
+    if (hasOpen)
+        encode(open);
+
+    std::string header;
+    header += static_cast<char>(WIRE_VERSION);
+    putVarint(header, count);
+
+    putVarint(out, header.size() + body.size());
+    out += header;
+    out += body;
+
+    body.clear();
+    count = 0;
+    last = Id{};
+    hasOpen = false;
+}
+
+///////////////////
+// READER
+///////////////////
+
+void Protocol::Reader::feed(const char *data, size_t n)
+{
+    // Drop what was decoded once it is most of the buffer, so the copy stays cheap
+    if (head > 0 && head * 2 >= buf.size())
+    {
+        buf.erase(0, head);
+        head = 0;
+    }
+    buf.append(data, n);
+}
+
+bool Protocol::Reader::decode(std::vector<Op> &out)
+{
+    if (!err.empty())
+        return false;
+
+    while (head < buf.size())
+    {
+        std::string_view in(buf);
+        in.remove_prefix(head);
+
+        // Wait for the length, then for the whole body
+        uint64_t len;
+        if (!getVarint(in, len))
+        {
+            if (in.size() >= 10)
+                err = "bad frame length";
+            return err.empty();
+        }
+        if (len > MAX_FRAME)
+        {
+            err = "frame of " + std::to_string(len) + " bytes";
+            return false;
+        }
+        if (in.size() < len)
+            return true;
+
+        std::string_view body = in.substr(0, len);
+        size_t next = buf.size() - in.size() + len;
+        if (body.empty() || uint8_t(body[0]) != WIRE_VERSION)
+        {
+            err = "peer speaks protocol v" + std::to_string(body.empty() ? 0 : uint8_t(body[0]));
+            return false;
+        }
+        body.remove_prefix(1);
+
+        uint64_t count;
+        if (!getVarint(body, count))
+        {
+            err = "bad operation count";
+            return false;
+        }
+
+        Id last;
+        auto getId = [&](Id &id) {
+            uint64_t site, delta;
+            if (!getVarint(body, site) || !getVarint(body, delta) || site > uint64_t(UINT32_MAX) + 1)
+                return false;
+            id.site = site == 0 ? last.site : uint32_t(site - 1);
+            id.clock = last.clock + unzigzag(delta);
+            last = id;
+            return true;
+        };
+
+        for (uint64_t i = 0; i < count; i++)
+        {
+            Op op;
+            uint64_t type, n = 0;
+            bool ok = getVarint(body, type);
+            op.type = static_cast<OpType>(type);
+            switch (type)
+            {
+            case OP_INSERT:
+                ok = ok && getId(op.id) && getId(op.after) && getString(body, op.text);
+                break;
+            case OP_DELETE:
+                // Every span takes at least three bytes, which bounds what a corrupt count can allocate
+                ok = ok && getId(op.id) && getVarint(body, n) && n <= body.size() / 3;
+                for (uint64_t k = 0; ok && k < n; k++)
+                {
+                    Span span;
+                    ok = getId(span.id) && getVarint(body, span.len);
+                    op.spans.push_back(span);
+                }
+                break;
+            default:
+                ok = false;
+            }
+            if (!ok)
+            {
+                err = "bad operation";
+                return false;
+            }
+            out.push_back(std::move(op));
+        }
+        head = next;
+    }
+    buf.clear();
+    head = 0;
+    return true;
+}
+
+const std::string &Protocol::Reader::error() const
+{
+    return err;
+}
@@ -0,0 +1,876 @@
+#include <regex.hh>
+#include <algorithm>
+#include <array>
+#include <bitset>
+#include <cctype>
+#include <functional>
+#include <map>
+
+namespace
+{
+constexpr size_t MAX_INSTS = 1 << 14;  // Bounds Pike VM work per byte and counted-repeat expansion
+constexpr size_t MAX_STATES = 1024;    // DFA states cached before the cache is flushed
+constexpr int MAX_REPEAT = 1000;
+constexpr int MAX_DEPTH = 256;         // Group nesting, bounding parser recursion
+
+enum Op : uint8_t
+{
+    BYTE,  ///< Consumes a byte in the class numbered x.
+    SPLIT, ///< Continues at both x and y.
+    JMP,   ///< Continues at x.
+    BOL,   ///< Asserts the start of the row.
+    EOL,   ///< Asserts the end of the row.
+    MATCH
+};
+
+struct Inst
+{
+    Op op;
+    int x = 0;
+    int y = 0;
+};
+
+// Instructions grouped into the strongly connected components of the moves that consume no byte,
+// sinks first, so a backward pass can settle each component from the ones it leads to
+struct Order
+{
+    std::vector<int> pcs;
+    std::vector<int> ends; ///< End in pcs of each component.
+    std::vector<int> comp; ///< Component of each instruction.
+};
+
+struct Node
+{
+    enum Kind
+    {
+        EMPTY,
+        CLASS,
+        CAT,
+        ALT,
+        REPEAT,
+        BOL,
+        EOL
+    } kind = EMPTY;
+    std::bitset<256> cls;
+    std::vector<Node> kids;
+    int min = 0;
+    int max = -1; ///< -1 for no upper bound.
+};
+
+// Recursive descent over the pattern; the first error stops parsing
+class Parser
+{
+private:
+    std::string_view s;
+    size_t i = 0;
+    int depth = 0;
+
+    bool more() const { return i < s.size(); }
+    char peek() const { return s[i]; }
+
+    bool escape(std::bitset<256> &cls, int &single)
+    {
+        single = -1;
+        if (!more())
+        {
+            err = "trailing \\";
+            return false;
+        }
+        unsigned char c = s[i++];
+        auto range = [&](unsigned char lo, unsigned char hi) {
+            for (int b = lo; b <= hi; b++)
+                cls.set(b);
+        };
+        switch (c)
+        {
+        case 'd':
+        case 'D':
+            range('0', '9');
+            break;
+        case 'w':
+        case 'W':
+            range('0', '9');
+            range('a', 'z');
+            range('A', 'Z');
+            cls.set('_');
+            break;
+        case 's':
+        case 'S':
+            for (char w : std::string_view(" \t\n\r\f\v"))
+                cls.set((unsigned char)w);
+            break;
+        case 't':
+            single = '\t';
+            break;
+        case 'n':
+            single = '\n';
+            break;
+        case 'r':
+            single = '\r';
+            break;
+        case 'f':
+            single = '\f';
+            break;
+        case 'v':
+            single = '\v';
+            break;
+        case 'x':
+            if (i + 2 > s.size() || !std::isxdigit((unsigned char)s[i]) || !std::isxdigit((unsigned char)s[i + 1]))
+            {
+                err = "bad \\x escape";
+                return false;
+            }
+            single = std::stoi(std::string(s.substr(i, 2)), nullptr, 16);
+            i += 2;
+            break;
+        default:
+            if (std::isalnum(c))
+            {
+                err = std::string("unknown escape \\") + (char)c;
+                return false;
+            }
+            single = c;
+        }
+        if (single >= 0)
+            cls.set(single);
+        else if (std::isupper(c))
+            cls.flip();
+        return true;
+    }
+
+    bool bracket(std::bitset<256> &cls)
+    {
+        bool negate = more() && peek() == '^';
+        if (negate)
+            i++;
+
+        // A ] first in the class is literal
+        for (bool first = true; first || !more() || peek() != ']'; first = false)
+        {
+            if (!more())
+            {
+                err = "missing ]";
+                return false;
+            }
+
+            std::bitset<256> item;
+            int lo = (unsigned char)s[i++];
+            if (lo == '\\' && !escape(item, lo))
+                return false;
+
+            // A range between two single bytes; otherwise - is literal
+            if (lo >= 0 && i + 1 < s.size() && peek() == '-' && s[i + 1] != ']')
+            {
+                i++;
+                std::bitset<256> end;
+                int hi = (unsigned char)s[i++];
+                if (hi == '\\' && !escape(end, hi))
+                    return false;
+                if (hi < lo)
+                {
+                    err = "bad range";
+                    return false;
+                }
+                for (int b = lo; b <= hi; b++)
+                    item.set(b);
+            }
+            else if (lo >= 0)
+                item.set(lo);
+            cls |= item;
+        }
+        i++;
+        if (negate)
+            cls.flip();
+        return true;
+    }
+
+    // Parses {m}, {m,} or {m,n}; leaves i alone and returns false if there is no such bound
+    bool bound(int &min, int &max)
+    {
+        size_t j = i + 1;
+        auto number = [&](int &out) {
+            size_t start = j;
+            out = 0;
+            while (j < s.size() && std::isdigit((unsigned char)s[j]))
+                out = std::min(out * 10 + (s[j++] - '0'), MAX_REPEAT + 1);
+            return j > start;
+        };
+        if (!number(min))
+            return false;
+        max = min;
+        if (j < s.size() && s[j] == ',')
+        {
+            j++;
+            if (!number(max))
+                max = -1;
+        }
+        if (j >= s.size() || s[j] != '}')
+            return false;
+        i = j + 1;
+        return true;
+    }
+
+    Node atom()
+    {
+        Node n;
+        unsigned char c = s[i++];
+        switch (c)
+        {
+        case '(':
+            if (++depth > MAX_DEPTH)
+            {
+                err = "groups nested too deep";
+                return n;
+            }
+            if (s.substr(i, 2) == "?:")
+                i += 2;
+            n = alt();
+            if (err.empty() && (!more() || peek() != ')'))
+                err = "missing )";
+            i++;
+            depth--;
+            return n;
+        case '[':
+            n.kind = Node::CLASS;
+            bracket(n.cls);
+            return n;
+        case '.':
+            n.kind = Node::CLASS;
+            n.cls.set();
+            return n;
+        case '^':
+            n.kind = Node::BOL;
+            return n;
+        case '$':
+            n.kind = Node::EOL;
+            return n;
+        case '*':
+        case '+':
+        case '?':
+            err = "nothing to repeat";
+            return n;
+        case '\\':
+        {
+            int single;
+            n.kind = Node::CLASS;
+            escape(n.cls, single);
+            return n;
+        }
+        default:
+            n.kind = Node::CLASS;
+            n.cls.set(c);
+            return n;
+        }
+    }
+
+    Node repeat()
+    {
+        Node n = atom();
+        while (err.empty() && more())
+        {
+            int min, max;
+            if (peek() == '*')
+                min = 0, max = -1, i++;
+            else if (peek() == '+')
+                min = 1, max = -1, i++;
+            else if (peek() == '?')
+                min = 0, max = 1, i++;
+            else if (peek() != '{' || !bound(min, max))
+                break;
+
+            if (min > MAX_REPEAT || max > MAX_REPEAT || (max >= 0 && max < min))
+            {
+                err = "bad repeat count";
+                break;
+            }
+            Node r;
+            r.kind = Node::REPEAT;
+            r.min = min;
+            r.max = max;
+            r.kids.push_back(std::move(n));
+            n = std::move(r);
+        }
+        return n;
+    }
+
+    Node cat()
+    {
+        Node n;
+        n.kind = Node::CAT;
+        while (err.empty() && more() && peek() != '|' && peek() != ')')
+            n.kids.push_back(repeat());
+        return n;
+    }
+
+public:
+    std::string err;
+
+    explicit Parser(std::string_view s) : s(s) {}
+
+    Node alt()
+    {
+        Node n;
+        n.kind = Node::ALT;
+        n.kids.push_back(cat());
+        while (err.empty() && more() && peek() == '|')
+        {
+            i++;
+            n.kids.push_back(cat());
+        }
+        return n;
+    }
+
+    Node parse()
+    {
+        Node n = alt();
+        if (err.empty() && more())
+            err = "unmatched )";
+        return n;
+    }
+};
+} // namespace
+
+struct Regex::Program
+{
+    std::vector<Inst> insts;
+    std::vector<std::bitset<256>> classes;
+    std::array<uint8_t, 256> eq{}; ///< Byte to equivalence class: bytes no instruction tells apart.
+    size_t eqCount = 1;
+    std::array<Order, 4> orders;   ///< By whether ^ (1) and $ (2) hold at the position.
+};
+
+// Tarjan's algorithm, without recursion, over the moves that consume no byte where ^ and $ hold as given
+static void order(const std::vector<Inst> &insts, bool bol, bool eol, Order &out)
+{
+    auto edges = [&](int pc, int to[2]) {
+        const Inst &in = insts[pc];
+        to[0] = in.op == BOL || in.op == EOL ? pc + 1 : in.x;
+        to[1] = in.y;
+        switch (in.op)
+        {
+        case JMP:
+            return 1;
+        case SPLIT:
+            return 2;
+        case BOL:
+            return bol ? 1 : 0;
+        case EOL:
+            return eol ? 1 : 0;
+        default:
+            return 0;
+        }
+    };
+
+    int m = insts.size();
+    std::vector<int> index(m, -1), low(m), stack;
+    std::vector<uint8_t> on(m);
+    std::vector<std::pair<int, int>> calls; // Instruction and its next edge
+    int counter = 0;
+    out.comp.assign(m, -1);
+    auto visit = [&](int pc) {
+        index[pc] = low[pc] = counter++;
+        stack.push_back(pc);
+        on[pc] = 1;
+        calls.push_back({pc, 0});
+    };
+    for (int root = 0; root < m; root++)
+    {
+        if (index[root] >= 0)
+            continue;
+        visit(root);
+        while (!calls.empty())
+        {
+            int pc = calls.back().first;
+            int to[2];
+            if (calls.back().second < edges(pc, to))
+            {
+                int w = to[calls.back().second++];
+                if (index[w] < 0)
+                    visit(w);
+                else if (on[w])
+                    low[pc] = std::min(low[pc], index[w]);
+                continue;
+            }
+            calls.pop_back();
+            if (!calls.empty())
+                low[calls.back().first] = std::min(low[calls.back().first], low[pc]);
+            if (low[pc] == index[pc])
+            {
+                int comp = out.ends.size(), w;
+                do
+                {
+                    w = stack.back();
+                    stack.pop_back();
+                    on[w] = 0;
+                    out.comp[w] = comp;
+                    out.pcs.push_back(w);
+                } while (w != pc);
+                out.ends.push_back(out.pcs.size());
+            }
+        }
+    }
+}
+
+// Emits the NFA for an AST node; false once the program grows past MAX_INSTS
+static bool emit(const Node &n, std::vector<Inst> &insts, const std::function<int(const std::bitset<256> &)> &classId)
+{
+    if (insts.size() > MAX_INSTS)
+        return false;
+
+    switch (n.kind)
+    {
+    case Node::EMPTY:
+        break;
+    case Node::CLASS:
+        insts.push_back(Inst{BYTE, classId(n.cls)});
+        break;
+    case Node::BOL:
+    case Node::EOL:
+        insts.push_back(Inst{n.kind == Node::BOL ? BOL : EOL});
+        break;
+    case Node::CAT:
+        for (const Node &k : n.kids)
+        {
+            if (!emit(k, insts, classId))
+                return false;
+        }
+        break;
+    case Node::ALT:
+    {
+        // Each alternative but the last: SPLIT into it or on to the next, then JMP to the end
+        std::vector<size_t> jumps;
+        for (size_t k = 0; k + 1 < n.kids.size(); k++)
+        {
+            size_t split = insts.size();
+            insts.push_back(Inst{SPLIT, (int)split + 1, 0});
+            if (!emit(n.kids[k], insts, classId))
+                return false;
+            jumps.push_back(insts.size());
+            insts.push_back(Inst{JMP});
+            insts[split].y = (int)insts.size();
+        }
+        if (!emit(n.kids.back(), insts, classId))
+            return false;
+        for (size_t j : jumps)
+            insts[j].x = insts.size();
+        break;
+    }
+    case Node::REPEAT:
+    {
+        const Node &k = n.kids[0];
+        for (int r = 0; r < n.min; r++)
+        {
+            if (!emit(k, insts, classId))
+                return false;
+        }
+        if (n.max < 0)
+        {
+            // L: SPLIT body, end; body; JMP L
+            size_t loop = insts.size();
+            insts.push_back(Inst{SPLIT, (int)loop + 1, 0});
+            if (!emit(k, insts, classId))
+                return false;
+            insts.push_back(Inst{JMP, (int)loop, 0});
+            insts[loop].y = (int)insts.size();
+        }
+        else
+        {
+            // Each optional copy may skip straight to the end
+            std::vector<size_t> splits;
+            for (int r = n.min; r < n.max; r++)
+            {
+                splits.push_back(insts.size());
+                insts.push_back(Inst{SPLIT, (int)insts.size() + 1, 0});
+                if (!emit(k, insts, classId))
+                    return false;
+            }
+            for (size_t sp : splits)
+                insts[sp].y = (int)insts.size();
+        }
+        break;
+    }
+    }
+    return insts.size() <= MAX_INSTS;
+}
+
+Regex::Regex(std::string_view pattern, bool ignoreCase)
+{
+    auto p = std::make_shared<Program>();
+    Parser parser(pattern);
+    Node root = parser.parse();
+    err = parser.err;
+
+    std::unordered_map<std::bitset<256>, int> ids;
+    auto classId = [&](std::bitset<256> cls) -> int {
+        if (ignoreCase)
+        {
+            for (int c = 'a'; c <= 'z'; c++)
+            {
+                if (cls.test(c) || cls.test(c - 'a' + 'A'))
+                    cls.set(c).set(c - 'a' + 'A');
+            }
+        }
+        auto [it, fresh] = ids.emplace(cls, p->classes.size());
+        if (fresh)
+            p->classes.push_back(cls);
+        return it->second;
+    };
+    if (err.empty() && !emit(root, p->insts, classId))
+        err = "pattern too large";
+    p->insts.push_back({MATCH});
+
+    // Split bytes into classes no instruction tells apart, so DFA rows stay narrow
+    std::array<uint8_t, 256> eq{};
+    size_t count = 1;
+    for (const auto &cls : p->classes)
+    {
+        std::map<std::pair<int, bool>, uint8_t> split;
+        for (int c = 0; c < 256; c++)
+            eq[c] = split.emplace(std::make_pair(eq[c], cls.test(c)), split.size()).first->second;
+        count = split.size();
+    }
+    p->eq = eq;
+    p->eqCount = count;
+    for (int at = 0; at < 4; at++)
+        order(p->insts, at & 1, at & 2, p->orders[at]);
+    prog = std::move(p);
+}
+
+bool Regex::smartCase(std::string_view pattern)
+{
+    for (size_t i = 0; i < pattern.size(); i++)
+    {
+        if (pattern[i] == '\\')
+            i++; // \S, \W and \D are not uppercase text
+        else if (std::isupper((unsigned char)pattern[i]))
+            return false;
+    }
+    return true;
+}
+
+const std::string &Regex::error() const
+{
+    return err;
+}
+
+void Regex::closure(std::vector<int> &out, std::vector<uint8_t> &seen, int pc, bool bol, bool eol) const
+{
+    std::vector<int> stack{pc};
+    while (!stack.empty())
+    {
+        pc = stack.back();
+        stack.pop_back();
+        if (seen[pc])
+            continue;
+        seen[pc] = 1;
+
+        const Inst &in = prog->insts[pc];
+        switch (in.op)
+        {
+        case BYTE:
+        case MATCH:
+            out.push_back(pc);
+            break;
+        case JMP:
+            stack.push_back(in.x);
+            break;
+        case SPLIT:
+            stack.push_back(in.y);
+            stack.push_back(in.x);
+            break;
+        case BOL:
+            if (bol)
+                stack.push_back(pc + 1);
+            break;
+        case EOL:
+            // Kept in DFA states so the end of the row can still satisfy it
+            if (eol)
+                stack.push_back(pc + 1);
+            else
+                out.push_back(pc);
+            break;
+        }
+    }
+}
+
+int Regex::intern(std::vector<int> pcs, bool bol, bool anchored)
+{
+    std::sort(pcs.begin(), pcs.end());
+    std::string key(reinterpret_cast<const char *>(pcs.data()), pcs.size() * sizeof(int));
+    key += (bol ? 1 : 0) | (anchored ? 2 : 0);
+    auto it = stateIds.find(key);
+    if (it != stateIds.end())
+        return it->second;
+
+    // Bound memory on patterns that blow up: start over rather than grow without limit
+    if (states.size() >= MAX_STATES)
+    {
+        states.clear();
+        stateIds.clear();
+        trans.clear();
+    }
+
+    DState d{std::move(pcs), bol, anchored, false, false};
+    std::vector<uint8_t> seen(prog->insts.size());
+    for (int pc : d.pcs)
+    {
+        if (prog->insts[pc].op == MATCH)
+            d.match = d.eolMatch = true;
+        else if (prog->insts[pc].op == EOL)
+        {
+            std::vector<int> after;
+            closure(after, seen, pc + 1, false, true);
+            for (int a : after)
+                d.eolMatch |= prog->insts[a].op == MATCH;
+        }
+    }
+
+    int id = states.size();
+    states.push_back(std::move(d));
+    stateIds.emplace(std::move(key), id);
+    trans.resize(states.size() * prog->eqCount, -1);
+    return id;
+}
+
+int Regex::step(int state, unsigned char c)
+{
+    // Threads from the state, plus a fresh one starting here unless anchored
+    const DState &d = states[state];
+    bool anchored = d.anchored;
+    std::vector<int> from = d.pcs;
+    std::vector<uint8_t> seen(prog->insts.size());
+    if (!anchored)
+        closure(from, seen, 0, d.bol, false);
+
+    std::vector<int> next;
+    std::fill(seen.begin(), seen.end(), 0);
+    for (int pc : from)
+    {
+        const Inst &in = prog->insts[pc];
+        if (in.op == BYTE && prog->classes[in.x].test(c))
+            closure(next, seen, pc + 1, false, false);
+    }
+
+    size_t before = states.size();
+    int id = intern(std::move(next), false, anchored);
+    int t = (int)(id * prog->eqCount) << 2 | (states[id].pcs.empty() ? 2 : 0) | (states[id].match ? 1 : 0);
+    if (states.size() >= before) // Not flushed, so state is still valid
+        trans[state * prog->eqCount + prog->eq[c]] = t;
+    return t;
+}
+
+size_t Regex::firstEnd(std::string_view hay, size_t from)
+{
+    const uint8_t *eq = prog->eq.data();
+    size_t width = prog->eqCount;
+    size_t row = intern({}, from == 0, false) * width;
+    for (size_t i = from; i < hay.size(); i++)
+    {
+        unsigned char c = hay[i];
+        int t = trans[row + eq[c]];
+        if (t < 0)
+            t = step(row / width, c);
+        row = t >> 2;
+        if (t & 1)
+            return i + 1;
+    }
+    return states[row / width].eolMatch ? hay.size() : std::string::npos;
+}
+
+size_t Regex::pike(std::string_view hay, size_t from) const
+{
+    const auto &insts = prog->insts;
+    constexpr size_t npos = std::string::npos;
+
+    // Threads in order of their start, so the first to reach an instruction has the leftmost start
+    std::vector<std::pair<int, size_t>> clist, nlist;
+    std::vector<size_t> mark(insts.size(), npos);
+    std::vector<int> stack;
+    size_t bestStart = npos;
+
+    auto add = [&](std::vector<std::pair<int, size_t>> &list, int pc, size_t start, size_t p) {
+        stack.push_back(pc);
+        while (!stack.empty())
+        {
+            pc = stack.back();
+            stack.pop_back();
+            if (mark[pc] == p)
+                continue;
+            mark[pc] = p;
+
+            const Inst &in = insts[pc];
+            switch (in.op)
+            {
+            case BYTE:
+                list.push_back({pc, start});
+                break;
+            case MATCH:
+                if (p > start && start < bestStart)
+                    bestStart = start;
+                break;
+            case JMP:
+                stack.push_back(in.x);
+                break;
+            case SPLIT:
+                stack.push_back(in.y);
+                stack.push_back(in.x);
+                break;
+            case BOL:
+                if (p == 0)
+                    stack.push_back(pc + 1);
+                break;
+            case EOL:
+                if (p == hay.size())
+                    stack.push_back(pc + 1);
+                break;
+            }
+        }
+    };
+
+    for (size_t p = from;; p++)
+    {
+        if (bestStart == npos)
+            add(clist, 0, p, p);
+        if (p == hay.size())
+            break;
+
+        unsigned char c = hay[p];
+        nlist.clear();
+        for (auto [pc, start] : clist)
+        {
+            // Threads starting at or right of the best match cannot move its start left
+            if (start >= bestStart)
+                break;
+            if (prog->classes[insts[pc].x].test(c))
+                add(nlist, pc + 1, start, p + 1);
+        }
+        clist.swap(nlist);
+
+        // Once no thread starts left of the best match, its start is final
+        if (bestStart != npos && clist.empty())
+            break;
+    }
+    return bestStart;
+}
+
+size_t Regex::longestEnd(std::string_view hay, size_t start)
+{
+    std::vector<int> init;
+    std::vector<uint8_t> seen(prog->insts.size());
+    closure(init, seen, 0, start == 0, false);
+    const uint8_t *eq = prog->eq.data();
+    size_t width = prog->eqCount;
+    size_t row = intern(std::move(init), false, true) * width;
+
+    size_t end = std::string::npos;
+    for (size_t i = start; i < hay.size(); i++)
+    {
+        unsigned char c = hay[i];
+        int t = trans[row + eq[c]];
+        if (t < 0)
+            t = step(row / width, c);
+        row = t >> 2;
+        if (t & 2)
+            return end;
+        if (t & 1)
+            end = i + 1;
+    }
+    return states[row / width].eolMatch ? hay.size() : end;
+}
+
+
+
+size_t Regex::find(std::string_view hay, size_t from, size_t &len)
+{
+    if (!err.empty() || from > hay.size())
+        return std::string::npos;
+
+    // The DFA rules out rows without a match; only rows with one pay for the Pike VM, which runs
+    // just until the leftmost start is settled before a DFA extends the match from it
+    if (firstEnd(hay, from) == std::string::npos)
+        return std::string::npos;
+    size_t start = pike(hay, from);
+    if (start == std::string::npos)
+        return start;
+    len = longestEnd(hay, start) - start;
+    return start;
+}
+
+void Regex::longestEnds(std::string_view hay)
+{
+    const auto &insts = prog->insts;
+    size_t n = hay.size();
+    here.assign(insts.size(), -1);
+    ahead.assign(insts.size(), -1);
+    longest.assign(n + 1, -1);
+
+    // Walking back from the end of the row, an instruction's value at i is the furthest a thread on it
+    // there can match to. Consuming a byte takes the value at i + 1; a component of moves that consume
+    // none takes the best of the components it leads to, which come before it in the order
+    for (size_t i = n + 1; i-- > 0;)
+    {
+        const Order &order = prog->orders[(i == 0 ? 1 : 0) | (i == n ? 2 : 0)];
+        unsigned char c = i < n ? hay[i] : 0;
+        size_t from = 0;
+        for (size_t comp = 0; comp < order.ends.size(); comp++)
+        {
+            auto out = [&](int to) { return order.comp[to] == (int)comp ? -1 : here[to]; };
+            size_t to = order.ends[comp];
+            long v = -1;
+            for (size_t j = from; j < to; j++)
+            {
+                int pc = order.pcs[j];
+                const Inst &in = insts[pc];
+                switch (in.op)
+                {
+                case MATCH:
+                    v = std::max(v, (long)i);
+                    break;
+                case BYTE:
+                    if (i < n && prog->classes[in.x].test(c))
+                        v = std::max(v, ahead[pc + 1]);
+                    break;
+                case JMP:
+                    v = std::max(v, out(in.x));
+                    break;
+                case SPLIT:
+                    v = std::max({v, out(in.x), out(in.y)});
+                    break;
+                case BOL:
+                    if (i == 0)
+                        v = std::max(v, out(pc + 1));
+                    break;
+                case EOL:
+                    if (i == n)
+                        v = std::max(v, out(pc + 1));
+                    break;
+                }
+            }
+            for (size_t j = from; j < to; j++)
+                here[order.pcs[j]] = v;
+            from = to;
+        }
+        longest[i] = here[0];
+        here.swap(ahead);
+    }
+}
+
+void Regex::findAll(std::string_view hay, std::vector<std::pair<size_t, size_t>> &out)
+{
+    out.clear();
+
+    // The DFA rules out rows without a match; only rows with one pay for the backward pass
+    if (!err.empty() || firstEnd(hay, 0) == std::string::npos)
+        return;
+    longestEnds(hay);
+    for (size_t i = 0; i < hay.size();)
+    {
+        if (longest[i] > (long)i)
+        {
+            out.push_back({i, longest[i] - i});
+            i = longest[i];
+        }
+        else
+            i++;
+    }
+}
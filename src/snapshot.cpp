@@ -0,0 +1,420 @@
+#include <snapshot.hh>
+#include <fileio.hh>
+#include <lz.hh>
+#include <protocol.hh>
+#include <threadpool.hh>
+#include <trace.hh>
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <sys/socket.h>
+#include <unistd.h>
+
+static const char MAGIC[4] = {'T', 'T', 'S', 'N'};
+static const char HELLO[4] = {'T', 'T', 'H', 'I'};
+static const char RESUME[4] = {'T', 'T', 'R', 'S'};
+static constexpr uint64_t MAX_CHUNKS = 1 << 24;
+static constexpr uint64_t MAX_CHUNK = 1ull << 32; ///< A chunk holds at least one row, however long.
+
+// Multiplicative hash over 8-byte little-endian words, so both ends agree whatever their byte order
+static uint64_t checksum(std::string_view s)
+{
+    auto word = [](const char *p) {
+        uint64_t w;
+        std::memcpy(&w, p, sizeof(w));
+        return __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__ ? w : __builtin_bswap64(w);
+    };
+
+    uint64_t h = 0x9e3779b97f4a7c15ull ^ s.size();
+    size_t i = 0;
+    for (; i + 8 <= s.size(); i += 8)
+        h = ((h << 31 | h >> 33) ^ word(s.data() + i)) * 0x9fb21c651e98df25ull;
+    uint64_t tail = 0;
+    for (size_t k = 0; i + k < s.size(); k++)
+        tail |= uint64_t(uint8_t(s[i + k])) << (8 * k);
+    h = ((h << 31 | h >> 33) ^ tail) * 0x9fb21c651e98df25ull;
+    return h ^ (h >> 29);
+}
+
+static void putFixed64(std::string &out, uint64_t v)
+{
+    for (int i = 0; i < 8; i++)
+        out += static_cast<char>(v >> (8 * i));
+}
+
+static void putVersion(std::string &out, const Crdt::Version &v)
+{
+    Protocol::putVarint(out, v.size());
+    for (const auto &[site, clock] : v)
+    {
+        Protocol::putVarint(out, site);
+        Protocol::putVarint(out, clock);
+    }
+}
+
+///////////////////
+// HANDSHAKE
+///////////////////
+
+void Snapshot::hello(const Crdt::Version &have, const Crdt::Version &floor, std::string &out)
+{
+    out.append(HELLO, sizeof(HELLO));
+    out += static_cast<char>(FORMAT_VERSION);
+    putVersion(out, have);
+    putVersion(out, floor);
+}
+
+int Snapshot::readHello(std::string_view &in, Crdt::Version &have, Crdt::Version &floor, std::string &err)
+{
+    std::string_view rest = in;
+    size_t head = std::min(rest.size(), sizeof(HELLO));
+    if (rest.substr(0, head) != std::string_view(HELLO, head))
+    {
+        err = "not a hello";
+        return -1;
+    }
+    if (rest.size() < sizeof(HELLO) + 1)
+        return 0;
+    if (uint8_t(rest[sizeof(HELLO)]) != FORMAT_VERSION)
+    {
+        err = "hello v" + std::to_string(uint8_t(rest[sizeof(HELLO)]));
+        return -1;
+    }
+    rest.remove_prefix(sizeof(HELLO) + 1);
+
+    // A varint running out means more is on its way
+    for (Crdt::Version *v : {&have, &floor})
+    {
+        uint64_t sites;
+        if (!Protocol::getVarint(rest, sites))
+            return 0;
+        v->clear();
+        for (uint64_t i = 0; i < sites; i++)
+        {
+            uint64_t site, clock;
+            if (!Protocol::getVarint(rest, site) || !Protocol::getVarint(rest, clock))
+                return 0;
+            (*v)[uint32_t(site)] = clock;
+        }
+    }
+    in = rest;
+    return 1;
+}
+
+void Snapshot::resume(const Crdt::Version &have, std::string &out)
+{
+    out.append(RESUME, sizeof(RESUME));
+    out += static_cast<char>(FORMAT_VERSION);
+    putVersion(out, have);
+}
+
+///////////////////
+// ENCODING
+///////////////////
+
+void Snapshot::encode(const TTEdFileData &fData, const Crdt::Sequence &doc, std::string &out)
+{
+    TRACE_SCOPE("Snapshot::encode");
+    const auto &rows = fData.fileData;
+
+    // Split the rows into chunks of about CHUNK bytes
+    std::vector<size_t> bounds{0};
+    size_t bytes = 0;
+    for (size_t r = 0; r < rows.size(); r++)
+    {
+        bytes += rows[r]->sRaw.size() + 1;
+        if (bytes >= CHUNK)
+        {
+            bounds.push_back(r + 1);
+            bytes = 0;
+        }
+    }
+    if (bounds.back() != rows.size())
+        bounds.push_back(rows.size());
+    size_t chunks = bounds.size() - 1;
+
+    // Join, checksum and compress each chunk on the pool
+    std::vector<std::string> headers(chunks), payloads(chunks);
+    ThreadPool::shared().run(chunks, [&](size_t c) {
+        std::string text;
+        for (size_t r = bounds[c]; r < bounds[c + 1]; r++)
+        {
+            text += rows[r]->sRaw;
+            text += '\n';
+        }
+
+        std::string packed;
+        Lz::compress(text, packed);
+        bool compressed = packed.size() < text.size();
+        payloads[c] = compressed ? std::move(packed) : std::move(text);
+
+        std::string &h = headers[c];
+        Protocol::putVarint(h, compressed ? text.size() : payloads[c].size());
+        Protocol::putVarint(h, payloads[c].size() << 1 | compressed);
+        putFixed64(h, checksum(compressed ? std::string_view(text) : payloads[c]));
+    });
+
+    std::string prelude(MAGIC, sizeof(MAGIC));
+    prelude += static_cast<char>(FORMAT_VERSION);
+    std::string path = fData.path.string();
+    Protocol::putVarint(prelude, path.size());
+    prelude += path;
+    Protocol::putVarint(prelude, chunks);
+
+    size_t total = out.size() + prelude.size();
+    for (size_t c = 0; c < chunks; c++)
+        total += headers[c].size() + payloads[c].size();
+    std::string layout;
+    doc.encode(layout);
+    out.reserve(total + layout.size() + 10);
+    out += prelude;
+    for (size_t c = 0; c < chunks; c++)
+    {
+        out += headers[c];
+        out += payloads[c];
+    }
+    Protocol::putVarint(out, layout.size());
+    out += layout;
+}
+
+///////////////////
+// RECEIVING
+///////////////////
+
+namespace
+{
+    // Reads the socket in large blocks, handing out the bytes in whatever pieces the parser asks for
+    struct Stream
+    {
+        int fd;
+        std::string buf;
+        size_t head = 0;
+        std::string &err;
+
+        bool need(size_t n)
+        {
+            while (buf.size() - head < n)
+            {
+                if (head > 0)
+                {
+                    buf.erase(0, head);
+                    head = 0;
+                }
+                size_t have = buf.size();
+                buf.resize(have + std::max<size_t>(n - have, 1 << 18));
+                ssize_t r = ::recv(fd, buf.data() + have, buf.size() - have, 0);
+                buf.resize(have + std::max<ssize_t>(r, 0));
+                if (r == 0)
+                {
+                    err = "connection closed mid-transfer";
+                    return false;
+                }
+                if (r < 0 && errno != EINTR)
+                {
+                    err = std::strerror(errno);
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        bool varint(uint64_t &v)
+        {
+            // A varint is at most 10 bytes; ask for them one at a time so none past it are awaited
+            for (size_t len = 1; len <= 10; len++)
+            {
+                if (!need(len))
+                    return false;
+                std::string_view in(buf.data() + head, len);
+                if (Protocol::getVarint(in, v))
+                {
+                    head += len;
+                    return true;
+                }
+            }
+            err = "bad varint";
+            return false;
+        }
+
+        bool bytes(size_t n, std::string &out)
+        {
+            if (!need(n))
+                return false;
+            out.assign(buf, head, n);
+            head += n;
+            return true;
+        }
+    };
+}
+
+bool Snapshot::read(int fd, Transfer &out, Protocol::Reader &live, Crdt::Version &resumed, std::string &err)
+{
+    TRACE_SCOPE("Snapshot::read");
+    Stream in{fd, {}, 0, err};
+    resumed.clear();
+    out = Transfer();
+
+    std::string magic;
+    if (!in.bytes(sizeof(MAGIC) + 1, magic))
+        return false;
+    bool resuming = magic.compare(0, sizeof(RESUME), RESUME, sizeof(RESUME)) == 0;
+    if (!resuming && magic.compare(0, sizeof(MAGIC), MAGIC, sizeof(MAGIC)) != 0)
+    {
+        err = "not a snapshot";
+        return false;
+    }
+    if (uint8_t(magic[sizeof(MAGIC)]) != FORMAT_VERSION)
+    {
+        err = "snapshot v" + std::to_string(uint8_t(magic[sizeof(MAGIC)]));
+        return false;
+    }
+
+    // A resumed session goes on from the document the peer has; only the host's version comes first
+    if (resuming)
+    {
+        uint64_t sites;
+        if (!in.varint(sites))
+            return false;
+        for (uint64_t i = 0; i < sites; i++)
+        {
+            uint64_t site, clock;
+            if (!in.varint(site) || !in.varint(clock))
+                return false;
+            resumed[uint32_t(site)] = clock;
+        }
+        if (resumed.empty())
+        {
+            err = "bad resume";
+            return false;
+        }
+        live.feed(in.buf.data() + in.head, in.buf.size() - in.head);
+        return true;
+    }
+
+    // Sizes are checked before anything is allocated for them, so a corrupt header cannot exhaust memory
+    uint64_t pathLen, chunks;
+    if (!in.varint(pathLen))
+        return false;
+    if (pathLen > PATH_MAX)
+    {
+        err = "bad path length";
+        return false;
+    }
+    if (!in.bytes(pathLen, out.path) || !in.varint(chunks))
+        return false;
+    if (chunks > MAX_CHUNKS)
+    {
+        err = "bad chunk count";
+        return false;
+    }
+
+    // Compressed chunks are small next to the rows they become, so all of them are read first
+    out.chunks.resize(chunks);
+    for (Transfer::Chunk &c : out.chunks)
+    {
+        uint64_t packed;
+        std::string sum;
+        if (!in.varint(c.rawLen) || !in.varint(packed) || !in.bytes(8, sum))
+            return false;
+        if (c.rawLen > MAX_CHUNK || (packed >> 1) > MAX_CHUNK)
+        {
+            err = "bad chunk size";
+            return false;
+        }
+        c.compressed = packed & 1;
+        c.sum = 0;
+        for (int i = 0; i < 8; i++)
+            c.sum |= uint64_t(uint8_t(sum[i])) << (8 * i);
+        if (!in.bytes(packed >> 1, c.stored))
+            return false;
+    }
+
+    uint64_t layoutLen;
+    if (!in.varint(layoutLen))
+        return false;
+    if (layoutLen > MAX_CHUNK)
+    {
+        err = "bad layout size";
+        return false;
+    }
+    if (!in.bytes(layoutLen, out.layout))
+        return false;
+
+    // Anything read past the snapshot is the start of the live stream
+    live.feed(in.buf.data() + in.head, in.buf.size() - in.head);
+    return true;
+}
+
+bool Snapshot::load(Transfer &in, Config &cfg, std::string &err)
+{
+    TRACE_SCOPE("Snapshot::load");
+    size_t chunks = in.chunks.size();
+
+    // Rows are highlighted as they are built, so the file type is settled first
+    SyntaxHL *syntax = Config::syntax;
+    TTEdFileData fData;
+    fData.path = in.path;
+    std::swap(fData, cfg.fileData);
+    parseFileExtension(cfg);
+    std::swap(fData, cfg.fileData);
+
+    // Decompress, verify and split each chunk into rows on the pool
+    std::vector<std::vector<std::shared_ptr<Row>>> rows(chunks);
+    std::vector<char> corrupt(chunks, 0);
+    ThreadPool::shared().run(chunks, [&](size_t i) {
+        Transfer::Chunk &c = in.chunks[i];
+        std::string text;
+        if (c.compressed ? !Lz::decompress(c.stored, c.rawLen, text) : c.stored.size() != c.rawLen)
+        {
+            corrupt[i] = 1;
+            return;
+        }
+        if (!c.compressed)
+            text.swap(c.stored);
+        if (checksum(text) != c.sum || (!text.empty() && text.back() != '\n'))
+        {
+            corrupt[i] = 1;
+            return;
+        }
+
+        for (size_t start = 0; start < text.size();)
+        {
+            size_t end = text.find('\n', start);
+            rows[i].push_back(std::make_shared<Row>(text.substr(start, end - start))); // Renders and highlights
+            start = end + 1;
+        }
+    });
+
+    for (size_t i = 0; i < chunks; i++)
+    {
+        if (corrupt[i])
+        {
+            err = "chunk " + std::to_string(i) + " is corrupt";
+            Config::syntax = syntax;
+            return false;
+        }
+    }
+
+    size_t total = 0;
+    for (const auto &r : rows)
+        total += r.size();
+    fData.fileData.reserve(total);
+    for (auto &r : rows)
+        std::move(r.begin(), r.end(), std::back_inserter(fData.fileData));
+
+    if (!cfg.session.doc.decode(in.layout, fData))
+    {
+        err = "layout does not match the text";
+        Config::syntax = syntax;
+        return false;
+    }
+    cfg.fileData = std::move(fData);
+    return true;
+}
+
+bool Snapshot::receive(int fd, Config &cfg, Protocol::Reader &live, Crdt::Version &resumed, std::string &err)
+{
+    Transfer t;
+    return read(fd, t, live, resumed, err) && (!resumed.empty() || load(t, cfg, err));
+}
@@ -1,4 +1,5 @@
 #include <termacts.hh>
+#include <cstdlib>
 
 void TermActions::wipeScreen(std::stringstream &buf)
 {
@@ -23,3 +24,27 @@ void TermActions::showCursor(std::stringstream &buf)
     // Escape sequence to show the cursor
     buf << "\x1b[?25h";
 }
+
+void TermActions::scrollRegion(std::stringstream &buf, size_t top, size_t bottom, long lines)
+{
+    // Index at the bottom margin scrolls the region up; reverse index at the top scrolls it down
+    buf << "\x1b[" << top << ";" << bottom << "r";
+    buf << "\x1b[" << (lines > 0 ? bottom : top) << ";1H";
+    for (long i = 0; i < std::abs(lines); i++)
+    {
+        buf << (lines > 0 ? "\x1b" "D" : "\x1b" "M");
+    }
+    buf << "\x1b[r";
+}
+
+void TermActions::beginSync(std::stringstream &buf)
+{
+    // Escape sequence to begin a synchronized update
+    buf << "\x1b[?2026h";
+}
+
+void TermActions::endSync(std::stringstream &buf)
+{
+    // Escape sequence to end a synchronized update
+    buf << "\x1b[?2026l";
+}
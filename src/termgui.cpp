@@ -7,107 +7,542 @@
 #include <termacts.hh>
 #include <iostream>
 #include <inhandler.hh>
+#include <perf.hh>
+#include <trace.hh>
+#include <cstdio>
+#include <algorithm>
+#include <finder.hh>
+#include <regex.hh>
 
-#define CURSOR_X_SHIFT 3
+#define CURSOR_X_SHIFT (GUTTER_WIDTH + 1)
 
 TerminalGUI::TerminalGUI(Config &cfg) : config(cfg) {}
 
+TerminalGUI::~TerminalGUI()
+{
+    stopRenderThread();
+}
+
 void TerminalGUI::flushBuf()
 {
     std::string s = buf.str();
     write(STDOUT_FILENO, s.c_str(), s.size());
+    bytesOut += s.size(); // Recorded by draw(), which may be on another thread
     buf.str("");
 }
 
-void TerminalGUI::updateCursor(const TTEdCursor &cursor)
+void TerminalGUI::captureRows(const TTEdCursor &cursor, const TTEdFileData &fData, const TTEdTermData &tData, const TTEdSearch &search, Frame &f)
 {
-    buf << "\x1b[" << (cursor.cy - cursor.rOffset) + 1 << ";" << cursor.rx + CURSOR_X_SHIFT << "H";
+    TRACE_SCOPE("TerminalGUI::captureRows");
+    Perf::Timer timer(Perf::RENDER);
+    f.rows.assign(tData.sRow, Line{});
+    if (tData.softWrap || fData.folds > 0)
+    {
+        captureIndexedRows(cursor, fData, tData, search, f);
+        return;
+    }
+
+    for (size_t r = 0; r < tData.sRow; ++r)
+    {
+        size_t rowLoc = r + cursor.rOffset;
+        if (rowLoc >= fData.size())
+        {
+            continue;
+        }
+
+        // Rows untouched since the last frame hand over the image they already have
+        auto row = fData.at(rowLoc);
+        overlayMatches(*row, rowLoc, search);
+        Line &line = f.rows[r];
+        line.image = row->imageOf(cursor.cOffset, f.textCols);
+        line.end = line.image->text.size();
+    }
 }
 
-void TerminalGUI::drawRows(const TTEdCursor &cursor, const TTEdFileData &fData, const TTEdTermData &tData)
+void TerminalGUI::captureIndexedRows(const TTEdCursor &cursor, const TTEdFileData &fData, const TTEdTermData &tData, const TTEdSearch &search, Frame &f)
 {
+    // Config::scroll has synced the line index, so each screen line maps to a (row, segment) in O(log n)
+    size_t total = fData.lines.total();
     for (size_t r = 0; r < tData.sRow; ++r)
     {
-        size_t rowLoc = r + cursor.rOffset;
+        size_t lineNo = r + cursor.vOffset;
+        if (lineNo >= total)
+        {
+            continue;
+        }
 
-        if (rowLoc >= fData.size())
+        auto [rowLoc, seg] = fData.lines.find(lineNo);
+        auto row = fData.at(rowLoc);
+        overlayMatches(*row, rowLoc, search);
+        Line &line = f.rows[r];
+        line.first = seg == 0;
+        if (tData.softWrap)
         {
-            buf << "~\x1b[K\r\n";
+            // Every segment of a wrapped row shares one image of the whole row
+            line.image = row->imageOf(0, SIZE_MAX);
+            line.begin = row->segmentStart(seg);
+            line.end = seg < row->wrapBreaks.size() ? row->wrapBreaks[seg] : row->sRender.size();
         }
         else
         {
-            auto row = fData.at(rowLoc);
+            line.image = row->imageOf(cursor.cOffset, f.textCols);
+            line.end = line.image->text.size();
+        }
 
-            auto start = row->sRender.cbegin();
-            auto end = row->sRender.cend();
+        // The marker counts what unfolding shows, leaving out rows other folds keep hidden
+        bool lastSeg = !tData.softWrap || seg == row->wrapBreaks.size();
+        line.foldLen = lastSeg && row->foldLen > 0 ? fData.lines.revealed(rowLoc) : 0;
+    }
+}
 
-            if (cursor.cOffset < row->size())
-            {
-                start += cursor.cOffset;
-            }
+void TerminalGUI::overlayMatches(Row &row, size_t rowLoc, const TTEdSearch &search)
+{
+    if (row.matchGen == search.generation)
+    {
+        return;
+    }
+
+    // Matches in rendered columns, overlapping ones merged
+    std::vector<std::pair<size_t, size_t>> found;
+
+    // Map raw columns to rendered ones walking forward, as matches come in column order;
+    // Row::rawToRender would recount the tabs from the start of the row for every match
+    struct Walk { size_t raw = 0; size_t render = 0; } starts, ends;
+    auto toRender = [&](Walk &w, size_t cx) {
+        cx = std::min(cx, row.sRaw.size()); // Hits lag behind edits until the next keystroke in the prompt
+        if (cx < w.raw)
+        {
+            w = Walk{};
+        }
+        for (; w.raw < cx; w.raw++)
+        {
+            w.render += row.sRaw[w.raw] == '\t' ? TABSTOP : 1;
+        }
+        return w.render;
+    };
+    auto add = [&](size_t col, size_t len) {
+        size_t start = toRender(starts, col);
+        size_t end = toRender(ends, col + len);
+        if (!found.empty() && start <= found.back().second)
+        {
+            found.back().second = std::max(found.back().second, end);
+        }
+        else if (start < end)
+        {
+            found.push_back({start, end});
+        }
+    };
+    auto scan = [&](auto &matcher) {
+        std::vector<std::pair<size_t, size_t>> spans;
+        matcher.findAll(row.sRaw, spans);
+        for (auto [col, len] : spans)
+        {
+            add(col, len);
+        }
+    };
 
-            size_t shift = cursor.cOffset + tData.sCol;
-            if (row->sRender.size() > shift)
+    if (search.active && search.error.empty() && !search.query.empty())
+    {
+        if (search.complete)
+        {
+            for (long i = search.locate({rowLoc, 0}); i >= 0 && (size_t)i < search.hits.size() && search.hits[i].row == rowLoc; i++)
             {
-                end = start + shift;
+                add(search.hits[i].col, search.hits[i].len);
             }
+        }
+        else if (search.regex && search.compiled)
+        {
+            scan(*search.compiled);
+        }
+        else if (!search.regex && search.finder)
+        {
+            scan(*search.finder);
+        }
+    }
 
-            buf << "~ ";
-            int current_color = -1;
-            for (size_t i = 0; i < row->size(); i++) {
-                textState state = row->textStates.at(i);
-                if (state == TS_NORMAL) {
-                    if (current_color != -1) {
-                        buf << "\x1b[m";
-                        buf << "\x1b[39m";
-                        current_color = -1;
-                    }   
-                    buf << row->sRender.at(i);
-                }
-                else {
-                    int color = this->stateToColor.at(state);
-                    if (current_color != color) {
-                        current_color = color;
-                        buf << "\x1b[" << std::to_string(color) << "m";
-                    }
-                    buf << row->sRender.at(i);
+    if (found != row.matches)
+    {
+        row.matches.swap(found);
+        row.invalidateImage();
+    }
+    row.matchGen = search.generation;
+}
+
+void TerminalGUI::encodeWindow(const RowImage &image, size_t begin, size_t end, std::string &out)
+{
+    // Only the requested window is encoded, so the cost is bounded by the screen width
+    begin = std::min(begin, image.text.size());
+    end = std::min(end, image.text.size());
+
+    int current_color = -1;
+    const int searchColor = this->stateToColor.at(TS_SEARCH);
+    auto paint = [&](size_t from, size_t to, textState state) {
+        if (state == TS_NORMAL) {
+            if (current_color != -1) {
+                out += "\x1b[m";
+                out += "\x1b[39m";
+                current_color = -1;
+            }
+        }
+        else {
+            int color = this->stateToColor.at(state);
+            if (current_color != color) {
+                // A new foreground alone would leave the match's reverse video on
+                if (current_color == searchColor) {
+                    out += "\x1b[m";
                 }
+                current_color = color;
+                out += "\x1b[" + std::to_string(color) + "m";
+            }
+        }
+        out.append(image.text, from, to - from);
+    };
+
+    // Walk the syntax spans, splitting them where a match starts or ends
+    auto match = std::upper_bound(image.matches.begin(), image.matches.end(), begin,
+                                  [](size_t c, const std::pair<size_t, size_t> &m) { return c < m.second; });
+    auto first = std::upper_bound(image.spans.begin(), image.spans.end(), begin,
+                                  [](size_t c, const StateSpan &s) { return c < s.start; });
+    for (size_t s = first == image.spans.begin() ? 0 : first - image.spans.begin() - 1; s < image.spans.size() && image.spans[s].start < end; s++) {
+        const StateSpan &span = image.spans[s];
+        size_t spanEnd = s + 1 < image.spans.size() ? image.spans[s + 1].start : image.text.size();
+        size_t to = std::min(spanEnd, end);
+
+        for (size_t from = std::max(span.start, begin); from < to;) {
+            while (match != image.matches.end() && match->second <= from) {
+                match++;
+            }
+            if (match != image.matches.end() && match->first <= from) {
+                size_t stop = std::min(to, match->second);
+                paint(from, stop, TS_SEARCH);
+                from = stop;
+            }
+            else {
+                size_t stop = match != image.matches.end() ? std::min(to, match->first) : to;
+                paint(from, stop, span.state);
+                from = stop;
             }
-            buf << "\x1b[39m\x1b[K\r\n";
         }
     }
 }
 
-void TerminalGUI::drawStatusBar(const Config &cfg)
+void TerminalGUI::captureBars(const Config &cfg, Frame &f)
 {
-    buf << "\x1b[7m";
-
-    std::string leftStatus = cfg.fileData.filename + " - " + std::to_string(cfg.fileData.size()) + " lines";
+    f.message.clear();
+    f.info.clear();
+    f.leftStatus = cfg.fileData.filename + " - " + std::to_string(cfg.fileData.size()) + " lines";
+    if (Perf::enabled)
+    {
+        f.leftStatus = hudTimings();
+    }
 
     std::string fileType = (cfg.syntax != NULL ) ? cfg.syntax->filetype : "?";
-    std::string connectionStatus = (cfg.conn.connected) ? cfg.conn.host ? "(host)" : "(remote)" : "";
-    std::string rightStatus = connectionStatus + " | " + fileType + " | " + std::to_string(cfg.cursor.cy + 1) + "," + std::to_string(cfg.cursor.cx + 1);
+    std::string connectionStatus = (cfg.session.connected) ? cfg.session.host ? "(host, " + std::to_string(cfg.session.peers) + " connected)" : "(remote)"
+                                   : cfg.fileData.journaling ? "(offline)" : "";
+    f.rightStatus = connectionStatus + " | " + fileType + " | " + std::to_string(cfg.cursor.cy + 1) + "," + std::to_string(cfg.cursor.cx + 1);
     if (cfg.fileData.modified > 0)
     {
-        rightStatus += " M";
+        f.rightStatus += " M";
     }
 
-    std::string spaces(cfg.term.sCol - rightStatus.size() - leftStatus.size(), ' ');
+    const TTEdStatus &status = cfg.status;
+    if ((std::time(nullptr) - status.statusTime) < 5)
+    {
+        f.message.assign(status.statusMsg, 0, std::min(status.statusMsg.size(), cfg.term.sCol));
+    }
 
-    buf << leftStatus << spaces << rightStatus;
-    buf << "\x1b[m\r\n";
+    // The search position and the I/O half of the HUD go right of the message
+    const TTEdSearch &search = cfg.search;
+    std::string &right = f.info;
+    if (!search.error.empty())
+    {
+        right = "regex: " + search.error;
+    }
+    else if (search.current >= 0 && search.complete)
+    {
+        right = "match " + std::to_string(search.current + 1) + " of " + std::to_string(search.hits.size());
+    }
+    else if (search.current >= 0 && search.total > 0)
+    {
+        right = std::to_string(search.total) + " matches";
+    }
+    if (search.active && search.regex && search.error.empty())
+    {
+        right = "regex" + (right.empty() ? "" : "  " + right);
+    }
+    if (Perf::enabled)
+    {
+        right += (right.empty() ? "" : "  ") + hudCounters();
+    }
 }
 
-void TerminalGUI::drawMessageBar(const TTEdTermData &tData, const TTEdStatus &status)
+void TerminalGUI::compose(Frame &f)
 {
-    buf << "\x1b[K";
-    int msgLen = std::min(status.statusMsg.size(), tData.sCol);
-    if (msgLen && (std::time(nullptr) - status.statusTime) < 5)
+    TRACE_SCOPE("TerminalGUI::compose");
+    f.lines.resize(f.rows.size() + 2);
+    for (size_t r = 0; r < f.rows.size(); r++)
+    {
+        const Line &row = f.rows[r];
+        std::string &line = f.lines[r];
+        line.clear();
+        if (!row.image)
+        {
+            line += "~\x1b[K";
+            continue;
+        }
+
+        const RowImage &image = *row.image;
+        size_t end = std::min(row.end, image.text.size());
+        size_t begin = std::min(row.begin, end);
+        line += row.first ? "~ " : "  ";
+        if (begin == 0 && end == image.text.size())
+        {
+            // Images untouched since an earlier frame are emitted straight from their cached bytes
+            if (!image.encodedValid)
+            {
+                image.encoded.clear();
+                encodeWindow(image, 0, end, image.encoded);
+                image.encodedValid = true;
+            }
+            line += image.encoded;
+        }
+        else
+        {
+            encodeWindow(image, begin, end, line);
+        }
+
+        // A folded row ends with a count of the rows unfolding it shows, when there is room for it
+        if (row.foldLen > 0)
+        {
+            std::string marker = " ... " + std::to_string(row.foldLen) + " lines";
+            if (end - begin + marker.size() <= f.textCols)
+            {
+                line += "\x1b[m\x1b[90m" + marker;
+            }
+        }
+        line += "\x1b[39m\x1b[K";
+    }
+
+    // Truncate the left side so the HUD never pushes the status bar past the screen width
+    std::string &status = f.lines[f.rows.size()];
+    std::string left = f.leftStatus;
+    if (left.size() + f.rightStatus.size() > f.cols)
+    {
+        left.resize(f.cols > f.rightStatus.size() ? f.cols - f.rightStatus.size() : 0);
+    }
+    status.assign("\x1b[7m").append(left);
+    status.append(f.cols - f.rightStatus.size() - left.size(), ' ');
+    status.append(f.rightStatus).append("\x1b[m");
+
+    // Right-align the search position and HUD counters after the message when they fit
+    std::string &message = f.lines[f.rows.size() + 1];
+    message.assign("\x1b[K").append(f.message);
+    if (!f.info.empty() && f.message.size() + f.info.size() < f.cols)
     {
-        buf << status.statusMsg.substr(0, msgLen);
+        message.append(f.cols - f.message.size() - f.info.size(), ' ').append(f.info);
     }
 }
 
+bool TerminalGUI::present(Frame &f)
+{
+    TRACE_SCOPE("TerminalGUI::present");
+    std::vector<std::string> &frame = f.lines;
+    size_t sRow = frame.size() - 2;
+    size_t top = f.top;
+    bool indexed = f.indexed;
+
+    bool full = screen.size() != frame.size() || screenCols != f.cols;
+    if (full)
+    {
+        TermActions::hideCursor(buf);
+        TermActions::wipeScreen(buf);
+        screen.assign(frame.size(), std::string());
+        screenCols = f.cols;
+    }
+    else if (top != screenTop && indexed == screenIndexed)
+    {
+        // Scroll the text area in place so only the rows it exposes need sending
+        long shift = (long)top - (long)screenTop;
+        size_t n = std::abs(shift);
+        if (n < sRow)
+        {
+            TermActions::hideCursor(buf);
+            buf << "\x1b[m"; // Lines scrolled in take the current background
+            TermActions::scrollRegion(buf, 1, sRow, shift);
+
+            auto first = screen.begin(), last = screen.begin() + sRow;
+            if (shift > 0)
+            {
+                std::rotate(first, first + n, last);
+                std::for_each(last - n, last, [](std::string &l) { l.clear(); });
+            }
+            else
+            {
+                std::rotate(first, last - n, last);
+                std::for_each(first, first + n, [](std::string &l) { l.clear(); });
+            }
+        }
+    }
+    screenTop = top;
+    screenIndexed = indexed;
+
+    // Rewrite only the lines that differ from what the terminal already shows
+    bool drawn = buf.tellp() > 0;
+    for (size_t i = 0; i < frame.size(); i++)
+    {
+        if (frame[i] == screen[i])
+            continue;
+
+        if (!drawn)
+        {
+            TermActions::hideCursor(buf);
+            drawn = true;
+        }
+        buf << "\x1b[" << i + 1 << ";1H";
+        buf.write(frame[i].data(), frame[i].size());
+        screen[i].swap(frame[i]);
+    }
+
+    if (!drawn && f.sx == screenSx && f.sy == screenSy)
+    {
+        buf.str(""); // Nothing changed on screen, so an idle frame sends nothing
+        return false;
+    }
+
+    buf << "\x1b[" << f.sy + 1 << ";" << f.sx + CURSOR_X_SHIFT << "H";
+    TermActions::showCursor(buf);
+    screenSx = f.sx;
+    screenSy = f.sy;
+
+    if (f.sync)
+    {
+        // Have the terminal apply the whole frame at once instead of painting it as it arrives
+        std::string s = buf.str();
+        buf.str("");
+        TermActions::beginSync(buf);
+        buf << s;
+        TermActions::endSync(buf);
+    }
+    flushBuf();
+    framesPresented++;
+    return true;
+}
+
+void TerminalGUI::invalidate()
+{
+    // The screen model belongs to whichever thread presents
+    std::lock_guard<std::mutex> lock(renderMutex);
+    screen.clear();
+}
+
+void TerminalGUI::renderLoop()
+{
+    std::unique_lock<std::mutex> lock(renderMutex);
+    auto lastPresent = std::chrono::steady_clock::now() - FRAME_INTERVAL;
+    while (true)
+    {
+        renderCv.wait(lock, [this] { return pending || stopping; });
+        if (!pending)
+        {
+            break;
+        }
+
+        // A lone draw goes out at once; during a burst newer draws replace the frame until
+        // they pause or a refresh interval has passed since the last frame
+        auto deadline = lastPresent + FRAME_INTERVAL;
+        while (!stopping && std::chrono::steady_clock::now() < deadline)
+        {
+            size_t seq = pendingSeq;
+            auto until = std::min(deadline, std::chrono::steady_clock::now() + FRAME_QUIET);
+            if (!renderCv.wait_until(lock, until, [&] { return stopping || pendingSeq != seq; }))
+            {
+                break;
+            }
+        }
+        std::unique_ptr<Frame> f = std::move(pending);
+
+        // Only the frame that survived the burst is composed; idle frames send nothing, so
+        // they do not delay the next real one
+        lock.unlock();
+        if (show(*f))
+        {
+            lastPresent = std::chrono::steady_clock::now();
+        }
+        lock.lock();
+        spare = std::move(f);
+    }
+}
+
+bool TerminalGUI::show(Frame &f)
+{
+    using clock = std::chrono::steady_clock;
+    auto start = clock::now();
+    compose(f);
+    auto composed = clock::now();
+    if (!present(f))
+    {
+        return false;
+    }
+
+    // Timed here rather than by probes, as the per-frame sums belong to the frame being captured
+    if (f.timed)
+    {
+        auto ms = [](clock::duration d) { return std::chrono::duration<double, std::milli>(d).count(); };
+        f.perf[Perf::RENDER] += ms(composed - start);
+        f.perf[Perf::BYTES] += bytesOut.exchange(0);
+        Perf::endFrame(f.perf, f.captureMs + ms(clock::now() - start));
+    }
+    return true;
+}
+
+void TerminalGUI::startRenderThread()
+{
+    if (renderThread.joinable())
+    {
+        return;
+    }
+    stopping = false;
+    renderThread = std::thread(&TerminalGUI::renderLoop, this);
+}
+
+void TerminalGUI::stopRenderThread()
+{
+    if (!renderThread.joinable())
+    {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(renderMutex);
+        stopping = true;
+    }
+    renderCv.notify_one();
+    renderThread.join();
+}
+
+size_t TerminalGUI::presentedFrames() const
+{
+    return framesPresented;
+}
+
+std::string TerminalGUI::hudTimings()
+{
+    Perf::Window frame = Perf::window(Perf::FRAME);
+    char s[128];
+    snprintf(s, sizeof(s), "frame %.2f p99 %.2fms | hl %.2f render %.2f input %.2fms",
+             frame.last(), frame.p99(), Perf::window(Perf::HIGHLIGHT).last(),
+             Perf::window(Perf::RENDER).last(), Perf::window(Perf::INPUT).last());
+    return s;
+}
+
+std::string TerminalGUI::hudCounters()
+{
+    char s[128];
+    snprintf(s, sizeof(s), "out %.0fB rehl %.0f | net recv %.2f apply %.2fms",
+             Perf::window(Perf::BYTES).last(), Perf::window(Perf::REHIGHLIGHT).last(),
+             Perf::window(Perf::NET_RECV).p99(), Perf::window(Perf::NET_APPLY).p99());
+    return s;
+}
+
 std::string TerminalGUI::centerText(const Config &config, const std::string &s)
 {
     if (s.size() > config.term.sCol)
@@ -150,20 +585,65 @@ void TerminalGUI::genCoverPage(const Config &config, std::stringstream &s)
 
 void TerminalGUI::draw()
 {
-    TermActions::hideCursor(buf);
-    TermActions::wipeScreen(buf);
-    TermActions::resetCursor(buf);
+    TRACE_SCOPE("TerminalGUI::draw");
+    auto start = std::chrono::steady_clock::now();
     config.scroll();
-    drawRows(config.cursor, config.fileData, config.term);
-    drawStatusBar(config);
-    drawMessageBar(config.term, config.status);
-    updateCursor(config.cursor);
-    TermActions::showCursor(buf);
-    flushBuf();
+
+    // Snapshot the viewport; composing it into terminal lines is left to the render thread
+    std::unique_ptr<Frame> f;
+    {
+        std::lock_guard<std::mutex> lock(renderMutex);
+        f = std::move(spare);
+    }
+    if (!f)
+    {
+        f = std::make_unique<Frame>();
+    }
+    f->textCols = config.term.textCols();
+    f->indexed = config.term.softWrap || config.fileData.folds > 0;
+    f->top = f->indexed ? config.cursor.vOffset : config.cursor.rOffset;
+    f->cols = config.term.sCol;
+    f->sx = config.cursor.sx;
+    f->sy = config.cursor.sy;
+    f->sync = config.term.syncOutput;
+    captureRows(config.cursor, config.fileData, config.term, config.search, *f);
+    captureBars(config, *f);
+
+    // The work since the last draw goes with this frame, and is recorded only if it is presented
+    f->timed = Perf::enabled;
+    if (f->timed)
+    {
+        f->perf = Perf::take();
+        f->captureMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    if (renderThread.joinable())
+    {
+        {
+            std::lock_guard<std::mutex> lock(renderMutex);
+            if (pending && pending->timed && f->timed)
+            {
+                // A frame replaced before it was presented hands its work on to this one
+                for (size_t m = 0; m < Perf::FRAME_METRICS; m++)
+                    f->perf[m] += pending->perf[m];
+                f->captureMs += pending->captureMs;
+            }
+            pending = std::move(f);
+            pendingSeq++;
+        }
+        renderCv.notify_one();
+    }
+    else
+    {
+        show(*f);
+        spare = std::move(f);
+    }
 }
 
 void TerminalGUI::splashScreen()
 {
+    stopRenderThread();
+    invalidate();
     genCoverPage(config, buf);
     flushBuf();
     InputHandler::processKey(config, true);
@@ -171,6 +651,8 @@ void TerminalGUI::splashScreen()
 
 void TerminalGUI::reset()
 {
+    stopRenderThread();
+    invalidate();
     TermActions::wipeScreen(buf);
     TermActions::resetCursor(buf);
     flushBuf();
@@ -0,0 +1,87 @@
+#include <threadpool.hh>
+#include <algorithm>
+
+ThreadPool::ThreadPool(size_t threads)
+{
+    for (size_t i = 1; i < threads; i++)
+    {
+        workers.emplace_back(&ThreadPool::work, this);
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto &w : workers)
+    {
+        w.join();
+    }
+}
+
+size_t ThreadPool::size() const
+{
+    return workers.size() + 1;
+}
+
+void ThreadPool::drain(std::unique_lock<std::mutex> &lock)
+{
+    while (next < tasks)
+    {
+        size_t i = next++;
+        const auto &fn = *task;
+        lock.unlock();
+        fn(i);
+        lock.lock();
+        if (++finished == tasks)
+        {
+            done.notify_all();
+        }
+    }
+}
+
+void ThreadPool::work()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    size_t seen = 0;
+    while (true)
+    {
+        wake.wait(lock, [&] { return stopping || batch != seen; });
+        if (stopping)
+        {
+            return;
+        }
+        seen = batch;
+        drain(lock);
+    }
+}
+
+void ThreadPool::run(size_t count, const std::function<void(size_t)> &fn)
+{
+    if (count == 0)
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> serial(batchMutex);
+    std::unique_lock<std::mutex> lock(mutex);
+    task = &fn;
+    tasks = count;
+    next = 0;
+    finished = 0;
+    batch++;
+    wake.notify_all();
+
+    drain(lock);
+    done.wait(lock, [&] { return finished == tasks; });
+    task = nullptr;
+}
+
+ThreadPool &ThreadPool::shared()
+{
+    static ThreadPool pool(std::max(1u, std::thread::hardware_concurrency()));
+    return pool;
+}
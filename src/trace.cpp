@@ -0,0 +1,95 @@
+#include <trace.hh>
+#include <array>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+std::atomic<bool> Trace::active{false};
+
+namespace
+{
+    struct Event
+    {
+        const char *name;
+        uint64_t start;
+        uint64_t dur;
+    };
+
+    /**
+     * @brief Single-producer ring of events owned by one thread.
+     *
+     * Only the owning thread writes slots; head is published with release so a
+     * reader sees every slot below it fully written.
+     */
+    struct Ring
+    {
+        static constexpr size_t CAPACITY = 1 << 16;
+        std::array<Event, CAPACITY> events;
+        std::atomic<size_t> head{0};
+        size_t tid;
+    };
+
+    // Rings are only registered, never removed, so they outlive their threads until stop()
+    std::mutex registryLock;
+    std::vector<std::unique_ptr<Ring>> rings;
+    std::string outPath;
+    uint64_t epoch = 0;
+
+    Ring &localRing()
+    {
+        thread_local Ring *ring = nullptr;
+        if (!ring)
+        {
+            std::lock_guard<std::mutex> lock(registryLock);
+            rings.push_back(std::make_unique<Ring>());
+            ring = rings.back().get();
+            ring->tid = rings.size();
+        }
+        return *ring;
+    }
+}
+
+void Trace::start(const std::string &path)
+{
+    outPath = path;
+    epoch = now();
+    active.store(true, std::memory_order_relaxed);
+}
+
+void Trace::emit(const char *name, uint64_t startUs, uint64_t durUs)
+{
+    Ring &ring = localRing();
+    size_t h = ring.head.load(std::memory_order_relaxed);
+    ring.events[h % Ring::CAPACITY] = {name, startUs, durUs};
+    ring.head.store(h + 1, std::memory_order_release);
+}
+
+void Trace::stop()
+{
+    if (!active.exchange(false))
+        return;
+
+    std::ofstream ofs(outPath, std::ofstream::trunc);
+    ofs << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+
+    bool first = true;
+    std::lock_guard<std::mutex> lock(registryLock);
+    for (const auto &ring : rings)
+    {
+        size_t head = ring->head.load(std::memory_order_acquire);
+        size_t begin = head > Ring::CAPACITY ? head - Ring::CAPACITY : 0;
+        for (size_t i = begin; i < head; i++)
+        {
+            const Event &e = ring->events[i % Ring::CAPACITY];
+            if (e.start < epoch)
+                continue;
+
+            ofs << (first ? "\n" : ",\n")
+                << "{\"name\":\"" << e.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << ring->tid
+                << ",\"ts\":" << e.start - epoch << ",\"dur\":" << e.dur << "}";
+            first = false;
+        }
+    }
+    ofs << "\n]}\n";
+}